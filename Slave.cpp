@@ -17,6 +17,7 @@
 #include <memory>
 #include <regex>
 #include <string>
+#include <thread>
 
 #include "Slave.h"
 #include "SlaveStats.h"
@@ -32,7 +33,11 @@
 #include <m_ctype.h>
 #include <sql_common.h>
 
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <signal.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
 #include <unistd.h>
 
 #define packet_end_data 1
@@ -104,6 +109,40 @@ void sigUnblock(int signal)
     if (0 != ::pthread_sigmask(SIG_UNBLOCK, &sigSet, nullptr))
         LOG_ERROR(log, "Can't unblock signal: " << errno);
 }
+
+// Error, after which binlog is read again from the stored position
+class StreamBroken : public std::runtime_error
+{
+public:
+    using std::runtime_error::runtime_error;
+};
+
+// Identifier in backticks, backticks inside it are doubled
+std::string quoteName(const std::string& name)
+{
+    std::string quoted = "`";
+    for (const char c : name)
+    {
+        if (c == '`')
+            quoted += '`';
+        quoted += c;
+    }
+    quoted += '`';
+    return quoted;
+}
+
+const unsigned int FLAGS_OFFSET = 17;
+const uint16_t LOG_EVENT_ARTIFICIAL_F = 0x20;
+
+// Event of the binlog itself, not the fake ROTATE or FORMAT_DESCRIPTION_EVENT
+// sent at the start of each dump and not a heartbeat
+bool isProgress(const char* buf, unsigned long len)
+{
+    return len >= LOG_EVENT_HEADER_LEN
+        && (unsigned char) buf[EVENT_TYPE_OFFSET] != slave::HEARTBEAT_LOG_EVENT
+        && uint4korr(buf + LOG_POS_OFFSET) != 0
+        && !(uint2korr(buf + FLAGS_OFFSET) & LOG_EVENT_ARTIFICIAL_F);
+}
 }// anonymous-namespace
 
 
@@ -115,10 +154,20 @@ void Slave::init()
 
     LOG_TRACE(log, "Initializing libslave...");
 
-    check_master_version();
+    withControl([this](nanomysql::Connection& conn)
+    {
+        // All checks in one round trip
+        conn.query("SELECT VERSION();"
+                   " SHOW GLOBAL VARIABLES LIKE 'binlog_format';"
+                   " SHOW GLOBAL VARIABLES LIKE 'gtid_mode'");
+
+        check_master_version(conn);
 
-    check_master_binlog_format();
-    check_master_gtid_mode();
+        conn.next_result();
+        check_master_binlog_format(conn);
+        conn.next_result();
+        check_master_gtid_mode(conn);
+    });
 
     ext_state.loadMasterPosition(m_master_info.position);
 
@@ -132,6 +181,32 @@ void Slave::enableGtid(bool on)
     m_gtid_enabled = on;
 }
 
+void Slave::withControl(const std::function<void (nanomysql::Connection&)>& f) const
+{
+    mysql_guard::MysqlGuard::init();
+    std::lock_guard<std::mutex> lock(m_control_mutex);
+
+    // Idle connection may be closed by master after wait_timeout
+    if (m_control && !m_control->ping())
+    {
+        LOG_INFO(log, "Control connection to master is lost, reconnecting");
+        m_control.reset();
+    }
+    if (!m_control)
+        m_control.reset(new nanomysql::Connection(m_master_info.conn_options, CLIENT_MULTI_STATEMENTS));
+
+    try
+    {
+        f(*m_control);
+    }
+    catch (...)
+    {
+        // Results of the failed query may be left unread
+        m_control.reset();
+        throw;
+    }
+}
+
 void Slave::close_connection()
 {
     std::lock_guard<std::mutex> l(m_slave_thread_mutex);
@@ -147,57 +222,443 @@ void Slave::close_connection()
 }
 
 
-void Slave::createDatabaseStructure_(table_order_t& tabs, RelayLogInfo& rli) const
+void Slave::createDatabaseStructure_(table_order_t& tabs, RelayLogInfo& rli)
 {
     LOG_TRACE(log, "enter: createDatabaseStructure");
 
-    nanomysql::Connection conn(m_master_info.conn_options);
-    const collate_map_t collate_map = readCollateMap(conn);
+    // Structure is taken from the schema history as it was at the position replication
+    // starts from, so that events written before later ALTERs are decoded correctly.
+    Position pos;
+    if (m_schema_cache)
+    {
+        if (!ext_state.getMasterPosition(pos))
+            pos = m_master_info.position;
+        m_schema_cache->prune(pos);
+    }
 
+    // Master is queried only for tables missing in the schema cache
+    table_order_t missing;
 
     for (table_order_t::const_iterator it = tabs.begin(); it != tabs.end(); ++ it) {
 
         LOG_INFO( log, "Creating database structure for: " << it->first << ", Creating table for: " << it->second );
-        createTable(rli, it->first, it->second, collate_map, conn);
+
+        const SchemaCache::Entry* cached = m_schema_cache ? m_schema_cache->find(*it, pos) : nullptr;
+        if (cached) {
+            LOG_DEBUG(log, "Using cached structure of " << it->first << "." << it->second);
+            createTable(rli, it->first, it->second, cached->columns, true);
+            continue;
+        }
+
+        missing.insert(*it);
     }
 
+    if (!missing.empty())
+    {
+        withControl([this, &missing, &rli](nanomysql::Connection& conn)
+        {
+            for (const auto& key : missing)
+            {
+                const columns_t columns = readColumns(conn, key.first, key.second);
+                createTable(rli, key.first, key.second, columns, false);
+
+                if (m_schema_cache)
+                    m_schema_cache->put(key, columns, SchemaPoint());
+            }
+        });
+    }
+
+    if (m_schema_cache && m_schema_cache->dirty())
+        m_schema_cache->save();
+
     LOG_TRACE(log, "exit: createDatabaseStructure");
 }
 
+void Slave::reloadTable(const std::pair<std::string, std::string>& key, RelayLogInfo& rli,
+                        const SchemaPoint& point, bool use_cache)
+{
+    // DDL, which was already seen in the previous run, is taken from the history
+    const SchemaCache::Entry* cached = use_cache && m_schema_cache ? m_schema_cache->find(key, point) : nullptr;
+    if (cached)
+    {
+        LOG_DEBUG(log, "Using cached structure of " << key.first << "." << key.second
+                  << " at " << point.log_name << ":" << point.log_pos);
+        createTable(rli, key.first, key.second, cached->columns, true);
+    }
+    else
+    {
+        columns_t columns;
+        withControl([this, &key, &columns](nanomysql::Connection& conn)
+        {
+            columns = readColumns(conn, key.first, key.second);
+        });
+        createTable(rli, key.first, key.second, columns, false);
+
+        if (m_schema_cache)
+        {
+            m_schema_cache->put(key, columns, point);
+            m_schema_cache->save();
+        }
+    }
+
+    setTableCallbacks(key, rli);
+}
+
+void Slave::setTableCallbacks(const std::pair<std::string, std::string>& key, RelayLogInfo& rli)
+{
+    auto it = rli.m_table_map.find(key);
+    if (it != rli.m_table_map.end())
+    {
+        // Binding is checked before the table gets anything: rows of a table, which does not
+        // match its binding, are read again from the stored position instead of being lost
+        std::unique_ptr<RowBinder> binder;
+        const auto binding = m_bindings.find(key);
+        if (binding != m_bindings.end())
+        {
+            try
+            {
+                binder = binding->second->bind(*it->second);
+            }
+            catch (const std::exception& e)
+            {
+                throw StreamBroken("Binding of " + key.first + "." + key.second + " does not match its structure: " + e.what());
+            }
+        }
+
+        it->second->m_callback = m_callbacks[key];
+        it->second->m_filter = m_filters[key];
+        it->second->set_column_filter(m_column_filters[key]);
+        it->second->row_type = m_row_types[key];
+        it->second->m_binder = std::move(binder);
+    }
+}
+
+bool Slave::isSubscribed(const std::pair<std::string, std::string>& key)
+{
+    if (m_table_order.count(key) == 1)
+        return true;
+
+    for (const auto& x : m_pattern_callbacks)
+    {
+        if (!x.pattern.match(key))
+            continue;
+
+        LOG_INFO(log, "Table " << key.first << "." << key.second << " matches pattern " << x.pattern.str());
+
+        // Table is subscribed only when its structure is read. Table dropped on master since
+        // the event is not subscribed, other errors make the transaction to be read again.
+        table_order_t tabs {key};
+        try
+        {
+            createDatabaseStructure_(tabs, m_rli);
+        }
+        catch (const nanomysql::Error& e)
+        {
+            if (e.code() != ER_NO_SUCH_TABLE && e.code() != ER_BAD_DB_ERROR)
+                throw StreamBroken(e.what());
+            LOG_WARNING(log, "Table " << key.first << "." << key.second << " is not subscribed: " << e.what());
+            return false;
+        }
+        catch (const std::exception& e)
+        {
+            throw StreamBroken(e.what());
+        }
+
+        m_table_order.insert(key);
+        m_callbacks[key] = x.cb;
+        m_filters[key] = x.filter;
+        m_column_filters[key] = x.column_filter;
+        m_row_types[key] = x.row_type;
+        ext_state.initTableCount(key.first + "." + key.second);
+        setTableCallbacks(key, m_rli);
+        return true;
+    }
+
+    return false;
+}
+
+Slave::~Slave()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_changes_mutex);
+        m_loader_stop = true;
+    }
+    m_changes_cond.notify_one();
+    if (m_loader.joinable())
+        m_loader.join();
+
+    close_remote_binlog();
+    if (m_cancel_fd >= 0)
+        ::close(m_cancel_fd);
+}
+
+void Slave::addSubscription(const std::string& db_name, const std::string& tbl_name, callback _callback,
+                            const cols_t& column_filter, RowType row_type, EventKind filter)
+{
+    SubscriptionChange change;
+    change.key = std::make_pair(db_name, tbl_name);
+    change.cb = _callback;
+    change.column_filter = column_filter;
+    change.row_type = row_type;
+    change.filter = filter;
+
+    {
+        std::lock_guard<std::mutex> lock(m_changes_mutex);
+        m_changes.push_back(std::move(change));
+        if (!m_loader.joinable())
+            m_loader = std::thread(&Slave::loaderThread, this);
+    }
+    m_changes_cond.notify_one();
+}
+
+void Slave::removeSubscription(const std::string& db_name, const std::string& tbl_name)
+{
+    SubscriptionChange change;
+    change.key = std::make_pair(db_name, tbl_name);
+    change.add = false;
+    change.ready = true;
+
+    std::lock_guard<std::mutex> lock(m_changes_mutex);
+    m_changes.push_back(std::move(change));
+    if (m_changes.front().ready)
+        m_changes_ready = true;
+}
+
+void Slave::loaderThread()
+{
+    std::unique_ptr<nanomysql::Connection> conn;
+    std::unique_lock<std::mutex> lock(m_changes_mutex);
+
+    while (!m_loader_stop)
+    {
+        const auto it = std::find_if(m_changes.begin(), m_changes.end(),
+                                     [](const SubscriptionChange& x) { return !x.ready; });
+        if (it == m_changes.end())
+        {
+            // Do not keep idle connection to master
+            if (conn)
+            {
+                lock.unlock();
+                conn.reset();
+                lock.lock();
+            }
+            else
+                m_changes_cond.wait(lock);
+            continue;
+        }
+
+        const auto key = it->key;
+        lock.unlock();
+
+        columns_t columns;
+        bool failed = false;
+        try
+        {
+            if (!conn)
+                conn.reset(new nanomysql::Connection(m_master_info.conn_options));
+            columns = readColumns(*conn, key.first, key.second);
+        }
+        catch (const std::exception& e)
+        {
+            LOG_ERROR(log, "Failed to read structure of " << key.first << "." << key.second << ": " << e.what());
+            conn.reset();
+            failed = true;
+        }
+
+        lock.lock();
+
+        // Not ready changes are never removed, but the deque may grow meanwhile
+        for (auto& x : m_changes)
+        {
+            if (!x.ready && x.key == key)
+            {
+                x.columns = std::move(columns);
+                x.failed = failed;
+                x.ready = true;
+                break;
+            }
+        }
+        if (m_changes.front().ready)
+            m_changes_ready = true;
+    }
+
+    lock.unlock();
+    conn.reset();
+    ::mysql_thread_end();
+}
+
+void Slave::applySubscriptionChanges()
+{
+    if (!m_changes_ready.load(std::memory_order_acquire))
+        return;
+
+    std::vector<SubscriptionChange> changes;
+    {
+        std::lock_guard<std::mutex> lock(m_changes_mutex);
+        while (!m_changes.empty() && m_changes.front().ready)
+        {
+            changes.push_back(std::move(m_changes.front()));
+            m_changes.pop_front();
+        }
+        m_changes_ready = false;
+    }
+
+    for (const auto& x : changes)
+    {
+        const std::string name = x.key.first + "." + x.key.second;
+
+        if (!x.add)
+        {
+            LOG_INFO(log, "Unsubscribing from " << name);
+            m_table_order.erase(x.key);
+            m_callbacks.erase(x.key);
+            m_bindings.erase(x.key);
+            m_filters.erase(x.key);
+            m_column_filters.erase(x.key);
+            m_row_types.erase(x.key);
+            m_rli.eraseTable(x.key);
+            continue;
+        }
+
+        if (x.failed)
+        {
+            LOG_ERROR(log, "Subscription to " << name << " is dropped: its structure is not read");
+            continue;
+        }
+
+        LOG_INFO(log, "Subscribing to " << name);
+        try
+        {
+            // As in createDatabaseStructure_: history version actual at the current position
+            // is preferred, structure read from master is remembered in the schema cache
+            const SchemaCache::Entry* cached = m_schema_cache ? m_schema_cache->find(x.key, m_master_info.position) : nullptr;
+            if (cached)
+            {
+                LOG_DEBUG(log, "Using cached structure of " << name);
+                createTable(m_rli, x.key.first, x.key.second, cached->columns, true);
+            }
+            else
+            {
+                createTable(m_rli, x.key.first, x.key.second, x.columns, false);
+                if (m_schema_cache)
+                {
+                    m_schema_cache->put(x.key, x.columns, SchemaPoint());
+                    m_schema_cache->save();
+                }
+            }
+        }
+        catch (const std::exception& e)
+        {
+            LOG_ERROR(log, "Subscription to " << name << " is dropped: " << e.what());
+            continue;
+        }
+
+        m_table_order.insert(x.key);
+        m_callbacks[x.key] = x.cb;
+        m_filters[x.key] = x.filter;
+        m_column_filters[x.key] = x.column_filter;
+        m_row_types[x.key] = x.row_type;
+        ext_state.initTableCount(name);
+        setTableCallbacks(x.key, m_rli);
+    }
+
+    // Tables seen before may become subscribed or unsubscribed
+    m_table_verdicts.clear();
+}
+
+
+columns_t Slave::readColumns(nanomysql::Connection& conn,
+                             const std::string& db_name, const std::string& tbl_name) const
+{
+    LOG_TRACE(log, "enter: readColumns " << db_name << " " << tbl_name);
+
+    columns_t columns;
+
+    conn.query("SHOW FULL COLUMNS FROM " + quoteName(tbl_name) + " IN " + quoteName(db_name));
+    {
+        nanomysql::Cursor cur = conn.cursor();
+        const size_t field = cur.index("Field");
+        const size_t type = cur.index("Type");
+        while (cur.next())
+        {
+            ColumnInfo column;
+            column.name = cur[field].to_string();
+            column.type = cur[type].to_string();
+            columns.push_back(std::move(column));
+        }
+    }
+
+    nanomysql::fields_t fields;
+    conn.select_db(db_name);
+    conn.get_fields(tbl_name, fields);
+
+    for (auto& column : columns)
+    {
+        const nanomysql::field& m_field = fields.at(column.name);
+        column.mysql_type = m_field.type;
+        column.length = m_field.length;
+        column.flags = m_field.flags;
+        column.decimals = m_field.decimals;
+    }
+
+    return columns;
+}
 
 
 void Slave::createTable(RelayLogInfo& rli,
                         const std::string& db_name, const std::string& tbl_name,
-                        const collate_map_t& collate_map, nanomysql::Connection& conn) const
+                        const columns_t& columns, bool from_cache) const
 {
     LOG_TRACE(log, "enter: createTable " << db_name << " " << tbl_name);
 
-    nanomysql::Connection::result_t res;
-
-    conn.query("SHOW FULL COLUMNS FROM " + tbl_name + " IN " + db_name);
-    conn.store(res);
+    const auto options = m_field_options.find(std::make_pair(db_name, tbl_name));
+    const FieldOptions& field_options = options == m_field_options.end() ? m_default_field_options : options->second;
+
+    const uint64_t fingerprint = columnsFingerprint(columns);
+    PtrTableSchema schema = rli.getSchema(fingerprint, columns, field_options);
+    if (schema) {
+        LOG_DEBUG(log, "Sharing structure " << std::hex << fingerprint << std::dec << " with table " << db_name << "." << tbl_name);
+    } else {
+        schema = createSchema(columns, field_options);
+        schema->fingerprint = fingerprint;
+        rli.setSchema(schema);
+    }
 
-    std::unique_ptr<Table> table(new Table(db_name, tbl_name));
+    std::unique_ptr<Table> table(new Table(db_name, tbl_name, schema));
     Table* const table_ = table.get();
+    table->from_cache = from_cache;
 
     LOG_DEBUG(log, "Created new Table object: database:" << db_name << " table: " << tbl_name );
 
-    nanomysql::fields_t fields;
-    conn.select_db(db_name);
-    conn.get_fields(tbl_name, fields);
+    rli.setTable(tbl_name, db_name, std::move(table));
 
-    for (const auto& row : res)
+    const auto key = std::make_pair(db_name, tbl_name);
+    auto it = m_ddl_callbacks.find(key);
+    if (it != m_ddl_callbacks.end() && !m_txn_duplicate) {
+        it->second(db_name, tbl_name, table_->fields);
+    }
+}
+
+
+PtrTableSchema Slave::createSchema(const columns_t& columns, const FieldOptions& options) const
+{
+    PtrTableSchema schema = std::make_shared<TableSchema>();
+    schema->columns = m_schema_pool ? m_schema_pool->intern(columnsFingerprint(columns), columns)
+                                    : std::make_shared<const columns_t>(columns);
+    schema->options = options;
+
+    for (const auto& m_field : columns)
     {
-        const std::string& name = row.at("Field").data;
-        const std::string& type = row.at("Type").data;
-        const nanomysql::field& m_field = fields.at(name);
+        const std::string& name = m_field.name;
+        const std::string& type = m_field.type;
+        const ColumnOptions& column_options = options.get(name);
 
         PtrField field;
 
-        switch (m_field.type) {
+        switch (m_field.mysql_type) {
          // case MYSQL_TYPE_DECIMAL:
             case MYSQL_TYPE_NEWDECIMAL:
-                field = PtrField(new Field_decimal(name, type, m_field.length, m_field.decimals, m_field.flags & UNSIGNED_FLAG));
+                field = PtrField(new Field_decimal(name, type, m_field.length, m_field.decimals, m_field.flags & UNSIGNED_FLAG, column_options.decimal));
                 break;
 
             case MYSQL_TYPE_TINY:
@@ -240,22 +701,22 @@ void Slave::createTable(RelayLogInfo& rli,
 
             case MYSQL_TYPE_TIMESTAMP:
             case MYSQL_TYPE_TIMESTAMP2:
-                field = PtrField(new Field_timestamp(name, type, m_field.decimals, m_master_info.is_old_storage));
+                field = PtrField(new Field_timestamp(name, type, m_field.decimals, m_master_info.is_old_storage, column_options.timestamp));
                 break;
 
             case MYSQL_TYPE_TIME:
             case MYSQL_TYPE_TIME2:
-                field = PtrField(new Field_time(name, type, m_field.decimals, m_master_info.is_old_storage));
+                field = PtrField(new Field_time(name, type, m_field.decimals, m_master_info.is_old_storage, column_options.temporal));
                 break;
 
             case MYSQL_TYPE_DATETIME:
             case MYSQL_TYPE_DATETIME2:
-                field = PtrField(new Field_datetime(name, type, m_field.decimals, m_master_info.is_old_storage));
+                field = PtrField(new Field_datetime(name, type, m_field.decimals, m_master_info.is_old_storage, column_options.temporal));
                 break;
 
             case MYSQL_TYPE_DATE:
             case MYSQL_TYPE_NEWDATE:
-                field = PtrField(new Field_date(name, type));
+                field = PtrField(new Field_date(name, type, column_options.temporal));
                 break;
 
             case MYSQL_TYPE_YEAR:
@@ -271,10 +732,10 @@ void Slave::createTable(RelayLogInfo& rli,
          // case MYSQL_TYPE_SET:
             case MYSQL_TYPE_STRING:
                 if (m_field.flags & ENUM_FLAG) {
-                    field = PtrField(new Field_enum(name, type));
+                    field = PtrField(new Field_enum(name, type, column_options.enums));
                 }
                 else if (m_field.flags & SET_FLAG) {
-                    field = PtrField(new Field_set(name, type));
+                    field = PtrField(new Field_set(name, type, column_options.enums));
                 }
                 else {
                     field = PtrField(new Field_string(name, type, m_field.length));
@@ -292,27 +753,76 @@ void Slave::createTable(RelayLogInfo& rli,
                 field = PtrField(new Field_blob(name, type, m_field.length));
                 break;
 
+            case MYSQL_TYPE_JSON:
+                field = PtrField(new Field_json(name, type, column_options.json, column_options.partial_json));
+                break;
+
             default:
-                LOG_ERROR(log, "Slave::create_table(): class name don't exist for type: " << m_field.type );
+                LOG_ERROR(log, "Slave::create_table(): class name don't exist for type: " << m_field.mysql_type );
                 throw std::runtime_error("Slave::create_table(): error in field '" + name + "'");
         }
 
-        table->fields.push_back(std::move(field));
+        if (m_field.mysql_type == MYSQL_TYPE_JSON)
+            schema->json_columns.push_back(schema->fields.size());
+        schema->field_index.emplace(name, schema->fields.size());
+        schema->fields.push_back(std::move(field));
 
     }
 
+    return schema;
+}
 
-    rli.setTable(tbl_name, db_name, std::move(table));
+namespace
+{
+// Seconds, silent master is detected by read timeout of 2 heartbeat periods
+unsigned int binlogReadTimeout(const MasterInfo& master_info)
+{
+    const unsigned int read_timeout = master_info.conn_options.mysql_read_timeout;
+    const unsigned int heartbeat_timeout = 2 * master_info.heartbeat_period;
+    if (heartbeat_timeout > 0 && (read_timeout == 0 || heartbeat_timeout < read_timeout))
+        return heartbeat_timeout;
+    return read_timeout;
+}
 
-    const auto key = std::make_pair(db_name, tbl_name);
-    auto it = m_ddl_callbacks.find(key);
-    if (it != m_ddl_callbacks.end()) {
-        it->second(db_name, tbl_name, table_->fields);
-    }
+void setBinlogOptions(MYSQL* mysql, const MasterInfo& master_info)
+{
+    nanomysql::Connection::setOptions(mysql, master_info.conn_options);
+
+    const unsigned int read_timeout = binlogReadTimeout(master_info);
+    if (read_timeout != master_info.conn_options.mysql_read_timeout)
+        mysql_options(mysql, MYSQL_OPT_READ_TIMEOUT, &read_timeout);
 }
 
-namespace
+void setKeepalive(int fd, unsigned int idle)
 {
+    const int on = 1;
+    ::setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, &on, sizeof(on));
+#ifdef TCP_KEEPIDLE
+    const int idle_seconds = idle;
+    const int interval = std::max(1u, idle / 3);
+    const int count = 3;
+    ::setsockopt(fd, IPPROTO_TCP, TCP_KEEPIDLE, &idle_seconds, sizeof(idle_seconds));
+    ::setsockopt(fd, IPPROTO_TCP, TCP_KEEPINTVL, &interval, sizeof(interval));
+    ::setsockopt(fd, IPPROTO_TCP, TCP_KEEPCNT, &count, sizeof(count));
+#endif
+}
+
+void setBinlogSocket(int fd, const MasterInfo& master_info)
+{
+    if (master_info.heartbeat_period > 0)
+        setKeepalive(fd, master_info.heartbeat_period);
+
+    if (master_info.socket_rcvbuf > 0
+        && ::setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &master_info.socket_rcvbuf, sizeof(master_info.socket_rcvbuf)) != 0)
+        LOG_WARNING(log, "Can't set SO_RCVBUF of binlog connection: " << errno);
+#ifdef SO_BUSY_POLL
+    // Values above net.core.busy_read require CAP_NET_ADMIN
+    if (master_info.socket_busy_poll > 0
+        && ::setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &master_info.socket_busy_poll, sizeof(master_info.socket_busy_poll)) != 0)
+        LOG_WARNING(log, "Can't set SO_BUSY_POLL of binlog connection: " << errno);
+#endif
+}
+
 struct raii_mysql_connector
 {
     MYSQL* mysql;
@@ -320,13 +830,18 @@ struct raii_mysql_connector
     ExtStateIface &ext_state;
     pthread_t& thread_id;
     std::mutex& mutex;
+    Backoff& backoff;
+    std::function<void ()> failed;
 
-    raii_mysql_connector(MYSQL* m, MasterInfo& mmi, ExtStateIface& state, pthread_t& tid, std::mutex& mtx)
+    raii_mysql_connector(MYSQL* m, MasterInfo& mmi, ExtStateIface& state, pthread_t& tid, std::mutex& mtx,
+                         Backoff& bo, const std::function<void ()>& on_failure)
         : mysql(m)
         , m_master_info(mmi)
         , ext_state(state)
         , thread_id(tid)
         , mutex(mtx)
+        , backoff(bo)
+        , failed(on_failure)
     {
         connect(false);
     }
@@ -355,27 +870,31 @@ struct raii_mysql_connector
 
         bool was_error = reconnect;
         const auto& sConnOptions = m_master_info.conn_options;
-        nanomysql::Connection::setOptions(mysql, sConnOptions);
+        setBinlogOptions(mysql, m_master_info);
 
         using mysql_guard::mysql_safe_connect;
-        while (mysql_safe_connect(mysql,
-                                  sConnOptions.mysql_host.c_str(),
-                                  sConnOptions.mysql_user.c_str(),
-                                  sConnOptions.mysql_pass.c_str(), 0, sConnOptions.mysql_port, 0, CLIENT_REMEMBER_OPTIONS)
-               == 0) {
+        // Reconnect is delayed too: stream may fail right after successful connect
+        for (bool delay = reconnect; ; delay = true) {
 
+            if (delay) {
+                const auto pause = backoff.next();
+                LOG_TRACE(log, "try connect to master in " << pause.count() << " ms, reconnect = " << reconnect);
+                std::this_thread::sleep_for(pause);
+            }
+
+            if (mysql_safe_connect(mysql,
+                                   sConnOptions.mysql_host.c_str(),
+                                   sConnOptions.mysql_user.c_str(),
+                                   sConnOptions.mysql_pass.c_str(), 0, sConnOptions.mysql_port, 0, CLIENT_REMEMBER_OPTIONS)
+                != 0)
+                break;
 
             ext_state.setConnecting();
+            failed();
             if(!was_error) {
                 LOG_ERROR(log, "Couldn't connect to mysql master " << sConnOptions.mysql_host << ":" << sConnOptions.mysql_port);
                 was_error = true;
             }
-
-            LOG_TRACE(log, "try connect to master");
-            LOG_TRACE(log, "connect_retry = " << m_master_info.connect_retry << ", reconnect = " << reconnect);
-
-            //
-            ::sleep(m_master_info.connect_retry);
         }
 
         if(was_error)
@@ -404,12 +923,18 @@ void Slave::get_remote_binlog(const std::function<bool()>& _interruptFlag)
     sigUnblock(SIGURG);
     int count_packet = 0;
 
+    if (m_claims && !m_gtid_enabled)
+        throw std::runtime_error("Slave::get_remote_binlog(): hedged reading requires GTID mode");
+
     generateSlaveId();
 
     // Moved to Slave member
     // MYSQL mysql;
 
-    raii_mysql_connector __conn(&mysql, m_master_info, ext_state, m_slave_thread_id, m_slave_thread_mutex);
+    m_backoff.setLimits(std::chrono::milliseconds(m_master_info.reconnect_initial_ms),
+                        std::chrono::seconds(m_master_info.connect_retry));
+    raii_mysql_connector __conn(&mysql, m_master_info, ext_state, m_slave_thread_id, m_slave_thread_mutex,
+                                m_backoff, [this]() { connection_lost(); ++m_failed_connects; });
 
     //connect_to_master(false, &mysql);
 
@@ -417,6 +942,7 @@ void Slave::get_remote_binlog(const std::function<bool()>& _interruptFlag)
 
 connected:
     do_checksum_handshake(&mysql);
+    tune_binlog_connection(&mysql);
 
     // Get binlog position saved in ext_state before, or load it
     // from persistent storage. Get false if failed to get binlog position.
@@ -433,7 +959,16 @@ connected:
     LOG_INFO(log, "Starting from binlog_pos: " << m_master_info.position);
 
     request_dump(m_master_info.position, &mysql);
-    gtid_t gtid_next;
+    m_dump_at = std::chrono::steady_clock::now();
+    m_gtid_next = gtid_t();
+    m_txn.clear();
+    m_txn_sizes.clear();
+
+    const bool native = m_master_info.native_reader && !mysql_get_ssl_cipher(&mysql);
+    if (m_master_info.native_reader && !native)
+        LOG_WARNING(log, "Native reader is not used for TLS connection");
+    const int read_timeout_ms = binlogReadTimeout(m_master_info) ? binlogReadTimeout(m_master_info) * 1000 : -1;
+    m_stream.clear();
 
     while (!_interruptFlag()) {
 
@@ -441,7 +976,14 @@ connected:
 
             LOG_TRACE(log, "-- reading event --");
 
-            unsigned long len = read_event(&mysql);
+            const char* packet = nullptr;
+            unsigned long len;
+            if (native) {
+                len = read_native(packet, read_timeout_ms);
+            } else {
+                len = read_event(&mysql);
+                packet = (const char*) mysql.net.read_pos;
+            }
 
             ext_state.setStateProcessing(true);
 
@@ -452,9 +994,16 @@ connected:
 
             if (len == packet_error || len == packet_end_data) {
 
-                uint mysql_error_number = mysql_errno(&mysql);
+                // Errors of native reader are logged by read_native()
+                uint mysql_error_number = native ? 0 : mysql_errno(&mysql);
+                if (native && _interruptFlag()) {
+                    LOG_INFO(log, "Interrupt flag is true, breaking loop");
+                    continue;
+                }
 
                 switch(mysql_error_number) {
+                    case 0:
+                        break;
                     case ER_NET_PACKET_TOO_LARGE:
                         LOG_ERROR(log, "Myslave: Log entry on master is longer than max_allowed_packet on "
                                   "slave. If the entry is correct, restart the server with a higher value of "
@@ -478,6 +1027,7 @@ connected:
                         break;
                 }
 
+                connection_lost();
                 __conn.connect(true);
 
                 goto connected;
@@ -489,108 +1039,394 @@ connected:
                 continue;
             }
 
-            slave::Basic_event_info event;
+            // Errors of parsing and of callbacks don't concern the connection, next event is read at once
+            try {
+                dispatch_event(packet + 1, len - 1);
+                event_applied(packet + 1, len - 1);
+            } catch (const StreamBroken& _ex) {
+                LOG_ERROR(log, "Rereading binlog from the stored position: " << _ex.what());
+                if (event_stat)
+                    event_stat->tickError();
+                connection_lost();
+                __conn.connect(true);
+                goto connected;
+            } catch (const std::exception& _ex) {
+                LOG_ERROR(log, "Met exception in get_remote_binlog cycle. Message: " << _ex.what() );
+                if (event_stat)
+                    event_stat->tickError();
+            }
 
-            if (!slave::read_log_event((const char*) mysql.net.read_pos + 1,
-                                       len - 1,
-                                       event,
-                                       event_stat,
-                                       masterGe56(),
-                                       m_master_info)) {
+        } catch (const std::exception& _ex ) {
 
-                LOG_TRACE(log, "Skipping unknown event.");
-                continue;
-            }
+            LOG_ERROR(log, "Met exception in get_remote_binlog cycle. Message: " << _ex.what() );
+            if (event_stat)
+                event_stat->tickError();
+            std::this_thread::sleep_for(m_backoff.next());
+            continue;
 
-            //
+        }
+
+    } //while
+
+    LOG_WARNING(log, "Binlog monitor was stopped. Binlog events are not listened.");
 
-            LOG_TRACE(log, "Event log position: " << event.log_pos );
+    deregister_slave_on_master(&mysql);
+}
 
-            if (event.log_pos != 0) {
-                m_master_info.position.log_pos = event.log_pos;
-                ext_state.setLastEventTimePos(event.when, event.log_pos);
+void Slave::dispatch_event(const char* buf, unsigned long len)
+{
+    if (m_claims && hedge_event(buf, len))
+        return;
+    decode_event(buf, len);
+}
+
+bool Slave::hedge_event(const char* buf, unsigned long len)
+{
+    if (len <= EVENT_TYPE_OFFSET)
+        return false;
+
+    const Log_event_type type = static_cast<Log_event_type>(static_cast<unsigned char>(buf[EVENT_TYPE_OFFSET]));
+    if (type == GTID_LOG_EVENT) {
+        if (!m_txn_sizes.empty())
+            LOG_WARNING(log, "Incomplete transaction of " << m_txn_sizes.size() << " events is dropped");
+        m_txn.clear();
+        m_txn_sizes.clear();
+    } else if (m_txn_sizes.empty() || type == HEARTBEAT_LOG_EVENT) {
+        return false;
+    }
+
+    m_txn.append(buf, len);
+    m_txn_sizes.push_back(len);
+
+    if (type != GTID_LOG_EVENT && ends_transaction(type, buf, len))
+        deliver_transaction();
+    return true;
+}
+
+bool Slave::ends_transaction(Log_event_type type, const char* buf, unsigned long len) const
+{
+    switch (type) {
+    case XID_EVENT:
+    case XA_PREPARE_LOG_EVENT:
+    // Compressed transaction is the only event after GTID
+    case TRANSACTION_PAYLOAD_EVENT:
+        return true;
+    case QUERY_EVENT: {
+        const Query_event_info qei(buf, len - (m_master_info.checksumEnabled() ? BINLOG_CHECKSUM_LEN : 0));
+        // Statement right after GTID, which is not BEGIN, is DDL
+        if (m_txn_sizes.size() == 2)
+            return qei.query != "BEGIN";
+        return qei.query == "COMMIT" || qei.query == "ROLLBACK";
+    }
+    default:
+        return false;
+    }
+}
+
+void Slave::deliver_transaction()
+{
+    // Broken transaction must not be claimed: another source would skip it as a duplicate
+    if (m_master_info.checksumEnabled()) {
+        size_t offset = 0;
+        for (const size_t size : m_txn_sizes) {
+            if (!checksumMatches(m_txn.data() + offset, size)) {
+                LOG_ERROR(log, "CRC32 check failed, transaction of " << m_txn_sizes.size() << " events is dropped unclaimed");
+                if (event_stat)
+                    event_stat->tickError();
+                m_txn.clear();
+                m_txn_sizes.clear();
+                return;
             }
+            offset += size;
+        }
+        m_txn_verified = true;
+    }
 
-            LOG_TRACE(log, "seconds_behind_master: " << (::time(NULL) - event.when) );
+    const Gtid_event_info gei(m_txn.data(), m_txn_sizes.front());
 
+    std::unique_lock<std::mutex> lock = m_claims->lock();
+    m_txn_duplicate = !m_claims->claim(gtid_t(gei.m_sid, gei.m_gno));
+    if (m_txn_duplicate) {
+        LOG_TRACE(log, "Transaction " << gei.m_sid << ":" << gei.m_gno << " is delivered by another source");
+        lock.unlock();
+    }
 
-            // MySQL5.1.23 binlogs can be read only starting from a XID_EVENT
-            // MySQL5.1.23 ev->log_pos -- the binlog offset
+    // As in the read loop, error in one event doesn't stop the others
+    size_t offset = 0;
+    for (const size_t size : m_txn_sizes) {
+        try {
+            decode_event(m_txn.data() + offset, size);
+        } catch (const StreamBroken&) {
+            m_txn_duplicate = false;
+            m_txn_verified = false;
+            m_txn.clear();
+            m_txn_sizes.clear();
+            throw;
+        } catch (const std::exception& _ex) {
+            LOG_ERROR(log, "Met exception in transaction delivery. Message: " << _ex.what());
+            if (event_stat)
+                event_stat->tickError();
+        }
+        offset += size;
+    }
 
-            if (event.type == XID_EVENT) {
+    m_txn_duplicate = false;
+    m_txn_verified = false;
+    m_txn.clear();
+    m_txn_sizes.clear();
+}
 
-                if (!gtid_next.first.empty())
-                    m_master_info.position.addGtid(gtid_next);
-                ext_state.setMasterPosition(m_master_info.position);
+void Slave::decode_event(const char* buf, unsigned long len)
+{
+    slave::Basic_event_info event;
+
+    if (!m_event_filter.empty() || m_txn_duplicate) {
+        event.parse(buf, len);
+        // Duplicate transaction moves position and structure only
+        const bool duplicate = m_txn_duplicate && event.type != GTID_LOG_EVENT
+                            && event.type != XID_EVENT && event.type != QUERY_EVENT;
+        if (duplicate || !m_event_filter.accept(event)) {
+            skip_event(event);
+            return;
+        }
+    }
 
-                LOG_TRACE(log, "Got XID event. Using binlog pos: " << m_master_info.position);
+    const bool verify = !m_txn_verified && verify_checksum(buf, len);
+    if (!verify && !m_txn_verified && m_checksum_policy == ChecksumPolicy::Async)
+        m_async_checksum.push(buf, len);
+
+    if (!slave::read_log_event(buf,
+                               len,
+                               event,
+                               event_stat,
+                               masterGe56(),
+                               m_master_info,
+                               true,
+                               verify)) {
+
+        LOG_TRACE(log, "Skipping unknown event.");
+        return;
+    }
 
-                if (m_xid_callback)
-                    m_xid_callback(event.server_id);
+    handle_event(event);
+}
 
-            } else  if (event.type == ROTATE_EVENT) {
+void Slave::open_remote_binlog()
+{
+    if (m_stream_open)
+        close_remote_binlog();
+
+    if (m_cancel_fd < 0) {
+        const int fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (fd < 0)
+            throw std::runtime_error("Slave::open_remote_binlog(): eventfd() failed");
+        m_cancel_fd = fd;
+    }
+    uint64_t value;
+    while (::read(m_cancel_fd, &value, sizeof(value)) > 0) {}
+    m_cancelled = false;
 
-                slave::Rotate_event_info rei(event.buf, event.event_len);
+    if (m_claims && !m_gtid_enabled)
+        throw std::runtime_error("Slave::open_remote_binlog(): hedged reading requires GTID mode");
 
-                /*
-                 * new_log_ident - new binlog name
-                 * pos - position of the starting event
-                 */
+    generateSlaveId();
 
-                LOG_INFO(log, "Got rotate event.");
+    ext_state.setConnecting();
 
-                /* WTF
-                 */
+    if (!mysql_guard::mysql_safe_init(&mysql))
+        throw std::runtime_error("Slave::open_remote_binlog(): mysql_init() : could not initialize mysql structure");
 
-                if (event.when == 0) {
+    const auto& sConnOptions = m_master_info.conn_options;
+    setBinlogOptions(&mysql, m_master_info);
 
-                    //LOG_TRACE(log, "ROTATE_FAKE");
-                }
+    const bool ssl = !sConnOptions.mysql_ssl_ca.empty() || !sConnOptions.mysql_ssl_cert.empty()
+                  || !sConnOptions.mysql_ssl_key.empty();
+#if MYSQL_VERSION_ID >= 50711
+    if (!ssl) {
+        const unsigned int ssl_mode = SSL_MODE_DISABLED;
+        mysql_options(&mysql, MYSQL_OPT_SSL_MODE, &ssl_mode);
+    }
+#endif
 
-                m_master_info.position.log_name = rei.new_log_ident;
-                m_master_info.position.log_pos = rei.pos; // this will always be equal to 4
+    if (mysql_guard::mysql_safe_connect(&mysql,
+                                        sConnOptions.mysql_host.c_str(),
+                                        sConnOptions.mysql_user.c_str(),
+                                        sConnOptions.mysql_pass.c_str(), 0, sConnOptions.mysql_port, 0, 0) == 0) {
+        const std::string error = mysql_error(&mysql);
+        mysql_close(&mysql);
+        connection_lost();
+        ++m_failed_connects;
+        throw std::runtime_error("Slave::open_remote_binlog(): couldn't connect to mysql master "
+                                 + sConnOptions.mysql_host + ":" + std::to_string(sConnOptions.mysql_port) + ": " + error);
+    }
 
-                ext_state.setMasterPosition(m_master_info.position);
+    try {
+        if (ssl || mysql_get_ssl_cipher(&mysql))
+            throw std::runtime_error("Slave::open_remote_binlog(): TLS connection is not supported in non-blocking mode");
 
-                LOG_TRACE(log, "new position is " << m_master_info.position);
-                LOG_TRACE(log, "ROTATE_EVENT processed OK.");
-            }
-            else if (event.type == GTID_LOG_EVENT)
-            {
-                LOG_TRACE(log, "Got GTID event.");
-                if (!gtid_next.first.empty())
-                {
-                    m_master_info.position.addGtid(gtid_next);
-                    ext_state.setMasterPosition(m_master_info.position);
-                }
-                Gtid_event_info gei(event.buf, event.event_len);
-                LOG_TRACE(log, "GTID_NEXT: sid = " << gei.m_sid << ", gno =  " << gei.m_gno);
-                gtid_next.first = gei.m_sid;
-                gtid_next.second = gei.m_gno;
-            }
+        register_slave_on_master(&mysql);
+        do_checksum_handshake(&mysql);
+        tune_binlog_connection(&mysql);
 
-            else if (process_event(event, m_rli))
-            {
-                LOG_TRACE(log, "Error in processing event.");
+        if (!ext_state.getMasterPosition(m_master_info.position)) {
+            LOG_INFO(log, "There is no saved binlog_pos");
+            m_master_info.position = getLastBinlogPos();
+            ext_state.setMasterPosition(m_master_info.position);
+            ext_state.saveMasterPosition();
+        }
+
+        LOG_INFO(log, "Starting from binlog_pos: " << m_master_info.position);
+
+        request_dump(m_master_info.position, &mysql);
+        m_dump_at = std::chrono::steady_clock::now();
+    } catch (...) {
+        mysql_close(&mysql);
+        connection_lost();
+        ++m_failed_connects;
+        throw;
+    }
+
+    m_gtid_next = gtid_t();
+    m_txn.clear();
+    m_txn_sizes.clear();
+    m_stream.clear();
+    m_stream_open = true;
+    m_last_packet = std::chrono::steady_clock::now().time_since_epoch().count();
+}
+
+size_t Slave::pump(size_t budget)
+{
+    if (!m_stream_open)
+        throw std::runtime_error("Slave::pump(): binlog is not opened");
+
+    size_t handled = 0;
+    while (handled < budget && !m_cancelled.load(std::memory_order_relaxed)) {
+
+        const char* data;
+        size_t size;
+        if (!m_stream.next(data, size)) {
+            BinlogStream::Status status;
+            try {
+                status = m_stream.fill(mysql.net.fd);
+            } catch (const std::exception& _ex) {
+                // i.e. ECONNRESET, the stream is reopened by the caller as for a closed one
+                lose_stream(_ex.what());
+            }
+            if (status == BinlogStream::Status::WouldBlock) {
+                if (stalled())
+                    lose_stream("Slave::pump(): no packets from master during 2 heartbeat periods");
+                break;
             }
+            if (status == BinlogStream::Status::Closed)
+                lose_stream("Slave::pump(): connection to master is lost");
+            m_last_packet = std::chrono::steady_clock::now().time_since_epoch().count();
+            continue;
+        }
 
+        if (size == 0)
+            continue;
 
+        const unsigned char type = data[0];
+        if (type == 255) {
+            // ERR packet: error code, '#', sql state and message
+            const unsigned code = size >= 3 ? uint2korr(data + 1) : 0;
+            const std::string message = size > 9 ? std::string(data + 9, size - 9) : std::string();
+            LOG_ERROR(log, "Myslave: Error reading packet from server: " << message << "; mysql_error: " << code);
+            lose_stream("Slave::pump(): error from master: " + message);
+        }
+        if (type == 254 && size < 8)
+            lose_stream("Slave::pump(): master closed binlog stream");
 
-        } catch (const std::exception& _ex ) {
+        ext_state.setStateProcessing(true);
+        ++handled;
 
-            LOG_ERROR(log, "Met exception in get_remote_binlog cycle. Message: " << _ex.what() );
+        try {
+            dispatch_event(data + 1, size - 1);
+            event_applied(data + 1, size - 1);
+        } catch (const StreamBroken& _ex) {
+            ext_state.setStateProcessing(false);
+            lose_stream(_ex.what());
+        } catch (const std::exception& _ex) {
+            LOG_ERROR(log, "Met exception in pump. Message: " << _ex.what());
             if (event_stat)
                 event_stat->tickError();
-            usleep(1000*1000);
-            continue;
-
         }
+        ext_state.setStateProcessing(false);
+    }
 
-    } //while
+    return handled;
+}
 
-    LOG_WARNING(log, "Binlog monitor was stopped. Binlog events are not listened.");
+void Slave::close_remote_binlog()
+{
+    if (!m_stream_open)
+        return;
 
+    m_stream_open = false;
+    m_last_packet = 0;
+    m_stream.clear();
     deregister_slave_on_master(&mysql);
+    mysql_close(&mysql);
+}
+
+void Slave::lose_stream(const std::string& message)
+{
+    close_remote_binlog();
+    connection_lost();
+    throw std::runtime_error(message);
+}
+
+bool Slave::stalled() const
+{
+    const int64_t last = m_last_packet;
+    const unsigned int period = m_master_info.heartbeat_period;
+    return last != 0 && period != 0
+        && std::chrono::steady_clock::now().time_since_epoch().count() - last
+           > std::chrono::steady_clock::duration(std::chrono::seconds(2 * period)).count();
+}
+
+void Slave::connection_lost()
+{
+    if (m_lost)
+        return;
+    m_lost = true;
+    m_lost_at = std::chrono::steady_clock::now();
+    m_backoff.setLimits(std::chrono::milliseconds(m_master_info.reconnect_initial_ms),
+                        std::chrono::seconds(m_master_info.connect_retry));
+}
+
+void Slave::event_applied(const char* buf, unsigned long len)
+{
+    // Master may accept the dump and drop it at once, or the stream may break on the same event
+    // after each reconnect: then backoff goes on growing
+    if ((m_lost || m_backoff.attempt()) && isProgress(buf, len)
+        && std::chrono::steady_clock::now() - m_dump_at >= std::chrono::milliseconds(m_master_info.reconnect_initial_ms))
+        connection_restored();
+}
+
+void Slave::connection_restored()
+{
+    if (m_lost) {
+        const auto lost = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - m_lost_at);
+        LOG_INFO(log, "Binlog connection is restored after " << lost.count() << " ms and "
+                 << m_failed_connects << " failed attempts");
+        if (event_stat)
+            event_stat->tickReconnect(lost.count(), m_failed_connects);
+    }
+    m_lost = false;
+    m_failed_connects = 0;
+    m_backoff.reset();
+}
+
+void Slave::cancel()
+{
+    m_cancelled = true;
+    const int fd = m_cancel_fd;
+    if (fd >= 0) {
+        const uint64_t value = 1;
+        if (::write(fd, &value, sizeof(value)) < 0)
+            LOG_ERROR(log, "Slave::cancel(): write to eventfd failed: " << errno);
+    }
 }
 
 void Slave::register_slave_on_master(MYSQL* mysql)
@@ -642,17 +1478,13 @@ void Slave::deregister_slave_on_master(MYSQL* mysql)
     simple_command(mysql, COM_QUIT, 0, 0, 1);
 }
 
-void Slave::check_master_version()
+void Slave::check_master_version(nanomysql::Connection& conn)
 {
-    nanomysql::Connection conn(m_master_info.conn_options);
-    nanomysql::Connection::result_t res;
+    nanomysql::Cursor cur = conn.cursor();
 
-    conn.query("SELECT VERSION()");
-    conn.store(res);
-
-    if (res.size() == 1 && res[0].size() == 1)
+    if (cur.size() == 1 && cur.next())
     {
-        std::string tmp = res[0].begin()->second.data;
+        std::string tmp = cur[0].to_string();
         int major, minor, patch;
         if (3 == sscanf(tmp.c_str(), "%d.%d.%d", &major, &minor, &patch))
         {
@@ -669,22 +1501,18 @@ void Slave::check_master_version()
     throw std::runtime_error("Slave::check_master_version(): could not SELECT VERSION()");
 }
 
-void Slave::check_master_binlog_format()
+void Slave::check_master_binlog_format(nanomysql::Connection& conn)
 {
-    nanomysql::Connection conn(m_master_info.conn_options);
-    nanomysql::Connection::result_t res;
-
-    conn.query("SHOW GLOBAL VARIABLES LIKE 'binlog_format'");
-    conn.store(res);
+    nanomysql::Cursor cur = conn.cursor();
 
-    if (res.size() == 1 && res[0].size() == 2) {
+    if (cur.size() == 2 && cur.next()) {
 
-        std::map<std::string,nanomysql::field>::const_iterator z = res[0].find("Value");
+        const size_t z = cur.find("Value");
 
-        if (z == res[0].end())
+        if (z == nanomysql::Cursor::npos)
             throw std::runtime_error("Slave::create_table(): SHOW GLOBAL VARIABLES query did not return 'Value'");
 
-        std::string tmp = z->second.data;
+        std::string tmp = cur[z].to_string();
 
         if (tmp == "ROW") {
             return;
@@ -698,22 +1526,18 @@ void Slave::check_master_binlog_format()
     throw std::runtime_error("Slave::check_binlog_format(): Could not SHOW GLOBAL VARIABLES LIKE 'binlog_format'");
 }
 
-void Slave::check_master_gtid_mode()
+void Slave::check_master_gtid_mode(nanomysql::Connection& conn)
 {
-    nanomysql::Connection conn(m_master_info.conn_options);
-    nanomysql::Connection::result_t res;
-
-    conn.query("SHOW GLOBAL VARIABLES LIKE 'gtid_mode'");
-    conn.store(res);
+    nanomysql::Cursor cur = conn.cursor();
 
     m_master_info.gtid_mode = false;
-    if (res.size() == 1 && res[0].size() == 2)
+    if (cur.size() == 2 && cur.next())
     {
-        auto it = res[0].find("Value");
-        if (it == res[0].end())
+        const size_t z = cur.find("Value");
+        if (z == nanomysql::Cursor::npos)
             throw std::runtime_error("Slave::check_master_gtid_mode(): SHOW GLOBAL VARIABLES query did not return 'Value'");
 
-        m_master_info.gtid_mode = (it->second.data == "ON");
+        m_master_info.gtid_mode = (cur[z] == "ON");
     }
 }
 
@@ -755,10 +1579,26 @@ void Slave::do_checksum_handshake(MYSQL* mysql)
     LOG_TRACE(log, "Success doing checksum handshake");
 }
 
+void Slave::tune_binlog_connection(MYSQL* mysql)
+{
+    const unsigned int period = m_master_info.heartbeat_period;
+    if (period > 0) {
+        const std::string query = "SET @master_heartbeat_period = " + std::to_string(period * 1000000000ull);
+        if (mysql_real_query(mysql, query.data(), query.size()))
+            throw std::runtime_error("Slave::tune_binlog_connection(): query '" + query + "' failed: " + mysql_error(mysql));
+    }
+
+    setBinlogSocket(mysql->net.fd, m_master_info);
+    m_stream.setReadSize(m_master_info.read_size);
+}
+
 
 
 namespace
 {
+// Verdicts are dropped when there are too many table_ids, i.e. when tables are reopened often
+const size_t max_table_verdicts = 65536;
+
 std::string checkAlterOrCreateQuery(const std::string& str)
 {
     static const std::regex query_regex(R"((?:alter\s+table|create\s+table(?:\s+if\s+not\s+exists)?)\s+(?:(?:`[^`]+`|\w+)\s*\.\s*)?(?:`([^`]+)|(\w+)))",
@@ -776,6 +1616,196 @@ std::string checkAlterOrCreateQuery(const std::string& str)
 
 
 
+bool Slave::verify_checksum(const char* buf, unsigned int event_len) const
+{
+    // FORMAT_DESCRIPTION_EVENT is always checked, it turns checksums on and off
+    if (!m_master_info.checksumEnabled() || event_len < LOG_EVENT_HEADER_LEN + ROWS_MAPID_OFFSET + 6)
+        return true;
+
+    switch (m_checksum_policy) {
+    case ChecksumPolicy::All:
+        return true;
+    case ChecksumPolicy::Async:
+        return (slave::Log_event_type)buf[EVENT_TYPE_OFFSET] == FORMAT_DESCRIPTION_EVENT;
+    case ChecksumPolicy::Decoded:
+        break;
+    }
+
+    EventKind kind;
+    switch ((slave::Log_event_type)buf[EVENT_TYPE_OFFSET]) {
+    case WRITE_ROWS_EVENT_V1:
+    case WRITE_ROWS_EVENT:          kind = eInsert; break;
+    case UPDATE_ROWS_EVENT_V1:
+    case UPDATE_ROWS_EVENT:
+    case PARTIAL_UPDATE_ROWS_EVENT: kind = eUpdate; break;
+    case DELETE_ROWS_EVENT_V1:
+    case DELETE_ROWS_EVENT:         kind = eDelete; break;
+    // Events, which are skipped by process_event
+    case INTVAR_EVENT:
+    case RAND_EVENT:
+    case USER_VAR_EVENT:
+    case ROWS_QUERY_LOG_EVENT:
+    case ANONYMOUS_GTID_LOG_EVENT:
+    case PREVIOUS_GTIDS_LOG_EVENT:
+    case HEARTBEAT_LOG_EVENT:
+                                    return false;
+    default:
+        return true;
+    }
+
+    // Rows of tables without callbacks or filtered out are not decoded
+    const auto& table = m_rli.getTable(m_rli.getTableNameById(uint6korr(buf + LOG_EVENT_HEADER_LEN + ROWS_MAPID_OFFSET)));
+    return table && should_process(table->m_filter, kind);
+}
+
+void Slave::sync_checksums()
+{
+    if (m_checksum_policy != ChecksumPolicy::Async)
+        return;
+    try {
+        m_async_checksum.sync();
+    } catch (const std::exception& _ex) {
+        throw StreamBroken(_ex.what());
+    }
+}
+
+void Slave::commit_position()
+{
+    ext_state.setMasterPosition(m_master_info.position);
+}
+
+void Slave::skip_event(const slave::Basic_event_info& event)
+{
+    LOG_TRACE(log, "Skipping filtered event, type " << (int)event.type << ", log position " << event.log_pos);
+
+    if (event.type == TRANSACTION_PAYLOAD_EVENT)
+        sync_checksums();
+
+    if (event.log_pos != 0) {
+        m_master_info.position.log_pos = event.log_pos;
+        ext_state.setLastEventTimePos(event.when, event.log_pos);
+    }
+
+    // Payload contains the whole transaction up to XID
+    if (event.type == TRANSACTION_PAYLOAD_EVENT) {
+        if (!m_gtid_next.first.empty())
+            m_master_info.position.addGtid(m_gtid_next);
+        commit_position();
+    }
+
+    if (event_stat)
+        event_stat->tickPreFiltered();
+}
+
+void Slave::handle_event(const slave::Basic_event_info& event)
+{
+    LOG_TRACE(log, "Event log position: " << event.log_pos );
+
+    // Events, which move the stored position
+    if (event.type == XID_EVENT || event.type == ROTATE_EVENT || event.type == GTID_LOG_EVENT)
+        sync_checksums();
+
+    if (event.log_pos != 0) {
+        m_master_info.position.log_pos = event.log_pos;
+        ext_state.setLastEventTimePos(event.when, event.log_pos);
+    }
+
+    LOG_TRACE(log, "seconds_behind_master: " << (::time(NULL) - event.when) );
+
+
+    // MySQL5.1.23 binlogs can be read only starting from a XID_EVENT
+    // MySQL5.1.23 ev->log_pos -- the binlog offset
+
+    if (event.type == XID_EVENT) {
+
+        if (!m_gtid_next.first.empty())
+            m_master_info.position.addGtid(m_gtid_next);
+        commit_position();
+
+        LOG_TRACE(log, "Got XID event. Using binlog pos: " << m_master_info.position);
+
+        // TABLE_MAP signatures remembered during the transaction
+        if (m_schema_cache && m_schema_cache->dirty())
+            m_schema_cache->save();
+
+        if (m_xid_callback && !m_txn_duplicate)
+            m_xid_callback(event.server_id);
+
+    } else  if (event.type == ROTATE_EVENT) {
+
+        slave::Rotate_event_info rei(event.buf, event.event_len);
+
+        /*
+         * new_log_ident - new binlog name
+         * pos - position of the starting event
+         */
+
+        LOG_INFO(log, "Got rotate event.");
+
+        /* WTF
+         */
+
+        if (event.when == 0) {
+
+            //LOG_TRACE(log, "ROTATE_FAKE");
+        }
+
+        m_master_info.position.log_name = rei.new_log_ident;
+        m_master_info.position.log_pos = rei.pos; // this will always be equal to 4
+
+        commit_position();
+
+        LOG_TRACE(log, "new position is " << m_master_info.position);
+        LOG_TRACE(log, "ROTATE_EVENT processed OK.");
+    }
+    else if (event.type == GTID_LOG_EVENT)
+    {
+        LOG_TRACE(log, "Got GTID event.");
+        if (!m_gtid_next.first.empty())
+        {
+            m_master_info.position.addGtid(m_gtid_next);
+            commit_position();
+        }
+        Gtid_event_info gei(event.buf, event.event_len);
+        LOG_TRACE(log, "GTID_NEXT: sid = " << gei.m_sid << ", gno =  " << gei.m_gno);
+        m_gtid_next.first = gei.m_sid;
+        m_gtid_next.second = gei.m_gno;
+        m_event_filter.beginTransaction(m_gtid_next);
+    }
+
+    else if (event.type == TRANSACTION_PAYLOAD_EVENT)
+    {
+        LOG_TRACE(log, "Got TRANSACTION_PAYLOAD event.");
+        m_payload.read(event.buf, event.event_len, [this, &event](const char* buf, unsigned int len)
+        {
+            slave::Basic_event_info inner;
+            if (!m_event_filter.empty()) {
+                inner.parse(buf, len);
+                if (!m_event_filter.accept(inner)) {
+                    if (event_stat)
+                        event_stat->tickPreFiltered();
+                    return;
+                }
+            }
+            if (!slave::read_log_event(buf, len, inner, event_stat, masterGe56(), m_master_info, false))
+            {
+                LOG_TRACE(log, "Skipping unknown event.");
+                return;
+            }
+            // Events inside of payload have no positions of their own
+            inner.log_pos = event.log_pos;
+            handle_event(inner);
+        });
+
+        if (event_stat)
+            event_stat->tickTransactionPayload(m_payload.lastCompressed(), m_payload.lastUncompressed());
+    }
+    else if (process_event(event, m_rli))
+    {
+        LOG_TRACE(log, "Error in processing event.");
+    }
+}
+
 int Slave::process_event(const slave::Basic_event_info& bei, RelayLogInfo& m_rli)
 {
 
@@ -794,6 +1824,10 @@ int Slave::process_event(const slave::Basic_event_info& bei, RelayLogInfo& m_rli
 
         LOG_TRACE(log, "Received QUERY_EVENT: " << qei.query);
 
+        // Subscriptions are changed between transactions only
+        if (qei.query == "BEGIN")
+            applySubscriptionChanges();
+
         const auto tbl_name = checkAlterOrCreateQuery(qei.query);
         if (!tbl_name.empty())
         {
@@ -801,16 +1835,7 @@ int Slave::process_event(const slave::Basic_event_info& bei, RelayLogInfo& m_rli
             if (m_table_order.count(key) == 1)
             {
                 LOG_DEBUG(log, "Rebuilding database structure.");
-                table_order_t order {key};
-                createDatabaseStructure_(order, m_rli);
-                auto it = m_rli.m_table_map.find(key);
-                if (it != m_rli.m_table_map.end())
-                {
-                    it->second->m_callback = m_callbacks[key];
-                    it->second->m_filter = m_filters[key];
-                    it->second->set_column_filter(m_column_filters[key]);
-                    it->second->row_type = m_row_types[key];
-                }
+                reloadTable(key, m_rli, SchemaPoint(m_master_info.position.log_name, bei.log_pos, m_gtid_next), true);
             }
         }
         break;
@@ -823,13 +1848,45 @@ int Slave::process_event(const slave::Basic_event_info& bei, RelayLogInfo& m_rli
         slave::Table_map_event_info tmi(bei.buf, bei.event_len);
 
         const auto table_key = std::make_pair(tmi.m_dbnam, tmi.m_tblnam);
-        if (m_table_order.find(table_key) == m_table_order.cend()) {
+
+        // table_id of a table changes only when it is reopened on master, so
+        // subscriptions are matched only for the first TABLE_MAP of the table
+        if (m_table_verdicts.size() > max_table_verdicts)
+            m_table_verdicts.clear();
+        TableVerdict& verdict = m_table_verdicts[tmi.m_table_id];
+        if (verdict.key != table_key) {
+            // Verdict is not kept if reading structure of a matched table breaks the stream
+            verdict.key.first.clear();
+            verdict.subscribed = isSubscribed(table_key);
+            verdict.key = table_key;
+        }
+
+        if (!verdict.subscribed) {
             LOG_TRACE(log, "Ignoring TABLE_MAP_EVENT for unreplicated table");
             break;
         }
 
         m_rli.setTableName(tmi.m_table_id, tmi.m_tblnam, tmi.m_dbnam);
 
+        if (m_schema_cache)
+        {
+            const auto& table = m_rli.getTable(table_key);
+            if (table && !table->map_checked)
+            {
+                table->map_checked = true;
+                const bool same = m_schema_cache->checkSignature(table_key, table->schema->fingerprint, m_master_info.is_old_storage,
+                                                                              tmi.m_cols_types, tmi.m_metadata)
+                               && tmi.m_cols_types.size() == table->fields.size();
+                if (!same && table->from_cache)
+                {
+                    LOG_WARNING(log, "Cached structure of " << tmi.m_dbnam << '.' << tmi.m_tblnam
+                                << " does not match TABLE_MAP event, reloading it from master");
+                    reloadTable(table_key, m_rli, SchemaPoint(m_master_info.position.log_name, bei.log_pos, m_gtid_next), false);
+                    m_rli.getTable(table_key)->map_checked = true;
+                }
+            }
+        }
+
         if (m_master_version >= 50604)
         {
             const auto& table = m_rli.getTable(table_key);
@@ -844,9 +1901,11 @@ int Slave::process_event(const slave::Basic_event_info& bei, RelayLogInfo& m_rli
                     case MYSQL_TYPE_FLOAT:
                     case MYSQL_TYPE_DOUBLE:
                     case MYSQL_TYPE_GEOMETRY:
-                    case MYSQL_TYPE_JSON:
                         metadata++;
                         break;
+                    case MYSQL_TYPE_JSON:
+                        static_cast<Field_json*>(table->fields[i].get())->set_size(*metadata++);
+                        break;
                     case MYSQL_TYPE_BIT:
                     case MYSQL_TYPE_NEWDECIMAL:
                         metadata += 2;
@@ -937,6 +1996,12 @@ int Slave::process_event(const slave::Basic_event_info& bei, RelayLogInfo& m_rli
         apply_row_event(m_rli, bei, roi, ext_state, event_stat);
     } break;
 
+    case PARTIAL_UPDATE_ROWS_EVENT: {
+        LOG_TRACE(log, "Got PARTIAL_UPDATE_ROWS_EVENT");
+        Row_event_info roi(bei.buf, bei.event_len, true, true);
+        apply_row_event(m_rli, bei, roi, ext_state, event_stat);
+    } break;
+
     default:
         break;
     }
@@ -1006,6 +2071,43 @@ void Slave::request_dump(const Position& pos, MYSQL* mysql)
     }
 }
 
+ulong Slave::read_native(const char*& packet, int timeout_ms)
+{
+    ext_state.setStateProcessing(false);
+
+    size_t size;
+    try {
+        while (!m_stream.next(packet, size)) {
+            if (!BinlogStream::wait(mysql.net.fd, timeout_ms)) {
+                LOG_ERROR(log, "Myslave: no packets from server during " << timeout_ms << " ms");
+                return packet_error;
+            }
+            if (m_stream.fill(mysql.net.fd) == BinlogStream::Status::Closed) {
+                LOG_WARNING(log, "Myslave: Lost connection to MySQL server");
+                return packet_error;
+            }
+        }
+    } catch (const std::exception& e) {
+        LOG_ERROR(log, "Myslave: Error reading packet from server: " << e.what());
+        return packet_error;
+    }
+
+    if (size > 0 && static_cast<unsigned char>(packet[0]) == 255) {
+        // ERR packet: error code, '#', sql state and message
+        const unsigned code = size >= 3 ? uint2korr(packet + 1) : 0;
+        LOG_ERROR(log, "Myslave: Error reading packet from server: "
+                  << (size > 9 ? std::string(packet + 9, size - 9) : std::string()) << "; mysql_error: " << code);
+        return packet_error;
+    }
+
+    if (size > 0 && size < 8 && static_cast<unsigned char>(packet[0]) == 254) {
+        LOG_ERROR(log, "read_event(): end of data\n");
+        return packet_end_data;
+    }
+
+    return size;
+}
+
 ulong Slave::read_event(MYSQL* mysql)
 {
 
@@ -1040,23 +2142,19 @@ void Slave::generateSlaveId()
 
     std::set<unsigned int> server_ids;
 
-    nanomysql::Connection conn(m_master_info.conn_options);
-    nanomysql::Connection::result_t res;
-
-    conn.query("SHOW SLAVE HOSTS");
-    conn.store(res);
-
-    for (nanomysql::Connection::result_t::const_iterator i = res.begin(); i != res.end(); ++i) {
-
-        //row[0] - server_id
-
-        std::map<std::string,nanomysql::field>::const_iterator z = i->find("Server_id");
+    withControl([&server_ids](nanomysql::Connection& conn)
+    {
+        conn.query("SHOW SLAVE HOSTS");
+        nanomysql::Cursor cur = conn.cursor();
 
-        if (z == i->end())
+        const size_t z = cur.find("Server_id");
+        if (z == nanomysql::Cursor::npos)
             throw std::runtime_error("Slave::create_table(): SHOW SLAVE HOSTS query did not return 'Server_id'");
 
-        server_ids.insert(::strtoul(z->second.data.c_str(), NULL, 10));
-    }
+        while (cur.next()) {
+            server_ids.insert(cur.as<unsigned int>(z));
+        }
+    });
 
     unsigned int serveroid = ::time(NULL);
     serveroid ^= (::getpid() << 16);
@@ -1077,36 +2175,36 @@ void Slave::generateSlaveId()
 
 Position Slave::getLastBinlogPos() const
 {
-    nanomysql::Connection conn(m_master_info.conn_options);
-    nanomysql::Connection::result_t res;
-
     static const std::string query = "SHOW MASTER STATUS";
-    conn.query(query);
-    conn.store(res);
-
-    if (res.size() == 1) {
-        Position result;
+    Position result;
+    bool found = false;
 
-        std::map<std::string,nanomysql::field>::const_iterator z = res[0].find("File");
+    withControl([&result, &found](nanomysql::Connection& conn)
+    {
+        conn.query(query);
+        nanomysql::Cursor cur = conn.cursor();
 
-        if (z == res[0].end())
+        const size_t file = cur.find("File");
+        if (file == nanomysql::Cursor::npos)
             throw std::runtime_error("Slave::create_table(): " + query + " query did not return 'File'");
 
-        result.log_name = z->second.data;
-
-        z = res[0].find("Position");
-
-        if (z == res[0].end())
+        const size_t position = cur.find("Position");
+        if (position == nanomysql::Cursor::npos)
             throw std::runtime_error("Slave::create_table(): " + query + " query did not return 'Position'");
 
-        result.log_pos = std::strtoul(z->second.data.c_str(), nullptr, 10);
+        const size_t gtid = cur.find("Executed_Gtid_Set");
 
-        z = res[0].find("Executed_Gtid_Set");
-        if (z != res[0].end())
-            result.parseGtid(z->second.data);
+        if (cur.next()) {
+            result.log_name = cur[file].to_string();
+            result.log_pos = cur.as<unsigned long>(position);
+            if (gtid != nanomysql::Cursor::npos)
+                result.parseGtid(cur[gtid].to_string());
+            found = !cur.next();
+        }
+    });
 
+    if (found)
         return result;
-    }
 
     throw std::runtime_error("Slave::getLastBinLog(): Could not " + query);
 }
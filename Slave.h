@@ -22,21 +22,37 @@
 #define __SLAVE_SLAVE_H_
 
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
 #include <functional>
 #include <string>
+#include <thread>
 #include <vector>
 #include <map>
 #include <set>
 #include <memory>
 #include <mutex>
+#include <unordered_map>
 
 #include <pthread.h>
 
 #include <mysql.h>
 
+#include "backoff.h"
 #include "binlog_pos.h"
+#include "binlog_stream.h"
+#include "checksum.h"
+#include "event_filter.h"
+#include "gtid_claims.h"
+#include "schema_cache.h"
+#include "schema_pool.h"
+#include "row_binding.h"
 #include "slave_log_event.h"
 #include "SlaveStats.h"
+#include "table_pattern.h"
+#include "transaction_payload.h"
 
 
 namespace slave
@@ -55,6 +71,7 @@ public:
     typedef std::vector<std::string> cols_t;
     typedef std::map<std::pair<std::string, std::string>, cols_t> column_filters_t;
     typedef std::map<std::pair<std::string, std::string>, RowType> row_types_t;
+    typedef std::map<std::pair<std::string, std::string>, FieldOptions> field_options_t;
 
 private:
     static inline bool falseFunction() { return false; };
@@ -72,20 +89,137 @@ private:
 
     table_order_t m_table_order;
     callbacks_t m_callbacks;
+    std::map<std::pair<std::string, std::string>, PtrRowBinding> m_bindings;
     ddl_callbacks_t m_ddl_callbacks;
     filters_t m_filters;
     column_filters_t m_column_filters;
     row_types_t m_row_types;
+    FieldOptions m_default_field_options;
+    field_options_t m_field_options;
+
+    // Subscription by pattern, see setCallbackPattern
+    struct PatternCallback
+    {
+        TablePattern pattern;
+        callback     cb;
+        cols_t       column_filter;
+        RowType      row_type;
+        EventKind    filter;
+    };
+    std::vector<PatternCallback> m_pattern_callbacks;
+
+    // Verdict on the table of TABLE_MAP event by table_id, so that subscriptions
+    // are matched once per table no matter how many patterns are registered.
+    struct TableVerdict
+    {
+        std::pair<std::string, std::string> key;
+        bool subscribed = false;
+    };
+    std::unordered_map<unsigned long, TableVerdict> m_table_verdicts;
+
+    // Subscription added or removed while binlog is being read, see addSubscription
+    struct SubscriptionChange
+    {
+        std::pair<std::string, std::string> key;
+        bool      add = true;
+        callback  cb;
+        cols_t    column_filter;
+        RowType   row_type = RowType::Map;
+        EventKind filter = eAll;
+        // Structure read by the loader thread
+        columns_t columns;
+        bool      ready = false;
+        bool      failed = false;
+    };
+    // Changes in order of calls, applied from the front once they are ready
+    std::deque<SubscriptionChange> m_changes;
+    std::mutex m_changes_mutex;
+    std::condition_variable m_changes_cond;
+    // The front change is ready, checked without lock at every transaction start
+    std::atomic<bool> m_changes_ready {false};
+    std::thread m_loader;
+    bool m_loader_stop = false;
+
+    void loaderThread();
+    void applySubscriptionChanges();
 
     typedef std::function<void (unsigned int)> xid_callback_t;
     xid_callback_t m_xid_callback;
 
     RelayLogInfo m_rli;
 
+    std::unique_ptr<SchemaCache> m_schema_cache;
+    std::shared_ptr<SchemaPool> m_schema_pool;
+
+    // GTID of the transaction being read
+    gtid_t m_gtid_next;
+
+    // Decompression of TRANSACTION_PAYLOAD events, its buffer is reused
+    TransactionPayload m_payload;
+
+    ChecksumPolicy m_checksum_policy = ChecksumPolicy::All;
+    AsyncChecksum  m_async_checksum;
+
+    EventFilter m_event_filter;
+
     pthread_t m_slave_thread_id = 0;
     std::mutex m_slave_thread_mutex;
 
-    void createDatabaseStructure_(table_order_t& tabs, RelayLogInfo& rli) const;
+    // Non-blocking mode, see open_remote_binlog
+    BinlogStream m_stream;
+    bool m_stream_open = false;
+    std::atomic<int> m_cancel_fd {-1};
+    std::atomic<bool> m_cancelled {false};
+    // Steady clock time of the last packet in non-blocking mode, 0 - binlog is closed
+    std::atomic<int64_t> m_last_packet {0};
+
+    // Reconnects: delays, time and number of failed attempts since connection is lost
+    Backoff m_backoff {std::chrono::milliseconds(100), std::chrono::seconds(10)};
+    std::chrono::steady_clock::time_point m_lost_at;
+    std::chrono::steady_clock::time_point m_dump_at;
+    bool m_lost = false;
+    unsigned m_failed_connects = 0;
+
+    // Hedged reading, see setGtidClaims: events of the current transaction are kept until
+    // it is complete. Duplicate transaction is replayed for DDL and position only.
+    std::shared_ptr<GtidClaims> m_claims;
+    std::string m_txn;
+    std::vector<size_t> m_txn_sizes;
+    bool m_txn_duplicate = false;
+    // Checksums of the transaction being replayed are already verified
+    bool m_txn_verified = false;
+
+    // Keeps event of a transaction, returns false for events out of transactions
+    bool hedge_event(const char* buf, unsigned long len);
+    bool ends_transaction(Log_event_type type, const char* buf, unsigned long len) const;
+    void deliver_transaction();
+
+    void connection_lost();
+    // Called after an applied event: connection is restored by a real event of a dump,
+    // which is not dropped at once
+    void event_applied(const char* buf, unsigned long len);
+    // Reports tickReconnect and resets backoff
+    void connection_restored();
+    // Closes binlog in non-blocking mode and throws
+    [[noreturn]] void lose_stream(const std::string& message);
+
+    // Connection for queries to master: startup checks, slave id, binlog position and
+    // table structure. It is opened once and reused while alive, see withControl.
+    mutable std::unique_ptr<nanomysql::Connection> m_control;
+    mutable std::mutex m_control_mutex;
+
+    void withControl(const std::function<void (nanomysql::Connection&)>& f) const;
+
+    void createDatabaseStructure_(table_order_t& tabs, RelayLogInfo& rli);
+    // Rebuilds table after DDL at given point. With use_cache structure of already known
+    // DDL is taken from the schema history, otherwise it is read from master.
+    void reloadTable(const std::pair<std::string, std::string>& key, RelayLogInfo& rli,
+                     const SchemaPoint& point, bool use_cache);
+    void setTableCallbacks(const std::pair<std::string, std::string>& key, RelayLogInfo& rli);
+    // Checks explicit subscriptions and patterns. Table matching a pattern is subscribed
+    // and its structure is created. Throws StreamBroken if structure can't be read,
+    // except for a table absent on master, which is not subscribed.
+    bool isSubscribed(const std::pair<std::string, std::string>& key);
 
 public:
 
@@ -93,6 +227,7 @@ public:
     Slave(ExtStateIface &state) : ext_state(state) {}
     Slave(const MasterInfo& _master_info) : m_master_info(_master_info), ext_state(empty_ext_state) {}
     Slave(const MasterInfo& _master_info, ExtStateIface &state) : m_master_info(_master_info), ext_state(state) {}
+    ~Slave();
 
     void linkEventStat(EventStatIface* _event_stat)
     {
@@ -102,6 +237,10 @@ public:
     // Makes sense only when get_remote_binlog is not started
     void setMasterInfo(const MasterInfo& aMasterInfo)
     {
+        {
+            std::lock_guard<std::mutex> lock(m_control_mutex);
+            m_control.reset();
+        }
         m_master_info = aMasterInfo;
         ext_state.setMasterPosition(aMasterInfo.position);
     }
@@ -123,6 +262,7 @@ public:
         const std::pair<std::string, std::string> key = std::make_pair(_db_name, _tbl_name);
         m_table_order.insert(key);
         m_callbacks[key] = _callback;
+        m_bindings.erase(key);
         m_filters[key] = filter;
         m_column_filters[key] = cols_t();
         m_row_types[key] = row_type;
@@ -130,6 +270,62 @@ public:
         ext_state.initTableCount(_db_name + "." + _tbl_name);
     }
 
+    // Rows of the table are decoded into structures of the binding and passed to its callback,
+    // see row_binding.h. Binding is checked against table structure in createDatabaseStructure.
+    // When ALTER breaks it, the stream stops at the ALTER and is read again from the stored position.
+    template <typename T>
+    void setCallback(const std::string& _db_name, const std::string& _tbl_name, const RowBinding<T>& binding,
+                     EventKind filter = eAll)
+    {
+        setCallback(_db_name, _tbl_name, callback(), RowType::Map, filter);
+        m_bindings[std::make_pair(_db_name, _tbl_name)] = std::make_shared<RowBinding<T>>(binding);
+    }
+
+    // Subscribes to all tables matching patterns, i.e. ("shop_*", "orders") or ("*", "audit_log"):
+    // '*' matches any sequence of characters, '?' matches any single character. Structure of
+    // a matching table is created on its first TABLE_MAP event, so tables created after start
+    // are followed too. Explicit setCallback for the same table takes precedence.
+    void setCallbackPattern(const std::string& db_pattern, const std::string& tbl_pattern, callback _callback,
+                            const cols_t& column_filter, RowType row_type = RowType::Map, EventKind filter = eAll)
+    {
+        const TablePattern pattern(db_pattern, tbl_pattern);
+        if (!pattern.hasWildcards())
+        {
+            setCallback(db_pattern, tbl_pattern, _callback, column_filter, row_type, filter);
+            return;
+        }
+
+        m_pattern_callbacks.push_back({pattern, _callback, column_filter, row_type, filter});
+        m_table_verdicts.clear();
+    }
+
+    void setCallbackPattern(const std::string& db_pattern, const std::string& tbl_pattern, callback _callback,
+                            RowType row_type = RowType::Map, EventKind filter = eAll)
+    {
+        setCallbackPattern(db_pattern, tbl_pattern, _callback, cols_t(), row_type, filter);
+    }
+
+    // Thread-safe versions of setCallback and of its removal, they may be called while
+    // get_remote_binlog is running. Structure of the added table is read from master in
+    // a background thread, and the change takes effect at the start of the next transaction
+    // after that, so reading of binlog is not stopped. Changes are applied in order of calls.
+    // Removed table, which matches a pattern subscription, is matched again by its next TABLE_MAP.
+    void addSubscription(const std::string& db_name, const std::string& tbl_name, callback _callback,
+                         const cols_t& column_filter = cols_t(), RowType row_type = RowType::Map, EventKind filter = eAll);
+    void removeSubscription(const std::string& db_name, const std::string& tbl_name);
+
+    // Output modes of column values (i.e. TimestampMode::Raw), for all tables or for the given one.
+    // Makes sense only before createDatabaseStructure.
+    void setFieldOptions(const FieldOptions& options)
+    {
+        m_default_field_options = options;
+    }
+
+    void setFieldOptions(const std::string& _db_name, const std::string& _tbl_name, const FieldOptions& options)
+    {
+        m_field_options[std::make_pair(_db_name, _tbl_name)] = options;
+    }
+
     void setDDLCallback(const std::string& _db_name, const std::string& _tbl_name, ddl_callback _callback)
     {
         const auto key = std::make_pair(_db_name, _tbl_name);
@@ -141,20 +337,82 @@ public:
         m_xid_callback = _callback;
     }
 
+    // Keep history of table structures in the file between restarts, so that createDatabaseStructure
+    // does not query master for tables it already knows, and structure actual at the start position
+    // is used when catching up over later ALTERs. Cached structure is checked against the first
+    // TABLE_MAP event of the table and is reloaded from master on mismatch.
+    // Makes sense only before createDatabaseStructure.
+    void setSchemaCache(const std::string& path)
+    {
+        m_schema_cache.reset(new SchemaCache(path));
+        m_schema_cache->load();
+    }
+
+    // Column definitions are shared with other slaves using the same pool, see SlaveGroup.
+    // Makes sense only before createDatabaseStructure.
+    void setSchemaPool(const std::shared_ptr<SchemaPool>& pool)
+    {
+        m_schema_pool = pool;
+    }
+
+    // Which events get their CRC32 checked, when master has binlog_checksum=CRC32.
+    // With ChecksumPolicy::Async failure is found before the position is passed to ExtStateIface,
+    // binlog is read again from the stored position then, as after a lost connection.
+    void setChecksumPolicy(ChecksumPolicy policy)
+    {
+        m_checksum_policy = policy;
+    }
+
+    // Events rejected by the filter are skipped before checksum and parsing.
+    // Makes sense only before get_remote_binlog.
+    void setEventFilter(const EventFilter& filter)
+    {
+        m_event_filter = filter;
+    }
+
     void get_remote_binlog(const std::function<bool()>& _interruptFlag = &Slave::falseFunction);
 
+    // Non-blocking alternative to get_remote_binlog for an event loop. open_remote_binlog()
+    // connects, registers on master and requests binlog dump, these steps block. Then the loop
+    // waits for binlog_fd() and cancel_fd() to become readable and calls pump().
+    // The connection is not encrypted: ssl mode is DISABLED unless ssl options are set,
+    // and with them open_remote_binlog() fails.
+    void open_remote_binlog();
+    // Handles at most budget events, which are received already. Returns number of handled events,
+    // if it equals budget more events may be buffered: call pump() again without waiting for binlog_fd().
+    // On lost connection it is closed and exception is thrown, open_remote_binlog() resumes reading.
+    // Silent master is detected only here, so with heartbeats the loop calls pump() at least
+    // once a MasterInfo::heartbeat_period.
+    size_t pump(size_t budget);
+    void close_remote_binlog();
+    int binlog_fd() const { return m_stream_open ? mysql.net.fd : -1; }
+    // eventfd, which becomes readable after cancel(). pump() does nothing after cancel()
+    // until the next open_remote_binlog().
+    int cancel_fd() const { return m_cancel_fd; }
+    // May be called from any thread
+    void cancel();
+
+    // Hedged reading of one GTID history from several sources, i.e. master and its replica:
+    // of the Slaves sharing claims, the one which has read a transaction completely first
+    // delivers it, the others skip it. Each Slave keeps its own connection, position and
+    // ExtStateIface, so when one source fails the others go on. Requires GTID mode
+    // (see enableGtid); rows are delivered when their transaction is complete.
+    void setGtidClaims(const std::shared_ptr<GtidClaims>& claims) { m_claims = claims; }
+    // Binlog is open, but master sent nothing during 2 heartbeat periods: the next pump() throws.
+    // May be called from any thread.
+    bool stalled() const;
+    // Connection was lost, and since then no dump has lasted long enough to apply a real event
+    bool lost() const { return m_lost; }
+
     void createDatabaseStructure() {
 
         m_rli.clear();
+        m_table_verdicts.clear();
 
         createDatabaseStructure_(m_table_order, m_rli);
 
-        for (RelayLogInfo::name_to_table_t::iterator i = m_rli.m_table_map.begin(); i != m_rli.m_table_map.end(); ++i) {
-            i->second->m_callback = m_callbacks[i->first];
-            i->second->m_filter = m_filters[i->first];
-            i->second->set_column_filter(m_column_filters[i->first]);
-            i->second->row_type = m_row_types[i->first];
-        }
+        for (RelayLogInfo::name_to_table_t::iterator i = m_rli.m_table_map.begin(); i != m_rli.m_table_map.end(); ++i)
+            setTableCallbacks(i->first, m_rli);
     }
 
     const RelayLogInfo& getRli() const {
@@ -181,25 +439,48 @@ public:
 protected:
 
 
-    void check_master_version();
+    // Checks read the current result of the query sent by init()
+    void check_master_version(nanomysql::Connection& conn);
 
-    void check_master_binlog_format();
-    void check_master_gtid_mode();
+    void check_master_binlog_format(nanomysql::Connection& conn);
+    void check_master_gtid_mode(nanomysql::Connection& conn);
 
+    // Tracks position and GTID, and processes event. Events of TRANSACTION_PAYLOAD
+    // are handled one by one, like they were read separately.
+    void handle_event(const slave::Basic_event_info& event);
+    // Moves position past the event rejected by the filter
+    void skip_event(const slave::Basic_event_info& event);
+    // Whether event is checked inline according to the checksum policy
+    bool verify_checksum(const char* buf, unsigned int event_len) const;
+    // Waits for asynchronous check of the events read so far, before position is moved past them.
+    // Broken event is handled as a lost stream: reading restarts from the stored position.
+    void sync_checksums();
+    void commit_position();
     int process_event(const slave::Basic_event_info& bei, RelayLogInfo& rli);
 
     void request_dump_wo_gtid(const std::string& logname, unsigned long start_position, MYSQL* mysql);
     void request_dump(const Position& pos, MYSQL* mysql);
 
     ulong read_event(MYSQL* mysql);
+    // read_event() of MasterInfo::native_reader: packet is taken from m_stream
+    ulong read_native(const char*& packet, int timeout_ms);
+    // Filters, checks and handles event read from master
+    void dispatch_event(const char* buf, unsigned long len);
+    void decode_event(const char* buf, unsigned long len);
+
+    columns_t readColumns(nanomysql::Connection& conn,
+                          const std::string& db_name, const std::string& tbl_name) const;
 
     void createTable(RelayLogInfo& rli,
                      const std::string& db_name, const std::string& tbl_name,
-                     const collate_map_t& collate_map, nanomysql::Connection& conn) const;
+                     const columns_t& columns, bool from_cache) const;
+    PtrTableSchema createSchema(const columns_t& columns, const FieldOptions& options) const;
 
     void register_slave_on_master(MYSQL* mysql);
     void deregister_slave_on_master(MYSQL* mysql);
     void do_checksum_handshake(MYSQL* mysql);
+    // Requests heartbeats from master and sets socket options of binlog connection
+    void tune_binlog_connection(MYSQL* mysql);
 
     void generateSlaveId();
 
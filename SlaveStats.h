@@ -50,7 +50,21 @@ struct MasterInfo {
 
     nanomysql::mysql_conn_opts conn_options;
     Position position;
+    // Seconds, upper limit of delay between reconnect attempts
     unsigned int connect_retry;
+    // First retry is immediate, then the delay doubles from this value up to connect_retry
+    unsigned int reconnect_initial_ms = 100;
+    // Seconds of master idleness after which it sends HEARTBEAT_LOG_EVENT, 0 - disabled.
+    // Binlog connection without any packets during 2 periods is considered lost.
+    unsigned int heartbeat_period = 30;
+    // Replication stream is read from the socket by libslave in large pieces (see BinlogStream)
+    // instead of packet by packet by libmysqlclient. It is not used for TLS connections.
+    bool native_reader = false;
+    // Bytes read at once by the native reader and in non-blocking mode
+    size_t read_size = 64 * 1024;
+    // SO_RCVBUF and SO_BUSY_POLL (microseconds) of binlog connection, 0 - system default
+    int socket_rcvbuf = 0;
+    int socket_busy_poll = 0;
     enum_binlog_checksum_alg checksum_alg = BINLOG_CHECKSUM_ALG_OFF;
     bool is_old_storage = true;
     bool gtid_mode = false;
@@ -186,6 +200,10 @@ public:
     virtual void tickRotate() {}
     // XID events.
     virtual void tickXid() {}
+    // TRANSACTION_PAYLOAD events: size of payload and of events decompressed from it.
+    virtual void tickTransactionPayload(uint64_t /*compressed*/, uint64_t /*uncompressed*/) {}
+    // Events rejected by EventFilter, neither checked nor parsed.
+    virtual void tickPreFiltered() {}
     // Unprocessed libslave events.
     virtual void tickOther() {}
     // UPDATE/INSERT/DELETE missed (there are not callbacks on given type of operation).
@@ -201,6 +219,8 @@ public:
     virtual void tickModifyRowDone(const unsigned long /*id*/, EventKind /*kind*/, uint64_t /*callbackWorkTimeNanoSeconds*/) {}
     // Errors during processing
     virtual void tickError() {}
+    // Binlog connection is restored: time since it was lost and number of failed attempts.
+    virtual void tickReconnect(uint64_t /*disconnectedMilliSeconds*/, unsigned /*failedAttempts*/) {}
 };
 }
 
@@ -0,0 +1,76 @@
+/* Copyright 2011 ZAO "Begun".
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef __SLAVE_BACKOFF_H_
+#define __SLAVE_BACKOFF_H_
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+
+namespace slave
+{
+
+// Delays between reconnect attempts. The first retry is immediate, then the delay doubles
+// from initial up to max. Each delay is taken at random from [d/2, d], so that slaves of
+// a failed master don't come back all at once.
+class Backoff
+{
+public:
+
+    typedef std::chrono::milliseconds duration;
+
+    Backoff(duration initial, duration max)
+        : m_initial(initial)
+        , m_max(max)
+        , m_random(std::random_device()())
+    {}
+
+    duration next()
+    {
+        if (m_attempt++ == 0)
+            return duration::zero();
+
+        duration d = std::min(m_initial, m_max);
+        for (unsigned i = 2; i < m_attempt && d < m_max; ++i)
+            d = std::min(d * 2, m_max);
+
+        std::uniform_int_distribution<duration::rep> jitter(d.count() / 2, d.count());
+        return duration(jitter(m_random));
+    }
+
+    // Called when a binlog event is received again, not just the start of a dump
+    void reset() { m_attempt = 0; }
+
+    // Number of next() calls since reset()
+    unsigned attempt() const { return m_attempt; }
+
+    void setLimits(duration initial, duration max)
+    {
+        m_initial = initial;
+        m_max = max;
+    }
+
+private:
+
+    duration m_initial;
+    duration m_max;
+    unsigned m_attempt = 0;
+    std::minstd_rand m_random;
+};
+
+}// slave
+
+#endif
@@ -254,6 +254,19 @@ bool Position::reachedOtherPos(const Position& other) const
     return gtid_executed == other.gtid_executed;
 }
 
+bool Position::hasGtid(const gtid_t& gtid) const
+{
+    const auto it = gtid_executed.find(gtid.first);
+    if (it == gtid_executed.end())
+        return false;
+
+    for (const auto& interval : it->second)
+        if (gtid.second >= interval.first && gtid.second <= interval.second)
+            return true;
+
+    return false;
+}
+
 std::string Position::str() const
 {
     std::string result = "'";
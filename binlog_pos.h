@@ -39,6 +39,7 @@ struct Position
     void encodeGtid(unsigned char* buf);
 
     bool reachedOtherPos(const Position& other) const;
+    bool hasGtid(const gtid_t& gtid) const;
 
     std::string str() const;
     std::string strGtid() const;
@@ -0,0 +1,115 @@
+/* Copyright 2011 ZAO "Begun".
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "binlog_stream.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <poll.h>
+#include <stdexcept>
+#include <sys/socket.h>
+
+using namespace slave;
+
+namespace
+{
+const size_t header_size = 4;
+const size_t max_packet = 0xFFFFFF;
+}// anonymous-namespace
+
+BinlogStream::Status BinlogStream::fill(int fd)
+{
+    // Consumed packets are dropped, the buffer grows for a packet longer than it
+    if (m_begin)
+    {
+        std::copy(m_buffer.begin() + m_begin, m_buffer.begin() + m_end, m_buffer.begin());
+        m_end -= m_begin;
+        m_begin = 0;
+    }
+    if (m_buffer.size() - m_end < m_read_size)
+        m_buffer.resize(std::max(m_buffer.size() * 2, m_end + m_read_size));
+
+    for (;;)
+    {
+        const ssize_t n = ::recv(fd, &m_buffer[m_end], m_buffer.size() - m_end, MSG_DONTWAIT);
+        if (n > 0)
+        {
+            m_end += n;
+            return Status::Data;
+        }
+        if (n == 0)
+            return Status::Closed;
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+            return Status::WouldBlock;
+        if (errno != EINTR)
+            throw std::runtime_error(std::string("BinlogStream: recv() failed: ") + ::strerror(errno));
+    }
+}
+
+bool BinlogStream::wait(int fd, int timeout_ms)
+{
+    pollfd p = {fd, POLLIN, 0};
+    for (;;)
+    {
+        const int n = ::poll(&p, 1, timeout_ms);
+        if (n >= 0)
+            return n > 0;
+        if (errno != EINTR)
+            throw std::runtime_error(std::string("BinlogStream: poll() failed: ") + ::strerror(errno));
+    }
+}
+
+bool BinlogStream::next(const char*& data, size_t& size)
+{
+    for (;;)
+    {
+        if (m_end - m_begin < header_size)
+            return false;
+
+        const unsigned char* header = reinterpret_cast<const unsigned char*>(&m_buffer[m_begin]);
+        const size_t len = header[0] | header[1] << 8 | header[2] << 16;
+        if (m_end - m_begin < header_size + len)
+            return false;
+
+        const char* payload = &m_buffer[m_begin + header_size];
+        m_begin += header_size + len;
+
+        if (len == max_packet)
+        {
+            m_parts.append(payload, len);
+            continue;
+        }
+        if (!m_parts.empty())
+        {
+            m_parts.append(payload, len);
+            m_packet.swap(m_parts);
+            m_parts.clear();
+            data = m_packet.data();
+            size = m_packet.size();
+            return true;
+        }
+
+        data = payload;
+        size = len;
+        return true;
+    }
+}
+
+void BinlogStream::clear()
+{
+    m_begin = m_end = 0;
+    m_parts.clear();
+}
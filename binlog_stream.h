@@ -0,0 +1,67 @@
+/* Copyright 2011 ZAO "Begun".
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef __SLAVE_BINLOG_STREAM_H_
+#define __SLAVE_BINLOG_STREAM_H_
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace slave
+{
+
+// MySQL packets read from a socket without blocking: replication stream after
+// COM_BINLOG_DUMP for the non-blocking mode of Slave and for MasterInfo::native_reader.
+// Socket is read in large pieces, so that one recv() brings many small events.
+// Packets of 16M and more, which are sent in parts, are joined. TLS and compression
+// are not supported.
+class BinlogStream
+{
+public:
+
+    enum class Status { Data, WouldBlock, Closed };
+
+    // Bytes requested by one recv()
+    explicit BinlogStream(size_t read_size = 64 * 1024) : m_read_size(read_size) {}
+
+    void setReadSize(size_t read_size) { m_read_size = read_size; }
+
+    // Waits for the socket to become readable, false on timeout. Negative timeout is infinite.
+    static bool wait(int fd, int timeout_ms);
+
+    // Reads bytes available in the socket, throws on socket error
+    Status fill(int fd);
+
+    // Payload of the next complete packet. It is valid until the next call of fill().
+    bool next(const char*& data, size_t& size);
+
+    // Drops buffered data, e.g. on reconnect
+    void clear();
+
+private:
+
+    size_t m_read_size;
+    std::vector<char> m_buffer;
+    size_t m_begin = 0;
+    size_t m_end = 0;
+    // Parts of the packet being joined and the last joined packet
+    std::string m_parts;
+    std::string m_packet;
+};
+
+}// slave
+
+#endif
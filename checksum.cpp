@@ -0,0 +1,247 @@
+/* Copyright 2011 ZAO "Begun".
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <endian.h>
+#include <cstring>
+#include <stdexcept>
+
+#include <zlib.h>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define SLAVE_CRC32_PCLMUL
+#include <immintrin.h>
+#endif
+
+#include "checksum.h"
+
+#include "Logging.h"
+
+namespace
+{
+inline uint32_t crc32_zlib(uint32_t crc, const unsigned char* data, size_t len)
+{
+    return static_cast<uint32_t>(::crc32(static_cast<unsigned int>(crc), data, static_cast<unsigned int>(len)));
+}
+
+#ifdef SLAVE_CRC32_PCLMUL
+
+// Folding of 64-byte blocks with carry-less multiplication and Barrett reduction, see
+// "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ Instruction" by Intel.
+// len is at least 64 and a multiple of 16, crc is not inverted.
+__attribute__((target("pclmul,sse4.1")))
+uint32_t crc32_fold(uint32_t crc, const unsigned char* buf, size_t len)
+{
+    // Constants of the bit-reflected domain for polynomial 0x04C11DB7
+    alignas(16) static const uint64_t k1k2[] = {0x0154442bd4, 0x01c6e41596};
+    alignas(16) static const uint64_t k3k4[] = {0x01751997d0, 0x00ccaa009e};
+    alignas(16) static const uint64_t k5k0[] = {0x0163cd6124, 0x0000000000};
+    alignas(16) static const uint64_t poly[] = {0x01db710641, 0x01f7011641};
+
+    __m128i x0, x1, x2, x3, x4, x5, x6, x7, x8;
+
+    x1 = _mm_loadu_si128((const __m128i*)(buf + 0x00));
+    x2 = _mm_loadu_si128((const __m128i*)(buf + 0x10));
+    x3 = _mm_loadu_si128((const __m128i*)(buf + 0x20));
+    x4 = _mm_loadu_si128((const __m128i*)(buf + 0x30));
+    x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(crc));
+
+    x0 = _mm_load_si128((const __m128i*)k1k2);
+    buf += 64;
+    len -= 64;
+
+    // Four independent folds per 64 bytes
+    while (len >= 64) {
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+        x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+        x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+        x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+        x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), _mm_loadu_si128((const __m128i*)(buf + 0x00)));
+        x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), _mm_loadu_si128((const __m128i*)(buf + 0x10)));
+        x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), _mm_loadu_si128((const __m128i*)(buf + 0x20)));
+        x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), _mm_loadu_si128((const __m128i*)(buf + 0x30)));
+
+        buf += 64;
+        len -= 64;
+    }
+
+    // Fold into 128 bits
+    x0 = _mm_load_si128((const __m128i*)k3k4);
+
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+    while (len >= 16) {
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, _mm_loadu_si128((const __m128i*)buf)), x5);
+
+        buf += 16;
+        len -= 16;
+    }
+
+    // Fold 128 bits to 64 bits
+    x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+    x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+    x1 = _mm_srli_si128(x1, 8);
+    x1 = _mm_xor_si128(x1, x2);
+
+    x0 = _mm_loadl_epi64((const __m128i*)k5k0);
+
+    x2 = _mm_srli_si128(x1, 4);
+    x1 = _mm_and_si128(x1, x3);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    // Barrett reduction to 32 bits
+    x0 = _mm_load_si128((const __m128i*)poly);
+
+    x2 = _mm_and_si128(x1, x3);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+    x2 = _mm_and_si128(x2, x3);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    return _mm_extract_epi32(x1, 1);
+}
+
+uint32_t crc32_pclmul(uint32_t crc, const unsigned char* data, size_t len)
+{
+    if (len >= 64) {
+        const size_t chunk = len & ~size_t(15);
+        crc = ~crc32_fold(~crc, data, chunk);
+        data += chunk;
+        len -= chunk;
+    }
+    return len ? crc32_zlib(crc, data, len) : crc;
+}
+
+#endif
+
+typedef uint32_t (*crc32_func_t)(uint32_t, const unsigned char*, size_t);
+
+crc32_func_t chooseCrc32()
+{
+#ifdef SLAVE_CRC32_PCLMUL
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.1"))
+        return crc32_pclmul;
+#endif
+    return crc32_zlib;
+}
+
+const crc32_func_t crc32_impl = chooseCrc32();
+}// anonymous-namespace
+
+namespace slave
+{
+
+uint32_t crc32(uint32_t crc, const unsigned char* data, size_t len)
+{
+    return crc32_impl(crc, data, len);
+}
+
+bool checksumMatches(const char* buf, size_t event_len)
+{
+    if (event_len < 4)
+        return false;
+    uint32_t incoming;
+    ::memcpy(&incoming, buf + event_len - 4, sizeof(incoming));
+    return le32toh(incoming) == crc32(crc32(0, nullptr, 0), (const unsigned char*)buf, event_len - 4);
+}
+
+AsyncChecksum::~AsyncChecksum()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_cond.notify_all();
+    if (m_thread.joinable())
+        m_thread.join();
+}
+
+void AsyncChecksum::push(const char* buf, unsigned int event_len)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    if (!m_thread.joinable())
+        m_thread = std::thread(&AsyncChecksum::run, this);
+
+    std::vector<char> event;
+    if (!m_free.empty()) {
+        event.swap(m_free.back());
+        m_free.pop_back();
+    }
+    event.assign(buf, buf + event_len);
+    m_queue.push_back(std::move(event));
+
+    lock.unlock();
+    m_cond.notify_one();
+}
+
+void AsyncChecksum::sync()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_done_cond.wait(lock, [this] { return m_queue.empty() && !m_busy; });
+
+    if (!m_error.empty()) {
+        const std::string error = std::move(m_error);
+        m_error.clear();
+        throw std::runtime_error("AsyncChecksum::sync(): " + error);
+    }
+}
+
+void AsyncChecksum::run()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (;;) {
+        m_cond.wait(lock, [this] { return m_stop || !m_queue.empty(); });
+        if (m_stop)
+            return;
+
+        std::vector<char> event = std::move(m_queue.front());
+        m_queue.pop_front();
+        m_busy = true;
+        lock.unlock();
+
+        const bool ok = checksumMatches(event.data(), event.size());
+
+        lock.lock();
+        if (!ok && m_error.empty()) {
+            LOG_ERROR(log, "CRC32 check failed on asynchronous check");
+            m_error = "CRC32 check failed";
+        }
+        m_free.push_back(std::move(event));
+        m_busy = false;
+        if (m_queue.empty())
+            m_done_cond.notify_all();
+    }
+}
+
+}// slave
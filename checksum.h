@@ -0,0 +1,78 @@
+/* Copyright 2011 ZAO "Begun".
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __SLAVE_CHECKSUM_H_
+#define __SLAVE_CHECKSUM_H_
+
+#include <inttypes.h>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace slave
+{
+
+// Which events get their CRC32 checked (binlog_checksum=CRC32)
+enum class ChecksumPolicy {
+    All,        // every event, before it is parsed
+    Decoded,    // events, which are parsed: not row events of tables without callbacks, not ignored events
+    Async       // every event on a helper thread, failures are thrown before position is stored
+};
+
+// Same as crc32() of zlib, PCLMULQDQ folding is used when CPU supports it.
+uint32_t crc32(uint32_t crc, const unsigned char* data, size_t len);
+
+// Compares CRC32 of the event with the checksum in its last 4 bytes.
+bool checksumMatches(const char* buf, size_t event_len);
+
+// Checks events on a helper thread. Events are copied into buffers, which are reused.
+class AsyncChecksum
+{
+public:
+
+    AsyncChecksum() {}
+    ~AsyncChecksum();
+
+    AsyncChecksum(const AsyncChecksum&) = delete;
+    AsyncChecksum& operator= (const AsyncChecksum&) = delete;
+
+    // Event with checksum in its last 4 bytes
+    void push(const char* buf, unsigned int event_len);
+
+    // Waits until all pushed events are checked, throws if any of them is broken.
+    void sync();
+
+private:
+
+    void run();
+
+    std::thread                    m_thread;
+    std::mutex                     m_mutex;
+    std::condition_variable        m_cond;
+    std::condition_variable        m_done_cond;
+    std::deque<std::vector<char>>  m_queue;
+    std::vector<std::vector<char>> m_free;
+    // Event being checked, it is not in the queue anymore
+    bool                           m_busy = false;
+    bool                           m_stop = false;
+    std::string                    m_error;
+};
+
+}// slave
+
+#endif
@@ -12,47 +12,42 @@ using namespace slave;
 collate_map_t slave::readCollateMap(nanomysql::Connection& conn)
 {
     collate_map_t res;
-    nanomysql::Connection::result_t nanores;
 
     typedef std::map<std::string, int> charset_maxlen_t;
     charset_maxlen_t cm;
 
     conn.query("SHOW CHARACTER SET");
-    conn.store(nanores);
-
-    for (nanomysql::Connection::result_t::const_iterator i = nanores.begin(); i != nanores.end(); ++i)
     {
-        std::map<std::string, nanomysql::field>::const_iterator z = i->find("Charset");
-        if (z == i->end())
+        nanomysql::Cursor cur = conn.cursor();
+
+        const size_t charset = cur.find("Charset");
+        if (charset == nanomysql::Cursor::npos)
             throw std::runtime_error("Slave::readCollateMap(): SHOW CHARACTER SET query did not return 'Charset'");
-        const std::string name = z->second.data;
 
-        z = i->find("Maxlen");
-        if (z == i->end())
+        const size_t maxlen = cur.find("Maxlen");
+        if (maxlen == nanomysql::Cursor::npos)
             throw std::runtime_error("Slave::readCollateMap(): SHOW CHARACTER SET query did not return 'Maxlen'");
 
-        const int maxlen = atoi(z->second.data.c_str());
-
-        cm[name] = maxlen;
+        while (cur.next())
+            cm[cur[charset].to_string()] = cur.as<int>(maxlen);
     }
 
-    nanores.clear();
     conn.query("SHOW COLLATION");
-    conn.store(nanores);
+    nanomysql::Cursor cur = conn.cursor();
 
-    for (nanomysql::Connection::result_t::const_iterator i = nanores.begin(); i != nanores.end(); ++i)
-    {
-        collate_info ci;
+    const size_t collation = cur.find("Collation");
+    if (collation == nanomysql::Cursor::npos)
+        throw std::runtime_error("Slave::readCollateMap(): SHOW COLLATION query did not return 'Collation'");
 
-        std::map<std::string, nanomysql::field>::const_iterator z = i->find("Collation");
-        if (z == i->end())
-            throw std::runtime_error("Slave::readCollateMap(): SHOW COLLATION query did not return 'Collation'");
-        ci.name = z->second.data;
+    const size_t charset = cur.find("Charset");
+    if (charset == nanomysql::Cursor::npos)
+        throw std::runtime_error("Slave::readCollateMap(): SHOW COLLATION query did not return 'Charset'");
 
-        z = i->find("Charset");
-        if (z == i->end())
-            throw std::runtime_error("Slave::readCollateMap(): SHOW COLLATION query did not return 'Charset'");
-        ci.charset = z->second.data;
+    while (cur.next())
+    {
+        collate_info ci;
+        ci.name = cur[collation].to_string();
+        ci.charset = cur[charset].to_string();
 
         charset_maxlen_t::const_iterator j = cm.find(ci.charset);
         if (j == cm.end())
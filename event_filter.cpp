@@ -0,0 +1,109 @@
+/* Copyright 2011 ZAO "Begun".
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "event_filter.h"
+
+namespace slave
+{
+
+void EventFilter::allowServerId(unsigned int server_id)
+{
+    m_allow_servers.insert(server_id);
+    m_active = true;
+}
+
+void EventFilter::denyServerId(unsigned int server_id)
+{
+    m_deny_servers.insert(server_id);
+    m_active = true;
+}
+
+void EventFilter::denyType(Log_event_type type)
+{
+    m_deny_types.set(static_cast<unsigned char>(type));
+    m_active = true;
+}
+
+void EventFilter::setTimeWindow(time_t from, time_t to)
+{
+    m_from = from;
+    m_to = to;
+    m_active = true;
+}
+
+void EventFilter::allowGtids(const std::string& gtid_set)
+{
+    m_allow_gtids.parseGtid(gtid_set);
+    m_active = true;
+}
+
+void EventFilter::denyGtids(const std::string& gtid_set)
+{
+    m_deny_gtids.parseGtid(gtid_set);
+    m_active = true;
+}
+
+void EventFilter::add(const predicate_t& predicate)
+{
+    m_predicates.push_back(predicate);
+    m_active = true;
+}
+
+bool EventFilter::accept(const Basic_event_info& info)
+{
+    switch (info.type) {
+    case START_EVENT_V3:
+    case STOP_EVENT:
+    case ROTATE_EVENT:
+    case FORMAT_DESCRIPTION_EVENT:
+    case XID_EVENT:
+    case HEARTBEAT_LOG_EVENT:
+    case GTID_LOG_EVENT:
+    case PREVIOUS_GTIDS_LOG_EVENT:
+        return true;
+    case ANONYMOUS_GTID_LOG_EVENT:
+        m_skip_transaction = false;
+        return true;
+    default:
+        break;
+    }
+
+    if (m_deny_types[static_cast<unsigned char>(info.type)])
+        return false;
+
+    if (info.type != QUERY_EVENT) {
+        if (m_skip_transaction)
+            return false;
+        if (!m_allow_servers.empty() && m_allow_servers.count(info.server_id) == 0)
+            return false;
+        if (m_deny_servers.count(info.server_id))
+            return false;
+        if ((m_from && info.when < m_from) || (m_to && info.when >= m_to))
+            return false;
+    }
+
+    for (const auto& predicate : m_predicates)
+        if (!predicate(info))
+            return false;
+
+    return true;
+}
+
+void EventFilter::beginTransaction(const gtid_t& gtid)
+{
+    m_skip_transaction = (!m_allow_gtids.gtid_executed.empty() && !m_allow_gtids.hasGtid(gtid))
+                      || m_deny_gtids.hasGtid(gtid);
+}
+
+}// slave
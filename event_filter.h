@@ -0,0 +1,80 @@
+/* Copyright 2011 ZAO "Begun".
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __SLAVE_EVENT_FILTER_H_
+#define __SLAVE_EVENT_FILTER_H_
+
+#include <bitset>
+#include <functional>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "binlog_pos.h"
+#include "slave_log_event.h"
+
+namespace slave
+{
+
+// Checks of the common event header, made before checksum and parsing of the event.
+// Rejected events are skipped, only the binlog position is moved past them.
+// Events, which track position and structure (FORMAT_DESCRIPTION, ROTATE, XID, GTID and so on),
+// are never rejected. QUERY events are rejected only by type or custom checks, because
+// DDL from them is needed to decode later events.
+class EventFilter
+{
+public:
+
+    typedef std::function<bool (const Basic_event_info&)> predicate_t;
+
+    // Events of listed servers only, i.e. to read one master of multi-master setup
+    void allowServerId(unsigned int server_id);
+    // Events of listed servers are skipped, i.e. own events in circular replication
+    void denyServerId(unsigned int server_id);
+    void denyType(Log_event_type type);
+    // Events with timestamp in [from, to), 0 is no limit
+    void setTimeWindow(time_t from, time_t to);
+    // Transactions with GTID from/out of the set, i.e. "3e11fa47-71ca-11e1-9e33-c80aa9429562:1-100",
+    // the set replaces previous one
+    void allowGtids(const std::string& gtid_set);
+    void denyGtids(const std::string& gtid_set);
+    // Called after the builtin checks, in order of adding
+    void add(const predicate_t& predicate);
+
+    bool empty() const { return !m_active; }
+
+    // Only header fields of info are filled
+    bool accept(const Basic_event_info& info);
+
+    // Events of the transaction are rejected, if its GTID is not accepted
+    void beginTransaction(const gtid_t& gtid);
+
+private:
+
+    bool                        m_active = false;
+    std::bitset<256>            m_deny_types;
+    std::set<unsigned int>      m_allow_servers;
+    std::set<unsigned int>      m_deny_servers;
+    time_t                      m_from = 0;
+    time_t                      m_to = 0;
+    Position                    m_allow_gtids;
+    Position                    m_deny_gtids;
+    std::vector<predicate_t>    m_predicates;
+
+    bool                        m_skip_transaction = false;
+};
+
+}// slave
+
+#endif
@@ -13,7 +13,9 @@
 */
 
 
+#include <algorithm>
 #include <cstdio>
+#include <cstring>
 #include <inttypes.h>
 #include <vector>
 #include <stdexcept>
@@ -28,9 +30,35 @@
 
 #include "dec_util.h"
 #include "field.h"
+#include "tz_table.h"
 
 #include "Logging.h"
 
+namespace
+{
+inline char* put2(char* p, unsigned v)
+{
+    p[0] = '0' + v / 10;
+    p[1] = '0' + v % 10;
+    return p + 2;
+}
+
+// Fraction of second with given number of digits, truncated like in my_TIME_to_str()
+char* putFraction(char* p, unsigned usec, unsigned precision)
+{
+    static const unsigned pow10[] = {1, 10, 100, 1000, 10000, 100000, 1000000};
+
+    precision = std::min(precision, 6u);
+    if (!precision)
+        return p;
+
+    *p++ = '.';
+    unsigned v = usec / pow10[6 - precision];
+    for (unsigned i = precision; i; --i, v /= 10)
+        p[i - 1] = '0' + v % 10;
+    return p + precision;
+}
+}// anonymous-namespace
 
 
 
@@ -88,6 +116,13 @@ const char* Field_num<T, length>::unpack(const char* from)
     return from + length;
 }
 
+template<typename T, const unsigned length>
+const char* Field_num<T, length>::unpack_value(const char* from, T& value) const
+{
+    value = get_value(from);
+    return from + length;
+}
+
 template<typename T, const unsigned length>
 void Field_num<T, length>::unpack_str(const std::string& from)
 {
@@ -102,6 +137,27 @@ void Field_num<T, length>::unpack_str(const std::string& from)
 }
 
 
+Field_decimal::Field_decimal(
+    const std::string& name,
+    const std::string& type,
+    const unsigned length_,
+    const unsigned scale_,
+    const bool is_unsigned,
+    const DecimalMode mode_
+) :
+    Field(name, type),
+    scale(scale_),
+    // see my_decimal_length_to_precision() @ my_decimal.h
+    precision(length_ - (scale_ ? 1 : 0) - (is_unsigned || !length_ ? 0 : 1)),
+    length(::decimal_bin_size(precision, scale_)),
+    mode(mode_)
+{
+    if (mode == DecimalMode::Scaled && precision > 38) {
+        LOG_WARNING(log, "field " << field_name << " " << field_type << " does not fit into __int128, it is delivered as string");
+        mode = DecimalMode::String;
+    }
+}
+
 const char* Field_decimal::unpack(const char *from)
 {
     // see DECIMAL_BUFF_LENGTH @ my_decimal.h
@@ -110,6 +166,43 @@ const char* Field_decimal::unpack(const char *from)
     dec.len = 9;
     dec.buf = buf;
 
+    if (mode != DecimalMode::String) {
+        if (dec_util::bin2dec(from, &dec, precision, scale) != E_DEC_OK) {
+            throw std::runtime_error("Field_decimal::unpack(): bin2dec() failed");
+        }
+
+        if (mode == DecimalMode::Double) {
+            double value;
+            dec_util::dec2dbl(&dec, &value);
+
+            LOG_TRACE(log, "field " << field_name << "  decimal: " << value << " // " << length);
+
+            field_data = static_cast<types::MY_DECIMAL>(value);
+            return from + length;
+        }
+
+        // Digits are in groups of 9, the last fraction group is padded with zeros
+        static const ::decimal_digit_t pow10[] = {1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000};
+        __int128 value = 0;
+        const ::decimal_digit_t* digit = dec.buf;
+        for (int i = dec.intg; i > 0; i -= 9)
+            value = value * pow10[9] + *digit++;
+        for (int i = dec.frac; i > 0; i -= 9) {
+            const int n = std::min(i, 9);
+            value = value * pow10[n] + *digit++ / pow10[9 - n];
+        }
+        if (dec.sign)
+            value = -value;
+
+        LOG_TRACE(log, "field " << field_name << "  decimal: " << static_cast<double>(value) << " // " << length);
+
+        if (precision <= 18)
+            field_data = static_cast<int64_t>(value);
+        else
+            field_data = value;
+        return from + length;
+    }
+
     if (::bin2decimal((const uchar*)from, &dec, precision, scale) != E_DEC_OK) {
         throw std::runtime_error("Field_decimal::unpack(): bin2decimal() failed");
     }
@@ -129,6 +222,15 @@ const char* Field_decimal::unpack(const char *from)
     return from + length;
 }
 
+const std::type_info& Field_decimal::value_type() const
+{
+    switch (mode) {
+        case DecimalMode::Double: return typeid(types::MY_DECIMAL);
+        case DecimalMode::Scaled: return precision <= 18 ? typeid(int64_t) : typeid(__int128);
+        default:                  return typeid(std::string);
+    }
+}
+
 // ----- date & time -------------------------------------------------------------------------------
 
 void Field_timestamp::reset(const bool is_old_storage_, const bool ctor_call)
@@ -142,9 +244,13 @@ void Field_timestamp::reset(const bool is_old_storage_, const bool ctor_call)
         length = ::my_timestamp_binary_length(precision);
     }
 }
+const std::type_info& Field_timestamp::value_type() const
+{
+    return mode == TimestampMode::Raw ? typeid(types::Timestamp) : typeid(std::string);
+}
+
 const char* Field_timestamp::unpack(const char* from)
 {
-    ::MYSQL_TIME my_time;
     struct ::timeval tv;
 
     if (is_old_storage) {
@@ -153,29 +259,59 @@ const char* Field_timestamp::unpack(const char* from)
     } else {
         ::my_timestamp_from_binary(&tv, (const uchar*)from, precision);
     }
-    if (tv.tv_sec || tv.tv_usec) {
-        // see localtime_to_TIME() @ sql_time.cc
-        struct ::tm tm_;
-        time_t ts = tv.tv_sec;
-        ::localtime_r(&ts, &tm_);
-
-        my_time.neg = 0;
-        my_time.second_part = tv.tv_usec;
-        my_time.year = (tm_.tm_year + 1900) % 10000;
-        my_time.month = tm_.tm_mon + 1;
-        my_time.day = tm_.tm_mday;
-        my_time.hour = tm_.tm_hour;
-        my_time.minute = tm_.tm_min;
-        my_time.second = std::min(tm_.tm_sec, 59); // see adjust_leap_second() @ tztime.cc
-    } else {
-        ::memset(&my_time, 0, sizeof(my_time));
+
+    if (mode == TimestampMode::Raw) {
+        LOG_TRACE(log, "field " << field_name << "  timestamp: " << tv.tv_sec << "." << tv.tv_usec << " // " << length);
+
+        field_data = types::Timestamp{tv.tv_sec, static_cast<uint32_t>(tv.tv_usec)};
+        return from + length;
     }
-    my_time.time_type = MYSQL_TIMESTAMP_DATETIME;
 
     char buffer[ MAX_DATE_STRING_REP_LENGTH ];
-    const int value_length = ::my_TIME_to_str(my_time, (char*)&buffer, precision);
+    char* p = buffer;
 
-    std::string value((char*)&buffer, value_length);
+    if (tv.tv_sec || tv.tv_usec) {
+        // Same as localtime_r(), but without timezone lock
+        const int64_t local = tv.tv_sec + TzTable::local().offset(tv.tv_sec, tz_hint);
+        int64_t day = local / 86400;
+        int64_t sec = local % 86400;
+        if (sec < 0) {
+            sec += 86400;
+            --day;
+        }
+
+        if (day != cached_day) {
+            int year;
+            unsigned month, mday;
+            civilFromDays(day, year, month, mday);
+            year %= 10000;
+
+            char* d = cached_date;
+            d = put2(d, year / 100);
+            d = put2(d, year % 100);
+            *d++ = '-';
+            d = put2(d, month);
+            *d++ = '-';
+            put2(d, mday);
+            cached_day = day;
+        }
+
+        ::memcpy(p, cached_date, sizeof(cached_date));
+        p += sizeof(cached_date);
+        *p++ = ' ';
+        p = put2(p, sec / 3600);
+        *p++ = ':';
+        p = put2(p, sec / 60 % 60);
+        *p++ = ':';
+        p = put2(p, sec % 60);
+    } else {
+        static const char zero[] = "0000-00-00 00:00:00";
+        ::memcpy(p, zero, sizeof(zero) - 1);
+        p += sizeof(zero) - 1;
+    }
+    p = putFraction(p, tv.tv_usec, precision);
+
+    std::string value(buffer, p - buffer);
 
     LOG_TRACE(log, "field " << field_name << "  timestamp: '" << value << "' // " << length);
 
@@ -195,6 +331,11 @@ void Field_time::reset(const bool is_old_storage_, const bool ctor_call)
         length = ::my_time_binary_length(precision);
     }
 }
+const std::type_info& Field_time::value_type() const
+{
+    return mode == TemporalMode::Packed ? typeid(types::Time) : typeid(std::string);
+}
+
 const char* Field_time::unpack(const char* from)
 {
     ::MYSQL_TIME my_time = {0};
@@ -210,6 +351,15 @@ const char* Field_time::unpack(const char* from)
         ::TIME_from_longlong_time_packed(&my_time, nr);
     }
 
+    if (mode == TemporalMode::Packed) {
+        const types::MY_TIME value = (my_time.hour * 10000 + my_time.minute * 100 + my_time.second) * (my_time.neg ? -1 : 1);
+
+        LOG_TRACE(log, "field " << field_name << "  time: " << value << "." << my_time.second_part << " // " << length);
+
+        field_data = types::Time{value, static_cast<uint32_t>(my_time.second_part), bool(my_time.neg)};
+        return from + length;
+    }
+
     char buffer[ MAX_DATE_STRING_REP_LENGTH ];
     const int value_length = ::my_TIME_to_str(my_time, (char*)&buffer, precision);
 
@@ -233,6 +383,11 @@ void Field_datetime::reset(const bool is_old_storage_, const bool ctor_call)
         length = ::my_datetime_binary_length(precision);
     }
 }
+const std::type_info& Field_datetime::value_type() const
+{
+    return mode == TemporalMode::Packed ? typeid(types::DateTime) : typeid(std::string);
+}
+
 const char* Field_datetime::unpack(const char* from)
 {
     ::MYSQL_TIME my_time = {0};
@@ -248,6 +403,17 @@ const char* Field_datetime::unpack(const char* from)
         ::TIME_from_longlong_datetime_packed(&my_time, nr);
     }
 
+    if (mode == TemporalMode::Packed) {
+        const types::MY_DATETIME value =
+            ((my_time.year * 10000ULL + my_time.month * 100 + my_time.day) * 100 + my_time.hour) * 10000
+            + my_time.minute * 100 + my_time.second;
+
+        LOG_TRACE(log, "field " << field_name << "  datetime: " << value << "." << my_time.second_part << " // " << length);
+
+        field_data = types::DateTime{value, static_cast<uint32_t>(my_time.second_part)};
+        return from + length;
+    }
+
     char buffer[ MAX_DATE_STRING_REP_LENGTH ];
     const int value_length = ::my_TIME_to_str(my_time, (char*)&buffer, precision);
 
@@ -260,12 +426,24 @@ const char* Field_datetime::unpack(const char* from)
 }
 
 
+const std::type_info& Field_date::value_type() const
+{
+    return mode == TemporalMode::Packed ? typeid(types::MY_DATE) : typeid(std::string);
+}
+
 const char* Field_date::unpack(const char* from)
 {
     ::MYSQL_TIME my_time = {0};
 
     // see Field_newdate::get_date_internal() @ field.cc
     longlong nr = uint3korr(from);
+
+    if (mode == TemporalMode::Packed) {
+        LOG_TRACE(log, "field " << field_name << "  date: " << nr);
+
+        field_data = static_cast<types::MY_DATE>(nr);
+        return from + 3;
+    }
     my_time.day = nr & 31;
     my_time.month = (nr >> 5) & 15;
     my_time.year = (nr >> 9);
@@ -305,7 +483,7 @@ void Field_year::unpack_str(const std::string& from)
 
 // ----- string ------------------------------------------------------------------------------------
 
-const char* Field_string::unpack(const char* from)
+const char* Field_string::unpack_view(const char* from, boost::string_view& value) const
 {
     size_t value_length;
     // see calc_pack_length() @ field.cc
@@ -317,18 +495,28 @@ const char* Field_string::unpack(const char* from)
         from += 2;
     }
 
-    std::string value(from, value_length);
+    value = boost::string_view(from, value_length);
+    return from + value_length;
+}
+
+const char* Field_string::unpack(const char* from)
+{
+    boost::string_view view;
+    from = unpack_view(from, view);
 
-    LOG_TRACE(log, "field " << field_name << "  string size " << length << ": '" << value << "' // " << value_length);
+    std::string value(view.data(), view.size());
+
+    LOG_TRACE(log, "field " << field_name << "  string size " << length << ": '" << value << "' // " << view.size());
 
     field_data = std::move(value);
-    return from + value_length;
+    return from;
 }
 
 // ----- enums -------------------------------------------------------------------------------------
 
-Field_bitset::Field_bitset(const std::string& name, const std::string& type) :
-    Field(name, type)
+Field_bitset::Field_bitset(const std::string& name, const std::string& type, const EnumMode mode_) :
+    Field(name, type),
+    mode(mode_)
 {
     char v[ field_type.size() ], *pv;
     const char *pt = (const char*)field_type.c_str(), *const pe = pt + field_type.size();
@@ -354,10 +542,22 @@ Field_bitset::Field_bitset(const std::string& name, const std::string& type) :
 }
 
 
+const std::type_info& Field_enum::value_type() const
+{
+    return mode == EnumMode::Ordinal ? typeid(types::Enum) : typeid(std::string);
+}
+
 const char* Field_enum::unpack(const char* from)
 {
     ulonglong nr = length == 1 ? *(const uchar*)from : uint2korr(from);
 
+    if (mode == EnumMode::Ordinal) {
+        LOG_TRACE(log, "field " << field_name << "  enum size " << length << ": " << nr);
+
+        field_data = types::Enum{static_cast<types::MY_ENUM>(nr), &str_values};
+        return from + length;
+    }
+
     std::string value;
     if (nr) value.assign(str_values.at(nr - 1));
 
@@ -368,6 +568,11 @@ const char* Field_enum::unpack(const char* from)
 }
 
 
+const std::type_info& Field_set::value_type() const
+{
+    return mode == EnumMode::Ordinal ? typeid(types::Set) : typeid(std::string);
+}
+
 const char* Field_set::unpack(const char* from)
 {
     ulonglong nr = 0;
@@ -381,6 +586,13 @@ const char* Field_set::unpack(const char* from)
         case 8: nr = uint8korr(from);
     }
 
+    if (mode == EnumMode::Ordinal) {
+        LOG_TRACE(log, "field " << field_name << "  set size " << length << ": " << nr);
+
+        field_data = types::Set{nr, &str_values};
+        return from + length;
+    }
+
     std::string value;
 
     if (nr) {
@@ -439,7 +651,7 @@ Field_blob::Field_blob(const std::string& name, const std::string& type, const u
         size = 4;
     }
 }
-const char* Field_blob::unpack(const char* from)
+const char* Field_blob::unpack_view(const char* from, boost::string_view& value) const
 {
     size_t value_length;
 
@@ -451,11 +663,93 @@ const char* Field_blob::unpack(const char* from)
         case 4: value_length = uint4korr(from); from += 4;
     }
 
-    std::string value(from, value_length);
+    value = boost::string_view(from, value_length);
+    return from + value_length;
+}
+
+const char* Field_blob::unpack(const char* from)
+{
+    boost::string_view view;
+    from = unpack_view(from, view);
 
-    LOG_TRACE(log, "field " << field_name << "  blob size " << size << ": '" << value << "' // " << value_length);
+    std::string value(view.data(), view.size());
+
+    LOG_TRACE(log, "field " << field_name << "  blob size " << size << ": '" << value << "' // " << view.size());
 
     field_data = std::move(value);
+    return from;
+}
+
+const std::type_info& Field_json::value_type() const
+{
+    return mode == JsonMode::View ? typeid(json::Value) : typeid(std::string);
+}
+
+const std::type_info& Field_json::diffs_type() const
+{
+    return partial_mode == PartialJsonMode::Diffs ? typeid(json::Diffs) : typeid(std::string);
+}
+
+const char* Field_json::unpack(const char* from)
+{
+    size_t value_length;
+
+    switch (size) {
+        case 1: value_length = *(const uchar*)from++; break;
+        case 2: value_length = uint2korr(from); from += 2; break;
+        case 3: value_length = uint3korr(from); from += 3; break;
+        default:
+        case 4: value_length = uint4korr(from); from += 4;
+    }
+
+    // Empty value is possible in a column added to a table with rows, it is JSON null
+    const json::Value value = value_length ? json::Value(from, value_length) : json::Value("\x04\x00", 2);
+    if (!value.valid()) {
+        throw std::runtime_error("Field_json::unpack(): bad binary JSON in field " + field_name);
+    }
+    last = value;
+
+    if (mode == JsonMode::View) {
+        LOG_TRACE(log, "field " << field_name << "  json view // " << value_length);
+
+        field_data = value;
+        return from + value_length;
+    }
+
+    std::string text;
+    value.toString(text);
+
+    LOG_TRACE(log, "field " << field_name << "  json: '" << text << "' // " << value_length);
+
+    field_data = std::move(text);
+    return from + value_length;
+}
+
+const char* Field_json::unpack_diffs(const char* from)
+{
+    const size_t value_length = uint4korr(from);
+    from += 4;
+
+    json::Diffs diffs;
+    json::parseDiffs(from, value_length, diffs);
+
+    if (partial_mode == PartialJsonMode::Apply) {
+        if (!last.valid()) {
+            throw std::runtime_error("Field_json::unpack_diffs(): no before image in field " + field_name);
+        }
+
+        std::string text = json::applyDiffs(last, diffs);
+
+        LOG_TRACE(log, "field " << field_name << "  json with " << diffs.size() << " diffs applied: '" << text << "' // " << value_length);
+
+        field_data = std::move(text);
+    } else {
+        LOG_TRACE(log, "field " << field_name << "  json diffs: " << diffs.size() << " // " << value_length);
+
+        field_data = std::move(diffs);
+    }
+
+    last = json::Value();
     return from + value_length;
 }
 
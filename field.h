@@ -17,9 +17,12 @@
 #define __SLAVE_FIELD_H_
 
 #include <string>
+#include <typeinfo>
 #include <vector>
 #include <list>
 
+#include <boost/utility/string_view.hpp>
+
 #include "collate.h"
 #include "types.h"
 
@@ -56,6 +59,11 @@ class Field
             field_data = from;
         }
 
+        // Type of field_data, which is set by unpack() with the column options of the field
+        virtual const std::type_info& value_type() const {
+            return typeid(std::string);
+        }
+
         const std::string& getFieldName() const {
             return field_name;
         }
@@ -71,9 +79,13 @@ class Field_num : public Field
     public:
         const char* unpack(const char* from);
         void unpack_str(const std::string& from);
+        const std::type_info& value_type() const { return typeid(T); }
+
+        // Value without FieldValue, for RowBinding
+        const char* unpack_value(const char* from, T& value) const;
 
     private:
-        inline T get_value(const char *from);
+        static inline T get_value(const char *from);
 };
 
 template class Field_num<uint16, 1>;
@@ -100,20 +112,17 @@ class Field_decimal : public Field
             const std::string& type,
             const unsigned length_,
             const unsigned scale_,
-            const bool is_unsigned
-        ) :
-            Field(name, type),
-            scale(scale_),
-            // see my_decimal_length_to_precision() @ my_decimal.h
-            precision(length_ - (scale_ ? 1 : 0) - (is_unsigned || !length_ ? 0 : 1)),
-            length(::decimal_bin_size(precision, scale_))
-        {}
+            const bool is_unsigned,
+            const DecimalMode mode_ = DecimalMode::String
+        );
 
         const char* unpack(const char *from);
+        const std::type_info& value_type() const;
 
     private:
         const unsigned scale, precision, length;
         static const bool zerofill = false;
+        DecimalMode mode;
 };
 
 // ----- date & time -------------------------------------------------------------------------------
@@ -147,15 +156,26 @@ class Field_timestamp : public Field_temporal
             const std::string& name,
             const std::string& type,
             const unsigned precision,
-            const bool is_old_storage_
+            const bool is_old_storage_,
+            const TimestampMode mode_ = TimestampMode::String
         ) :
-            Field_temporal(name, type, precision)
+            Field_temporal(name, type, precision),
+            mode(mode_)
         {
             reset(is_old_storage_, true);
         }
 
         const char* unpack(const char* from);
         void reset(const bool is_old_storage_, const bool ctor_call);
+        const std::type_info& value_type() const;
+
+    private:
+        const TimestampMode mode;
+        // TzTable interval of the previous value
+        size_t tz_hint = 0;
+        // Formatted date of the previous value, values of one table are usually close in time
+        int64_t cached_day = -1;
+        char cached_date[10];
 };
 
 
@@ -166,15 +186,21 @@ class Field_time : public Field_temporal
             const std::string& name,
             const std::string& type,
             const unsigned precision,
-            const bool is_old_storage_
+            const bool is_old_storage_,
+            const TemporalMode mode_ = TemporalMode::String
         ) :
-            Field_temporal(name, type, precision)
+            Field_temporal(name, type, precision),
+            mode(mode_)
         {
             reset(is_old_storage_, true);
         }
 
         const char* unpack(const char* from);
         void reset(const bool is_old_storage_, const bool ctor_call);
+        const std::type_info& value_type() const;
+
+    private:
+        const TemporalMode mode;
 };
 
 
@@ -185,24 +211,41 @@ class Field_datetime : public Field_temporal
             const std::string& name,
             const std::string& type,
             const unsigned precision,
-            const bool is_old_storage_
+            const bool is_old_storage_,
+            const TemporalMode mode_ = TemporalMode::String
         ) :
-            Field_temporal(name, type, precision)
+            Field_temporal(name, type, precision),
+            mode(mode_)
         {
             reset(is_old_storage_, true);
         }
 
         const char* unpack(const char* from);
         void reset(const bool is_old_storage_, const bool ctor_call);
+        const std::type_info& value_type() const;
+
+    private:
+        const TemporalMode mode;
 };
 
 
 class Field_date : public Field
 {
-    using Field::Field;
-
     public:
+        Field_date(
+            const std::string& name,
+            const std::string& type,
+            const TemporalMode mode_ = TemporalMode::String
+        ) :
+            Field(name, type),
+            mode(mode_)
+        {}
+
         const char* unpack(const char* from);
+        const std::type_info& value_type() const;
+
+    private:
+        const TemporalMode mode;
 };
 
 
@@ -213,6 +256,7 @@ class Field_year : public Field
     public:
         const char* unpack(const char* from);
         void unpack_str(const std::string& from);
+        const std::type_info& value_type() const { return typeid(uint16); }
 };
 
 // ----- string ------------------------------------------------------------------------------------
@@ -230,6 +274,8 @@ class Field_string : public Field
         {}
 
         const char* unpack(const char* from);
+        // Value inside of the event, without copying
+        const char* unpack_view(const char* from, boost::string_view& value) const;
 
         void set_length(const unsigned x) {
             LOG_TRACE(log, "field " << field_name << " new string length: " << x);
@@ -245,31 +291,33 @@ class Field_string : public Field
 class Field_bitset : public Field
 {
     public:
-        Field_bitset(const std::string& name, const std::string& type);
+        Field_bitset(const std::string& name, const std::string& type, const EnumMode mode_);
 
     protected:
         unsigned length;
-        std::vector<std::string> str_values;
+        types::Labels str_values;
+        const EnumMode mode;
 };
 
 class Field_enum : public Field_bitset
 {
     public:
-        Field_enum(const std::string& name, const std::string& type) :
-            Field_bitset(name, type)
+        Field_enum(const std::string& name, const std::string& type, const EnumMode mode_ = EnumMode::String) :
+            Field_bitset(name, type, mode_)
         {
             // see get_enum_pack_length() @ field.h
             length = str_values.size() < 256 ? 1 : 2;
         }
 
         const char* unpack(const char* from);
+        const std::type_info& value_type() const;
 };
 
 class Field_set: public Field_bitset
 {
     public:
-        Field_set(const std::string& name, const std::string& type) :
-            Field_bitset(name, type)
+        Field_set(const std::string& name, const std::string& type, const EnumMode mode_ = EnumMode::String) :
+            Field_bitset(name, type, mode_)
         {
             // see get_set_pack_length() @ field.h
             const unsigned len = (str_values.size() + 7) / 8;
@@ -277,6 +325,7 @@ class Field_set: public Field_bitset
         }
 
         const char* unpack(const char* from);
+        const std::type_info& value_type() const;
 };
 
 
@@ -294,6 +343,7 @@ class Field_bit : public Field
 
         const char* unpack(const char *from);
         void unpack_str(const std::string& from);
+        const std::type_info& value_type() const { return typeid(unsigned long long); }
 
     private:
         const unsigned length;
@@ -309,6 +359,8 @@ class Field_blob : public Field {
             const unsigned length
         );
         const char* unpack(const char* from);
+        // Value inside of the event, without copying
+        const char* unpack_view(const char* from, boost::string_view& value) const;
 
         void set_size(const unsigned x) {
             LOG_TRACE(log, "field " << field_name << " new blob size: " << x);
@@ -319,6 +371,43 @@ class Field_blob : public Field {
         unsigned size;
 };
 
+// JSON is stored like BLOB: length of pack_length() bytes and binary JSON document
+class Field_json : public Field {
+    public:
+        Field_json(
+            const std::string& name,
+            const std::string& type,
+            const JsonMode mode_ = JsonMode::Text,
+            const PartialJsonMode partial_mode_ = PartialJsonMode::Diffs
+        ) :
+            Field(name, type),
+            size(4),
+            mode(mode_),
+            partial_mode(partial_mode_)
+        {}
+
+        const char* unpack(const char* from);
+
+        // After image of partially updated column: 4-byte length and diffs, which are
+        // applied (in PartialJsonMode::Apply) to the document unpacked last, i.e. before image.
+        const char* unpack_diffs(const char* from);
+
+        const std::type_info& value_type() const;
+        // Type of field_data, which is set by unpack_diffs()
+        const std::type_info& diffs_type() const;
+
+        void set_size(const unsigned x) {
+            LOG_TRACE(log, "field " << field_name << " new json size: " << x);
+            size = x;
+        }
+
+    private:
+        unsigned size;
+        JsonMode mode;
+        PartialJsonMode partial_mode;
+        json::Value last;
+};
+
 
 }
 
@@ -0,0 +1,63 @@
+/* Copyright 2011 ZAO "Begun".
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef __SLAVE_GTID_CLAIMS_H_
+#define __SLAVE_GTID_CLAIMS_H_
+
+#include <cstddef>
+#include <mutex>
+
+#include "binlog_pos.h"
+
+namespace slave
+{
+
+// Transactions read by several Slaves from different sources of the same GTID history,
+// i.e. from master and its replica. The first Slave, which has read a transaction completely,
+// claims its GTID and delivers it, the others skip it as a duplicate. See Slave::setGtidClaims.
+class GtidClaims
+{
+public:
+
+    // Held while the claimed transaction is delivered, so that callbacks of the Slaves
+    // are called for one transaction at a time
+    std::unique_lock<std::mutex> lock() { return std::unique_lock<std::mutex>(m_mutex); }
+
+    // Under lock(): true for the first claim of the GTID
+    bool claim(const gtid_t& gtid)
+    {
+        if (m_claimed.hasGtid(gtid))
+        {
+            ++m_duplicates;
+            return false;
+        }
+        m_claimed.addGtid(gtid);
+        return true;
+    }
+
+    // Under lock()
+    const Position& claimed() const { return m_claimed; }
+    size_t duplicates() const { return m_duplicates; }
+
+private:
+
+    std::mutex m_mutex;
+    Position   m_claimed;
+    size_t     m_duplicates = 0;
+};
+
+}// slave
+
+#endif
@@ -0,0 +1,902 @@
+/* Copyright 2011 ZAO "Begun".
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+
+#include <my_byteorder.h>
+#undef min
+#undef max
+#undef test
+
+#include <mysql.h>
+#include <decimal.h>
+
+#include "json_binary.h"
+
+namespace
+{
+// Type bytes, see json_binary.h @ mysql
+enum
+{
+    JSONB_TYPE_SMALL_OBJECT = 0x0,
+    JSONB_TYPE_LARGE_OBJECT = 0x1,
+    JSONB_TYPE_SMALL_ARRAY  = 0x2,
+    JSONB_TYPE_LARGE_ARRAY  = 0x3,
+    JSONB_TYPE_LITERAL      = 0x4,
+    JSONB_TYPE_INT16        = 0x5,
+    JSONB_TYPE_UINT16       = 0x6,
+    JSONB_TYPE_INT32        = 0x7,
+    JSONB_TYPE_UINT32       = 0x8,
+    JSONB_TYPE_INT64        = 0x9,
+    JSONB_TYPE_UINT64       = 0xA,
+    JSONB_TYPE_DOUBLE       = 0xB,
+    JSONB_TYPE_STRING       = 0xC,
+    JSONB_TYPE_OPAQUE       = 0xF
+};
+
+enum
+{
+    JSONB_NULL_LITERAL  = 0x0,
+    JSONB_TRUE_LITERAL  = 0x1,
+    JSONB_FALSE_LITERAL = 0x2
+};
+
+inline uint64_t readLE(const char* p, size_t n)
+{
+    uint64_t x = 0;
+    for (size_t i = n; i > 0; --i)
+        x = (x << 8) | static_cast<unsigned char>(p[i - 1]);
+    return x;
+}
+
+// Offset or size inside of object or array
+inline size_t offsetSize(bool large) { return large ? 4 : 2; }
+
+// Key entry: offset and 2-byte length; value entry: type and offset (or inlined value)
+inline size_t keyEntrySize(bool large) { return offsetSize(large) + 2; }
+inline size_t valueEntrySize(bool large) { return 1 + offsetSize(large); }
+
+inline bool inlined(uint8_t type, bool large)
+{
+    switch (type)
+    {
+    case JSONB_TYPE_LITERAL:
+    case JSONB_TYPE_INT16:
+    case JSONB_TYPE_UINT16:
+        return true;
+    case JSONB_TYPE_INT32:
+    case JSONB_TYPE_UINT32:
+        return large;
+    default:
+        return false;
+    }
+}
+
+// Variable length of strings and opaque values: 7 bits per byte, high bit means "more"
+bool readVarLen(const char*& data, size_t& size, size_t& len)
+{
+    len = 0;
+    for (unsigned i = 0; i < 5 && i < size; ++i)
+    {
+        const unsigned char b = data[i];
+        len |= static_cast<size_t>(b & 0x7F) << (7 * i);
+        if (!(b & 0x80))
+        {
+            data += i + 1;
+            size -= i + 1;
+            return len <= size;
+        }
+    }
+    return false;
+}
+
+void appendString(std::string& out, boost::string_view s)
+{
+    static const char hex[] = "0123456789abcdef";
+
+    out += '"';
+    for (const char c : s)
+    {
+        switch (c)
+        {
+        case '"':  out += "\\\""; break;
+        case '\\': out += "\\\\"; break;
+        case '\b': out += "\\b"; break;
+        case '\f': out += "\\f"; break;
+        case '\n': out += "\\n"; break;
+        case '\r': out += "\\r"; break;
+        case '\t': out += "\\t"; break;
+        default:
+            if (static_cast<unsigned char>(c) < 0x20)
+            {
+                out += "\\u00";
+                out += hex[c >> 4];
+                out += hex[c & 0xF];
+            }
+            else
+                out += c;
+        }
+    }
+    out += '"';
+}
+
+// Shortest representation which reads back to the same value, integral ones get ".0"
+void appendDouble(std::string& out, double d)
+{
+    char buf[32];
+    for (int precision = 15; precision <= 17; ++precision)
+    {
+        snprintf(buf, sizeof(buf), "%.*g", precision, d);
+        if (std::strtod(buf, nullptr) == d)
+            break;
+    }
+    out += buf;
+    if (std::isfinite(d) && !std::strpbrk(buf, ".e"))
+        out += ".0";
+}
+
+void appendBase64(std::string& out, boost::string_view s)
+{
+    static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+    size_t i = 0;
+    for (; i + 2 < s.size(); i += 3)
+    {
+        const uint32_t x = readLE(&s[i], 1) << 16 | readLE(&s[i + 1], 1) << 8 | readLE(&s[i + 2], 1);
+        out += alphabet[x >> 18];
+        out += alphabet[(x >> 12) & 0x3F];
+        out += alphabet[(x >> 6) & 0x3F];
+        out += alphabet[x & 0x3F];
+    }
+    if (i < s.size())
+    {
+        const bool two = i + 1 < s.size();
+        const uint32_t x = readLE(&s[i], 1) << 16 | (two ? readLE(&s[i + 1], 1) << 8 : 0);
+        out += alphabet[x >> 18];
+        out += alphabet[(x >> 12) & 0x3F];
+        out += two ? alphabet[(x >> 6) & 0x3F] : '=';
+        out += '=';
+    }
+}
+
+// DATE, TIME and DATETIME are stored as packed longlong, see TIME_to_longlong_*_packed() @ my_time.c
+void appendTemporal(std::string& out, unsigned type, boost::string_view data)
+{
+    if (data.size() < 8)
+        throw std::runtime_error("json::Value: bad temporal value");
+
+    int64_t packed = static_cast<int64_t>(readLE(data.data(), 8));
+    const bool neg = packed < 0;
+    if (neg)
+        packed = -packed;
+
+    const unsigned usec = packed % (1LL << 24);
+    const int64_t ymdhms = packed >> 24;
+
+    char buf[64];
+    if (type == MYSQL_TYPE_TIME)
+    {
+        snprintf(buf, sizeof(buf), "\"%s%02u:%02u:%02u.%06u\"", neg ? "-" : "",
+                 static_cast<unsigned>((ymdhms >> 12) % (1 << 10)),
+                 static_cast<unsigned>((ymdhms >> 6) % (1 << 6)),
+                 static_cast<unsigned>(ymdhms % (1 << 6)), usec);
+    }
+    else
+    {
+        const int64_t ymd = ymdhms >> 17;
+        const int64_t ym = ymd >> 5;
+        const int64_t hms = ymdhms % (1 << 17);
+        const unsigned year = ym / 13, month = ym % 13, day = ymd % (1 << 5);
+
+        if (type == MYSQL_TYPE_DATE)
+            snprintf(buf, sizeof(buf), "\"%04u-%02u-%02u\"", year, month, day);
+        else
+            snprintf(buf, sizeof(buf), "\"%04u-%02u-%02u %02u:%02u:%02u.%06u\"", year, month, day,
+                     static_cast<unsigned>(hms >> 12), static_cast<unsigned>((hms >> 6) % (1 << 6)),
+                     static_cast<unsigned>(hms % (1 << 6)), usec);
+    }
+    out += buf;
+}
+
+// Opaque DECIMAL: precision, scale and binary decimal
+void appendDecimal(std::string& out, boost::string_view data)
+{
+    if (data.size() < 2)
+        throw std::runtime_error("json::Value: bad decimal value");
+
+    const int precision = static_cast<unsigned char>(data[0]);
+    const int scale = static_cast<unsigned char>(data[1]);
+    if (precision > 65 || scale > precision || data.size() < 2 + static_cast<size_t>(::decimal_bin_size(precision, scale)))
+        throw std::runtime_error("json::Value: bad decimal value");
+
+    // see DECIMAL_BUFF_LENGTH @ my_decimal.h
+    ::decimal_digit_t buf[ 9 ];
+    ::decimal_t dec;
+    dec.len = 9;
+    dec.buf = buf;
+
+    if (::bin2decimal((const uchar*)data.data() + 2, &dec, precision, scale) != E_DEC_OK)
+        throw std::runtime_error("json::Value: bin2decimal() failed");
+
+    int length = decimal_string_size(&dec);
+    char str[ length ];
+    if (::decimal2string(&dec, str, &length, 0, 0, 0) != E_DEC_OK)
+        throw std::runtime_error("json::Value: decimal2string() failed");
+
+    out.append(str, length);
+}
+// Splits path like "$.a."b c"[1]" into member names and array indexes
+class PathParser
+{
+public:
+
+    struct Leg
+    {
+        bool               member = false;
+        boost::string_view key;
+        size_t             index = 0;
+        // Storage for unescaped quoted key
+        std::string        buf;
+    };
+
+    explicit PathParser(boost::string_view path) : m_path(path)
+    {
+        skipSpaces();
+        if (m_i == m_path.size() || m_path[m_i] != '$')
+            error("path must start with '$'");
+        ++m_i;
+    }
+
+    // Reads next leg, returns false at the end of path
+    bool next(Leg& leg)
+    {
+        skipSpaces();
+        if (m_i == m_path.size())
+            return false;
+
+        if (m_path[m_i] == '.')
+        {
+            ++m_i;
+            skipSpaces();
+            leg.member = true;
+            if (m_i < m_path.size() && m_path[m_i] == '"')
+            {
+                // Quoted key, only \" and \\ escapes are expected there
+                leg.buf.clear();
+                for (++m_i; m_i < m_path.size() && m_path[m_i] != '"'; ++m_i)
+                {
+                    if (m_path[m_i] == '\\' && m_i + 1 < m_path.size())
+                        ++m_i;
+                    leg.buf += m_path[m_i];
+                }
+                if (m_i == m_path.size())
+                    error("unterminated key in path");
+                ++m_i;
+                leg.key = leg.buf;
+            }
+            else
+            {
+                const size_t start = m_i;
+                while (m_i < m_path.size() && m_path[m_i] != '.' && m_path[m_i] != '[' && m_path[m_i] != ' ')
+                    ++m_i;
+                if (start == m_i)
+                    error("empty key in path");
+                leg.key = m_path.substr(start, m_i - start);
+            }
+            return true;
+        }
+
+        if (m_path[m_i] == '[')
+        {
+            ++m_i;
+            skipSpaces();
+            leg.member = false;
+            leg.index = 0;
+            const size_t start = m_i;
+            for (; m_i < m_path.size() && m_path[m_i] >= '0' && m_path[m_i] <= '9'; ++m_i)
+                leg.index = leg.index * 10 + (m_path[m_i] - '0');
+            skipSpaces();
+            if (start == m_i || m_i == m_path.size() || m_path[m_i] != ']')
+                error("bad array index in path");
+            ++m_i;
+            return true;
+        }
+
+        error("bad path");
+        return false;
+    }
+
+private:
+
+    void skipSpaces()
+    {
+        while (m_i < m_path.size() && m_path[m_i] == ' ')
+            ++m_i;
+    }
+
+    void error(const char* what) const
+    {
+        throw std::runtime_error(std::string("json: ") + what + ": " + m_path.to_string());
+    }
+
+    const boost::string_view m_path;
+    size_t                   m_i = 0;
+};
+
+// Length of diff path and value, see net_store_length() @ pack.c
+bool readPacked(const char*& p, const char* end, size_t& len)
+{
+    if (p >= end)
+        return false;
+
+    const unsigned char first = *p;
+    size_t n = 0;
+    if (first < 251)
+        len = first;
+    else if (first == 252)
+        n = 2;
+    else if (first == 253)
+        n = 3;
+    else if (first == 254)
+        n = 8;
+    else
+        return false;
+
+    if (static_cast<size_t>(end - p) < n + 1)
+        return false;
+    if (n)
+        len = readLE(p + 1, n);
+    p += n + 1;
+    return len <= static_cast<size_t>(end - p);
+}
+
+// Keys of objects are ordered by length, then by bytes
+inline bool keyLess(boost::string_view a, boost::string_view b)
+{
+    return a.size() != b.size() ? a.size() < b.size() : a.compare(b) < 0;
+}
+}// anonymous-namespace
+
+namespace slave
+{
+namespace json
+{
+
+Value::Value(const char* data, size_t size)
+{
+    if (size > 0)
+        *this = make(static_cast<unsigned char>(data[0]), data + 1, size - 1);
+}
+
+Value Value::make(uint8_t type, const char* data, size_t size)
+{
+    switch (type)
+    {
+    case JSONB_TYPE_SMALL_OBJECT:
+    case JSONB_TYPE_LARGE_OBJECT:
+    case JSONB_TYPE_SMALL_ARRAY:
+    case JSONB_TYPE_LARGE_ARRAY:
+    {
+        const bool large = type == JSONB_TYPE_LARGE_OBJECT || type == JSONB_TYPE_LARGE_ARRAY;
+        const size_t n = offsetSize(large);
+        if (size < 2 * n)
+            return Value();
+
+        const size_t count = readLE(data, n);
+        const size_t bytes = readLE(data + n, n);
+        const bool object = type == JSONB_TYPE_SMALL_OBJECT || type == JSONB_TYPE_LARGE_OBJECT;
+        const size_t header = 2 * n + count * ((object ? keyEntrySize(large) : 0) + valueEntrySize(large));
+        if (bytes > size || header > bytes)
+            return Value();
+
+        return Value(object ? Object : Array, type, data, bytes);
+    }
+    case JSONB_TYPE_LITERAL:
+        if (size < 1)
+            return Value();
+        switch (static_cast<unsigned char>(data[0]))
+        {
+        case JSONB_NULL_LITERAL:  return Value(Null, type, data, 1);
+        case JSONB_TRUE_LITERAL:
+        case JSONB_FALSE_LITERAL: return Value(Boolean, type, data, 1);
+        default:                  return Value();
+        }
+    case JSONB_TYPE_INT16:  return size < 2 ? Value() : Value(Int, type, data, 2);
+    case JSONB_TYPE_UINT16: return size < 2 ? Value() : Value(UInt, type, data, 2);
+    case JSONB_TYPE_INT32:  return size < 4 ? Value() : Value(Int, type, data, 4);
+    case JSONB_TYPE_UINT32: return size < 4 ? Value() : Value(UInt, type, data, 4);
+    case JSONB_TYPE_INT64:  return size < 8 ? Value() : Value(Int, type, data, 8);
+    case JSONB_TYPE_UINT64: return size < 8 ? Value() : Value(UInt, type, data, 8);
+    case JSONB_TYPE_DOUBLE: return size < 8 ? Value() : Value(Double, type, data, 8);
+    case JSONB_TYPE_STRING:
+    {
+        size_t len;
+        if (!readVarLen(data, size, len))
+            return Value();
+        return Value(String, type, data, len);
+    }
+    case JSONB_TYPE_OPAQUE:
+    {
+        // Field type is kept in the first byte of data
+        if (size < 1)
+            return Value();
+        const char* p = data + 1;
+        size_t rest = size - 1;
+        size_t len;
+        if (!readVarLen(p, rest, len))
+            return Value();
+        return Value(Opaque, type, data, p + len - data);
+    }
+    default:
+        return Value();
+    }
+}
+
+bool Value::large() const
+{
+    return m_subtype == JSONB_TYPE_LARGE_OBJECT || m_subtype == JSONB_TYPE_LARGE_ARRAY;
+}
+
+bool Value::getBool() const
+{
+    if (m_type != Boolean)
+        throw std::runtime_error("json::Value: not a boolean");
+    return m_data[0] == JSONB_TRUE_LITERAL;
+}
+
+int64_t Value::getInt() const
+{
+    if (m_type == Int)
+    {
+        // sign extension
+        const unsigned shift = 64 - 8 * m_size;
+        return static_cast<int64_t>(readLE(m_data, m_size) << shift) >> shift;
+    }
+    if (m_type == UInt)
+        return static_cast<int64_t>(readLE(m_data, m_size));
+    throw std::runtime_error("json::Value: not an integer");
+}
+
+uint64_t Value::getUInt() const
+{
+    if (m_type == UInt)
+        return readLE(m_data, m_size);
+    if (m_type == Int)
+        return static_cast<uint64_t>(getInt());
+    throw std::runtime_error("json::Value: not an integer");
+}
+
+double Value::getDouble() const
+{
+    switch (m_type)
+    {
+    case Double:
+    {
+        const uint64_t bits = readLE(m_data, 8);
+        double d;
+        ::memcpy(&d, &bits, sizeof(d));
+        return d;
+    }
+    case Int:  return getInt();
+    case UInt: return getUInt();
+    default:   throw std::runtime_error("json::Value: not a number");
+    }
+}
+
+boost::string_view Value::getString() const
+{
+    if (m_type != String)
+        throw std::runtime_error("json::Value: not a string");
+    return boost::string_view(m_data, m_size);
+}
+
+unsigned Value::opaqueType() const
+{
+    if (m_type != Opaque)
+        throw std::runtime_error("json::Value: not an opaque value");
+    return static_cast<unsigned char>(m_data[0]);
+}
+
+boost::string_view Value::getOpaque() const
+{
+    if (m_type != Opaque)
+        throw std::runtime_error("json::Value: not an opaque value");
+    const char* p = m_data + 1;
+    size_t rest = m_size - 1;
+    size_t len;
+    readVarLen(p, rest, len);
+    return boost::string_view(p, len);
+}
+
+size_t Value::size() const
+{
+    if (m_type != Object && m_type != Array)
+        return 0;
+    return readLE(m_data, offsetSize(large()));
+}
+
+Value Value::element(size_t index) const
+{
+    const bool is_large = large();
+    const size_t n = offsetSize(is_large);
+    size_t entry = 2 * n + index * valueEntrySize(is_large);
+    if (m_type == Object)
+        entry += size() * keyEntrySize(is_large);
+
+    const uint8_t type = m_data[entry];
+    if (inlined(type, is_large))
+        return make(type, m_data + entry + 1, n);
+
+    const size_t offset = readLE(m_data + entry + 1, n);
+    if (offset >= m_size)
+        return Value();
+    return make(type, m_data + offset, m_size - offset);
+}
+
+Value Value::operator[](size_t index) const
+{
+    if (m_type != Array || index >= size())
+        return Value();
+    return element(index);
+}
+
+Value Value::member(size_t index) const
+{
+    if (m_type != Object || index >= size())
+        return Value();
+    return element(index);
+}
+
+boost::string_view Value::key(size_t index) const
+{
+    if (m_type != Object || index >= size())
+        return boost::string_view();
+
+    const bool is_large = large();
+    const size_t n = offsetSize(is_large);
+    const char* entry = m_data + 2 * n + index * keyEntrySize(is_large);
+    const size_t offset = readLE(entry, n);
+    const size_t len = readLE(entry + n, 2);
+    if (offset + len > m_size)
+        return boost::string_view();
+    return boost::string_view(m_data + offset, len);
+}
+
+Value Value::operator[](boost::string_view name) const
+{
+    if (m_type != Object)
+        return Value();
+
+    // Keys are sorted by length, then by bytes
+    size_t lo = 0, hi = size();
+    while (lo < hi)
+    {
+        const size_t mid = lo + (hi - lo) / 2;
+        const boost::string_view k = key(mid);
+        const int cmp = k.size() != name.size() ? (k.size() < name.size() ? -1 : 1) : k.compare(name);
+        if (cmp == 0)
+            return element(mid);
+        if (cmp < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return Value();
+}
+
+Value Value::path(boost::string_view path) const
+{
+    PathParser parser(path);
+    PathParser::Leg leg;
+
+    Value v = *this;
+    while (v.valid() && parser.next(leg))
+        v = leg.member ? v[leg.key] : v[leg.index];
+    return v;
+}
+
+std::string Value::toString() const
+{
+    std::string out;
+    toString(out);
+    return out;
+}
+
+void Value::toString(std::string& out) const
+{
+    switch (m_type)
+    {
+    case Invalid:
+        throw std::runtime_error("json::Value: invalid value");
+    case Null:
+        out += "null";
+        break;
+    case Boolean:
+        out += getBool() ? "true" : "false";
+        break;
+    case Int:
+        out += std::to_string(getInt());
+        break;
+    case UInt:
+        out += std::to_string(getUInt());
+        break;
+    case Double:
+        appendDouble(out, getDouble());
+        break;
+    case String:
+        appendString(out, getString());
+        break;
+    case Object:
+    {
+        out += '{';
+        const size_t count = size();
+        for (size_t i = 0; i < count; ++i)
+        {
+            if (i)
+                out += ", ";
+            appendString(out, key(i));
+            out += ": ";
+            element(i).toString(out);
+        }
+        out += '}';
+        break;
+    }
+    case Array:
+    {
+        out += '[';
+        const size_t count = size();
+        for (size_t i = 0; i < count; ++i)
+        {
+            if (i)
+                out += ", ";
+            element(i).toString(out);
+        }
+        out += ']';
+        break;
+    }
+    case Opaque:
+    {
+        const unsigned type = opaqueType();
+        const boost::string_view data = getOpaque();
+        switch (type)
+        {
+        case MYSQL_TYPE_NEWDECIMAL:
+            appendDecimal(out, data);
+            break;
+        case MYSQL_TYPE_DATE:
+        case MYSQL_TYPE_TIME:
+        case MYSQL_TYPE_DATETIME:
+        case MYSQL_TYPE_TIMESTAMP:
+            appendTemporal(out, type, data);
+            break;
+        default:
+            out += "\"base64:type" + std::to_string(type) + ":";
+            appendBase64(out, data);
+            out += '"';
+        }
+        break;
+    }
+    }
+}
+
+}// json
+}// slave
+
+namespace
+{
+// Mutable document to apply diffs to. Only containers along changed paths are decoded,
+// the rest stays a view of the original document.
+struct Node
+{
+    slave::json::Value value;   // not modified part of document
+    bool               object = false;
+    bool               decoded = false;
+    std::vector<std::pair<std::string, Node>> members;
+    std::vector<Node>  elements;
+
+    explicit Node(const slave::json::Value& v) : value(v), object(v.type() == slave::json::Value::Object) {}
+
+    // Children of object or array are needed to modify them
+    void decode()
+    {
+        if (decoded)
+            return;
+        if (value.type() != slave::json::Value::Object && value.type() != slave::json::Value::Array)
+            throw std::runtime_error("json::applyDiffs: path goes through scalar value");
+
+        const size_t count = value.size();
+        for (size_t i = 0; i < count; ++i)
+        {
+            if (object)
+                members.emplace_back(value.key(i).to_string(), Node(value.member(i)));
+            else
+                elements.emplace_back(value[i]);
+        }
+        decoded = true;
+    }
+
+    std::vector<std::pair<std::string, Node>>::iterator find(boost::string_view key)
+    {
+        auto it = std::lower_bound(members.begin(), members.end(), key,
+                                   [](const std::pair<std::string, Node>& m, boost::string_view k) { return keyLess(m.first, k); });
+        return it != members.end() && it->first == key ? it : members.end();
+    }
+
+    Node& child(const PathParser::Leg& leg)
+    {
+        decode();
+        if (leg.member && object)
+        {
+            const auto it = find(leg.key);
+            if (it != members.end())
+                return it->second;
+        }
+        else if (!leg.member && !object && leg.index < elements.size())
+            return elements[leg.index];
+        throw std::runtime_error("json::applyDiffs: path does not exist");
+    }
+
+    void apply(const PathParser::Leg& leg, const slave::json::Diff& diff)
+    {
+        decode();
+        if (leg.member != object)
+            throw std::runtime_error("json::applyDiffs: path does not match document");
+
+        if (object)
+        {
+            auto it = find(leg.key);
+            if (diff.operation == slave::json::Diff::Remove || diff.operation == slave::json::Diff::Replace)
+            {
+                if (it == members.end())
+                    throw std::runtime_error("json::applyDiffs: member does not exist");
+                if (diff.operation == slave::json::Diff::Remove)
+                    members.erase(it);
+                else
+                    it->second = Node(diff.value);
+            }
+            else if (it != members.end())
+                it->second = Node(diff.value);
+            else
+            {
+                it = std::lower_bound(members.begin(), members.end(), leg.key,
+                                      [](const std::pair<std::string, Node>& m, boost::string_view k) { return keyLess(m.first, k); });
+                members.emplace(it, leg.key.to_string(), Node(diff.value));
+            }
+            return;
+        }
+
+        switch (diff.operation)
+        {
+        case slave::json::Diff::Insert:
+            elements.emplace(elements.begin() + std::min(leg.index, elements.size()), diff.value);
+            break;
+        case slave::json::Diff::Replace:
+        case slave::json::Diff::Remove:
+            if (leg.index >= elements.size())
+                throw std::runtime_error("json::applyDiffs: element does not exist");
+            if (diff.operation == slave::json::Diff::Remove)
+                elements.erase(elements.begin() + leg.index);
+            else
+                elements[leg.index] = Node(diff.value);
+            break;
+        }
+    }
+
+    void toString(std::string& out) const
+    {
+        if (!decoded)
+        {
+            value.toString(out);
+            return;
+        }
+
+        out += object ? '{' : '[';
+        const size_t count = object ? members.size() : elements.size();
+        for (size_t i = 0; i < count; ++i)
+        {
+            if (i)
+                out += ", ";
+            if (object)
+            {
+                appendString(out, members[i].first);
+                out += ": ";
+                members[i].second.toString(out);
+            }
+            else
+                elements[i].toString(out);
+        }
+        out += object ? '}' : ']';
+    }
+};
+}// anonymous-namespace
+
+namespace slave
+{
+namespace json
+{
+
+void parseDiffs(const char* data, size_t size, Diffs& diffs)
+{
+    diffs.clear();
+
+    const char* end = data + size;
+    while (data < end)
+    {
+        Diff diff;
+        const unsigned char operation = *data++;
+        if (operation > Diff::Remove)
+            throw std::runtime_error("json::parseDiffs: unknown operation " + std::to_string(operation));
+        diff.operation = static_cast<Diff::Operation>(operation);
+
+        size_t len;
+        if (!readPacked(data, end, len))
+            throw std::runtime_error("json::parseDiffs: bad path length");
+        diff.path = boost::string_view(data, len);
+        data += len;
+
+        if (diff.operation != Diff::Remove)
+        {
+            if (!readPacked(data, end, len))
+                throw std::runtime_error("json::parseDiffs: bad value length");
+            diff.value = Value(data, len);
+            if (!diff.value.valid())
+                throw std::runtime_error("json::parseDiffs: bad value");
+            data += len;
+        }
+
+        diffs.push_back(diff);
+    }
+}
+
+std::string applyDiffs(const Value& doc, const Diffs& diffs)
+{
+    Node root(doc);
+
+    for (const auto& diff : diffs)
+    {
+        PathParser parser(diff.path);
+        // Leg may point to its own buffer, so they are not moved
+        PathParser::Leg legs[2];
+        int cur = 0;
+
+        if (!parser.next(legs[cur]))
+        {
+            if (diff.operation != Diff::Replace)
+                throw std::runtime_error("json::applyDiffs: can not insert or remove document itself");
+            root = Node(diff.value);
+            continue;
+        }
+
+        Node* node = &root;
+        while (parser.next(legs[1 - cur]))
+        {
+            node = &node->child(legs[cur]);
+            cur = 1 - cur;
+        }
+        node->apply(legs[cur], diff);
+    }
+
+    std::string out;
+    root.toString(out);
+    return out;
+}
+
+}// json
+}// slave
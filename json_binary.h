@@ -0,0 +1,129 @@
+/* Copyright 2011 ZAO "Begun".
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __SLAVE_JSON_BINARY_H_
+#define __SLAVE_JSON_BINARY_H_
+
+#include <inttypes.h>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include <boost/utility/string_view.hpp>
+
+namespace slave
+{
+namespace json
+{
+
+// View of a value in MySQL binary JSON format (see json_binary.h @ mysql). Nothing is decoded
+// in advance: members, elements and paths are found directly in the binary data, which is
+// borrowed, so the view is valid only while the data is (i.e. inside callback for row values).
+class Value
+{
+public:
+
+    enum Type
+    {
+        Invalid,    // malformed data or missing member
+        Null,
+        Boolean,
+        Int,
+        UInt,
+        Double,
+        String,
+        Object,
+        Array,
+        Opaque      // other MySQL types: DECIMAL, DATETIME, etc.
+    };
+
+    Value() {}
+
+    // Whole document: type byte followed by the value
+    Value(const char* data, size_t size);
+
+    Type type() const { return m_type; }
+    bool valid() const { return m_type != Invalid; }
+
+    bool getBool() const;
+    int64_t getInt() const;
+    uint64_t getUInt() const;
+    double getDouble() const;
+    boost::string_view getString() const;
+    // MySQL field type of Opaque value and its data
+    unsigned opaqueType() const;
+    boost::string_view getOpaque() const;
+
+    // Number of elements of Object or Array
+    size_t size() const;
+    // Element of Array
+    Value operator[](size_t index) const;
+    // Member of Object by name
+    Value operator[](boost::string_view key) const;
+    // Member of Object by index, members are ordered by key length, then by key
+    boost::string_view key(size_t index) const;
+    Value member(size_t index) const;
+
+    // Value at path like "$.user.id", "$.items[0]" or "$.\"odd key\"", Invalid if absent.
+    Value path(boost::string_view path) const;
+
+    // JSON text as printed by MySQL
+    std::string toString() const;
+    void toString(std::string& out) const;
+
+private:
+
+    Value(Type type, uint8_t subtype, const char* data, size_t size)
+    :   m_type(type), m_subtype(subtype), m_data(data), m_size(size)
+    {}
+
+    static Value make(uint8_t type, const char* data, size_t size);
+    Value element(size_t index) const;
+    bool large() const;
+
+    Type        m_type = Invalid;
+    // Binary type byte: it keeps exact integer width and small/large layout
+    uint8_t     m_subtype = 0;
+    const char* m_data = nullptr;
+    size_t      m_size = 0;
+};
+
+// Modification of JSON document written to PARTIAL_UPDATE_ROWS_EVENT (see Json_diff @ mysql).
+// Like Value, it borrows event data.
+struct Diff
+{
+    enum Operation
+    {
+        Replace,
+        Insert,
+        Remove
+    };
+
+    Operation          operation = Replace;
+    boost::string_view path;    // i.e. "$.items[1]"
+    Value              value;   // Invalid for Remove
+};
+
+typedef std::vector<Diff> Diffs;
+
+// Parses diff list of a column (without its length)
+void parseDiffs(const char* data, size_t size, Diffs& diffs);
+
+// Text of document after applying diffs to it, i.e. to before image of the column.
+std::string applyDiffs(const Value& doc, const Diffs& diffs);
+
+}// json
+}// slave
+
+#endif
@@ -1,12 +1,66 @@
 #ifndef __SLAVE_NANO_FIELD_H__
 #define __SLAVE_NANO_FIELD_H__
 
+#include <cstdlib>
+#include <cstring>
+#include <limits>
 #include <map>
 #include <string>
 #include <sstream>
+#include <type_traits>
+#include <boost/utility/string_view.hpp>
 
 namespace nanomysql
 {
+    // Parses the whole text as a decimal integer, like std::from_chars.
+    // Returns false on empty text, garbage or overflow.
+    template <typename T>
+    typename std::enable_if<std::is_integral<T>::value && !std::is_same<T, bool>::value, bool>::type
+    parse_number(boost::string_view s, T& value)
+    {
+        typedef typename std::make_unsigned<T>::type U;
+
+        const char* p = s.begin();
+        const bool negative = p != s.end() && *p == '-';
+        if (negative && std::is_unsigned<T>::value)
+            return false;
+        if (p != s.end() && (*p == '-' || *p == '+'))
+            ++p;
+        if (p == s.end())
+            return false;
+
+        const U limit = negative ? U(std::numeric_limits<T>::max()) + 1 : U(std::numeric_limits<T>::max());
+        U result = 0;
+        for (; p != s.end(); ++p)
+        {
+            const unsigned digit = static_cast<unsigned char>(*p) - '0';
+            if (digit > 9 || result > (limit - digit) / 10)
+                return false;
+            result = result * 10 + digit;
+        }
+        value = negative ? static_cast<T>(U(0) - result) : static_cast<T>(result);
+        return true;
+    }
+
+    template <typename T>
+    typename std::enable_if<std::is_floating_point<T>::value, bool>::type
+    parse_number(boost::string_view s, T& value)
+    {
+        // strtod needs terminated string, numbers in mysql results are short
+        char buf[64];
+        if (s.empty() || s.size() >= sizeof(buf))
+            return false;
+        ::memcpy(buf, s.data(), s.size());
+        buf[s.size()] = '\0';
+
+        char* end = nullptr;
+        const double result = ::strtod(buf, &end);
+        if (end != buf + s.size())
+            return false;
+        value = static_cast<T>(result);
+        return true;
+    }
+
     struct field
     {
         const std::string name;
@@ -22,6 +76,31 @@ namespace nanomysql
 
         template <typename T>
         operator T() const
+        {
+            return convert<T>(is_number<T>());
+        }
+
+    private:
+
+        // Types, which std::istream reads as numbers
+        template <typename T>
+        using is_number = std::integral_constant<bool, std::is_arithmetic<T>::value
+                                                     && !std::is_same<T, bool>::value
+                                                     && !std::is_same<T, char>::value
+                                                     && !std::is_same<T, signed char>::value
+                                                     && !std::is_same<T, unsigned char>::value>;
+
+        template <typename T>
+        T convert(std::true_type) const
+        {
+            T ret;
+            if (parse_number(data, ret))
+                return ret;
+            return convert<T>(std::false_type());
+        }
+
+        template <typename T>
+        T convert(std::false_type) const
         {
             T ret;
             std::istringstream s;
@@ -39,28 +39,135 @@ struct mysql_conn_opts
     unsigned int mysql_write_timeout    = 60 * 15;
 };
 
-class Connection {
+// Error reported by mysql client library, code is mysql_errno(), i.e. ER_NO_SUCH_TABLE or CR_SERVER_LOST
+class Error : public std::runtime_error
+{
+public:
+    Error(const std::string& msg, unsigned int code) : std::runtime_error(msg), m_code(code) {}
 
-    MYSQL* m_conn;
+    unsigned int code() const { return m_code; }
+
+private:
+    unsigned int m_code;
+};
+
+inline void throw_error(MYSQL* conn, std::string msg, const std::string& m2 = "")
+{
+
+    msg += ": ";
+    msg += ::mysql_error(conn);
+    msg += " : ";
 
-    void throw_error(std::string msg, const std::string& m2 = "")
+    char n[32];
+    ::snprintf(n, 31, "%d", ::mysql_errno(conn));
+    msg += n;
+
+    if (m2.size() > 0) {
+        msg += " : [";
+        msg += m2;
+        msg += "]";
+    }
+
+    throw Error(msg, ::mysql_errno(conn));
+}
+
+// Streaming cursor over the result of the last query. Columns are addressed by position,
+// index() resolves a name once before the rows are read. Cells point into the buffer of
+// mysql client and are valid until the next call of next().
+class Cursor {
+
+    MYSQL*         m_conn;
+    MYSQL_RES*     m_res;
+    MYSQL_FIELD*   m_fields;
+    size_t         m_num_fields;
+    MYSQL_ROW      m_row = NULL;
+    unsigned long* m_lengths = NULL;
+
+public:
+    static const size_t npos = size_t(-1);
+
+    explicit Cursor(MYSQL* conn) : m_conn(conn), m_res(::mysql_use_result(conn))
+    {
+        if (m_res == NULL)
+            throw_error(m_conn, "mysql_use_result() failed");
+        m_fields = ::mysql_fetch_fields(m_res);
+        m_num_fields = ::mysql_num_fields(m_res);
+    }
+
+    Cursor(Cursor&& other)
+        : m_conn(other.m_conn), m_res(other.m_res), m_fields(other.m_fields), m_num_fields(other.m_num_fields)
+        , m_row(other.m_row), m_lengths(other.m_lengths)
+    {
+        other.m_res = NULL;
+    }
+
+    Cursor(const Cursor&) = delete;
+    Cursor& operator= (const Cursor&) = delete;
+
+    // Not read rows are skipped by mysql_free_result()
+    ~Cursor()
     {
+        if (m_res != NULL)
+            ::mysql_free_result(m_res);
+    }
+
+    size_t size() const { return m_num_fields; }
+    const MYSQL_FIELD& field(size_t i) const { return m_fields[i]; }
 
-        msg += ": ";
-        msg += ::mysql_error(m_conn);
-        msg += " : ";
+    size_t find(boost::string_view name) const
+    {
+        for (size_t i = 0; i != m_num_fields; ++i)
+            if (name == boost::string_view(m_fields[i].name, m_fields[i].name_length))
+                return i;
+        return npos;
+    }
 
-        char n[32];
-        ::snprintf(n, 31, "%d", ::mysql_errno(m_conn));
-        msg += n;
+    size_t index(boost::string_view name) const
+    {
+        const size_t i = find(name);
+        if (i == npos)
+            throw std::runtime_error("nanomysql: result has no column '" + name.to_string() + "'");
+        return i;
+    }
 
-        if (m2.size() > 0) {
-            msg += " : [";
-            msg += m2;
-            msg += "]";
+    // Fetches the next row, returns false after the last one
+    bool next()
+    {
+        m_row = ::mysql_fetch_row(m_res);
+        if (m_row == NULL) {
+            if (::mysql_errno(m_conn) != 0)
+                throw_error(m_conn, "mysql_fetch_row() failed");
+            return false;
         }
+        m_lengths = ::mysql_fetch_lengths(m_res);
+        return true;
+    }
 
-        throw std::runtime_error(msg);
+    bool is_null(size_t i) const { return m_row[i] == NULL; }
+
+    boost::string_view operator[](size_t i) const
+    {
+        return boost::string_view(m_row[i], m_lengths[i]);
+    }
+
+    template <typename T>
+    T as(size_t i) const
+    {
+        T value;
+        if (is_null(i) || !parse_number((*this)[i], value))
+            throw std::runtime_error("nanomysql: column '" + std::string(m_fields[i].name, m_fields[i].name_length)
+                                     + "' is not a number: '" + (*this)[i].to_string() + "'");
+        return value;
+    }
+};
+
+class Connection {
+
+    MYSQL* m_conn;
+
+    void throw_error(const std::string& msg, const std::string& m2 = "")
+    {
+        nanomysql::throw_error(m_conn, msg, m2);
     }
 
     struct _mysql_res_wrap {
@@ -69,7 +176,7 @@ class Connection {
         ~_mysql_res_wrap() { if (s != NULL) ::mysql_free_result(s); }
     };
 
-    void connect(const mysql_conn_opts& opts)
+    void connect(const mysql_conn_opts& opts, unsigned long client_flag)
     {
         m_conn = mysql_guard::mysql_safe_init(NULL);
 
@@ -83,7 +190,7 @@ class Connection {
                                           , opts.mysql_user.c_str()
                                           , opts.mysql_pass.c_str()
                                           , opts.mysql_db.c_str()
-                                          , opts.mysql_port, NULL, 0
+                                          , opts.mysql_port, NULL, client_flag
                                            ) == NULL)
         {
             throw_error("Could not mysql_real_connect()");
@@ -136,9 +243,10 @@ public:
                      );
     }
 
-    Connection(const mysql_conn_opts& opts)
+    // client_flag of mysql_real_connect(), e.g. CLIENT_MULTI_STATEMENTS
+    Connection(const mysql_conn_opts& opts, unsigned long client_flag = 0)
     {
-        connect(opts);
+        connect(opts, client_flag);
     }
 
     ~Connection()
@@ -171,45 +279,44 @@ public:
             throw_error("mysql_query() failed", q);
     }
 
-    template <typename F>
-    void use(F f)
+    // Moves to the next result of multi-statement query, returns false if there is none
+    bool next_result()
     {
-        _mysql_res_wrap re(::mysql_use_result(m_conn));
+        const int ret = ::mysql_next_result(m_conn);
+        if (ret > 0)
+            throw_error("mysql_next_result() failed");
+        return ret == 0;
+    }
 
-        if (re.s == NULL) {
-            throw_error("mysql_use_result() failed");
-        }
+    // Checks that connection is alive, it is not reconnected
+    bool ping()
+    {
+        return ::mysql_ping(m_conn) == 0;
+    }
+
+    // Result of the last query, read row by row
+    Cursor cursor()
+    {
+        return Cursor(m_conn);
+    }
 
-        const size_t num_fields = ::mysql_num_fields(re.s);
+    template <typename F>
+    void use(F f)
+    {
+        Cursor cur(m_conn);
 
         fields_t fields;
         std::vector<fields_t::iterator> fields_n;
 
-        while (1) {
-            MYSQL_FIELD* ff = ::mysql_fetch_field(re.s);
-
-            if (!ff) break;
-
+        for (size_t z = 0; z != cur.size(); ++z) {
             fields_n.push_back(
-                push_field(fields, ff));
+                push_field(fields, &cur.field(z)));
         }
 
-        while (1) {
-            MYSQL_ROW row = ::mysql_fetch_row(re.s);
-
-            if (row == NULL) {
-                if (::mysql_errno(m_conn) != 0) {
-                    throw_error("mysql_fetch_row() failed");
-                }
-
-                break;
-            }
-
-            const unsigned long* lens = ::mysql_fetch_lengths(re.s);
-
-            for (size_t z = 0; z != num_fields; ++z) {
-                fields_n[z]->second.data.assign(row[z], lens[z]);
-                fields_n[z]->second.is_null = row[z] == 0;
+        while (cur.next()) {
+            for (size_t z = 0; z != cur.size(); ++z) {
+                fields_n[z]->second.data.assign(cur[z].data(), cur[z].size());
+                fields_n[z]->second.is_null = cur.is_null(z);
             }
 
             f(fields);
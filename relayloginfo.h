@@ -38,10 +38,15 @@ public:
     typedef std::map<std::pair<std::string, std::string>, PtrTable> name_to_table_t;
     name_to_table_t m_table_map;
 
+    // Structures shared between tables, by fingerprint
+    typedef std::multimap<uint64_t, PtrTableSchema> schemas_t;
+    schemas_t m_schemas;
+
 
     void clear() {
         m_map_table_name.clear();
         m_table_map.clear();
+        m_schemas.clear();
     }
 
 
@@ -73,7 +78,56 @@ public:
 
     void setTable(const std::string& table_name, const std::string& db_name, PtrTable&& table)
     {
-        m_table_map[std::make_pair(db_name, table_name)] = std::move(table);
+        PtrTable& slot = m_table_map[std::make_pair(db_name, table_name)];
+        PtrTableSchema old = slot ? slot->schema : PtrTableSchema();
+        slot = std::move(table);
+        releaseSchema(std::move(old));
+    }
+
+    void eraseTable(const std::pair<std::string, std::string>& key)
+    {
+        name_to_table_t::iterator p = m_table_map.find(key);
+        if (p == m_table_map.end())
+            return;
+
+        PtrTableSchema old = p->second->schema;
+        m_table_map.erase(p);
+        releaseSchema(std::move(old));
+    }
+
+    // Returns structure already used by another table with the same columns and options, or null
+    PtrTableSchema getSchema(uint64_t fingerprint, const columns_t& columns, const FieldOptions& options) const
+    {
+        const auto range = m_schemas.equal_range(fingerprint);
+
+        for (schemas_t::const_iterator p = range.first; p != range.second; ++p)
+            if (*p->second->columns == columns && p->second->options == options)
+                return p->second;
+
+        return PtrTableSchema();
+    }
+
+    void setSchema(const PtrTableSchema& schema)
+    {
+        m_schemas.emplace(schema->fingerprint, schema);
+    }
+
+private:
+
+    // Forgets structure of the replaced or removed table, if no other table uses it
+    void releaseSchema(PtrTableSchema schema)
+    {
+        // References are held by m_schemas and by the argument only
+        if (!schema || schema.use_count() > 2)
+            return;
+
+        const auto range = m_schemas.equal_range(schema->fingerprint);
+        for (schemas_t::iterator p = range.first; p != range.second; ++p) {
+            if (p->second == schema) {
+                m_schemas.erase(p);
+                return;
+            }
+        }
     }
 
 };
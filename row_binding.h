@@ -0,0 +1,453 @@
+/* Copyright 2011 ZAO "Begun".
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __SLAVE_ROW_BINDING_H_
+#define __SLAVE_ROW_BINDING_H_
+
+#include <functional>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <boost/any.hpp>
+#include <boost/utility/string_view.hpp>
+
+#include "table.h"
+
+namespace slave
+{
+
+// Row given to callback of RowBinding. Structures are reused from row to row.
+template <typename T>
+struct BoundRow
+{
+    T row;          // written or deleted row, after image of updated one
+    T old_row;      // before image of updated row
+    RecordSet::TypeEvent type_event = RecordSet::Write;
+    time_t when = 0;
+    unsigned int master_id = 0;
+};
+
+namespace binding
+{
+
+template <typename T>
+class Column
+{
+public:
+    virtual ~Column() {}
+    virtual const char* unpack(const char* from, T& row) const = 0;
+    // Column is NULL or is not in the row image
+    virtual void clear(T& row) const {}
+    // Partially updated JSON column
+    virtual const char* unpack_diffs(Field_json& field, const char* from, T& row) const { return field.unpack_diffs(from); }
+};
+
+// Columns, which are not bound, are skipped without decoding where possible
+template <typename T>
+class SkipColumn : public Column<T>
+{
+public:
+    explicit SkipColumn(Field* field) : m_field(field) {}
+    const char* unpack(const char* from, T& row) const { return m_field->unpack(from); }
+private:
+    Field* const m_field;
+};
+
+template <typename T, unsigned length>
+class SkipFixedColumn : public Column<T>
+{
+public:
+    const char* unpack(const char* from, T& row) const { return from + length; }
+};
+
+template <typename T, typename F>
+class SkipStringColumn : public Column<T>
+{
+public:
+    explicit SkipStringColumn(const F* field) : m_field(field) {}
+    const char* unpack(const char* from, T& row) const
+    {
+        boost::string_view value;
+        return m_field->unpack_view(from, value);
+    }
+private:
+    const F* const m_field;
+};
+
+template <typename T, typename M>
+class MemberColumn : public Column<T>
+{
+public:
+    explicit MemberColumn(M T::* member) : m_member(member) {}
+    void clear(T& row) const { row.*m_member = M(); }
+protected:
+    M T::* const m_member;
+};
+
+template <typename T, typename M, typename V, unsigned length>
+class NumColumn : public MemberColumn<T, M>
+{
+public:
+    NumColumn(const Field_num<V, length>* field, M T::* member) : MemberColumn<T, M>(member), m_field(field) {}
+    const char* unpack(const char* from, T& row) const
+    {
+        V value;
+        from = m_field->unpack_value(from, value);
+        row.*this->m_member = static_cast<M>(value);
+        return from;
+    }
+private:
+    const Field_num<V, length>* const m_field;
+};
+
+// M is std::string or boost::string_view, which points into the event
+template <typename T, typename M, typename F>
+class StringColumn : public MemberColumn<T, M>
+{
+public:
+    StringColumn(const F* field, M T::* member) : MemberColumn<T, M>(member), m_field(field) {}
+    const char* unpack(const char* from, T& row) const
+    {
+        boost::string_view value;
+        from = m_field->unpack_view(from, value);
+        (row.*this->m_member).assign(value.data(), value.size());
+        return from;
+    }
+private:
+    const F* const m_field;
+};
+
+template <typename T, typename F>
+class StringColumn<T, boost::string_view, F> : public MemberColumn<T, boost::string_view>
+{
+public:
+    StringColumn(const F* field, boost::string_view T::* member) : MemberColumn<T, boost::string_view>(member), m_field(field) {}
+    const char* unpack(const char* from, T& row) const { return m_field->unpack_view(from, row.*this->m_member); }
+private:
+    const F* const m_field;
+};
+
+// Other types are unpacked as usual and taken from field_data, its type is checked at bind
+template <typename T, typename M>
+class AnyColumn : public MemberColumn<T, M>
+{
+public:
+    AnyColumn(Field* field, M T::* member) : MemberColumn<T, M>(member), m_field(field) {}
+    const char* unpack(const char* from, T& row) const
+    {
+        from = m_field->unpack(from);
+        row.*this->m_member = boost::any_cast<const M&>(m_field->field_data);
+        return from;
+    }
+    const char* unpack_diffs(Field_json& field, const char* from, T& row) const
+    {
+        from = field.unpack_diffs(from);
+        row.*this->m_member = boost::any_cast<const M&>(m_field->field_data);
+        return from;
+    }
+private:
+    Field* const m_field;
+};
+
+template <typename T>
+using PtrColumn = std::unique_ptr<Column<T>>;
+
+inline void mismatch(const Table& table, const Field& field, const char* expected)
+{
+    LOG_ERROR(log, "RowBinding: column " << table.full_name << "." << field.field_name
+              << " of type " << field.field_type << " can not be bound to " << expected);
+    throw std::runtime_error("RowBinding: type mismatch of " + table.full_name + "." + field.field_name);
+}
+
+// Member M holds every value of a column of length bytes, which is unpacked as V
+template <typename M, typename V, unsigned length>
+struct Holds
+{
+    static const int digits = std::is_floating_point<V>::value ? std::numeric_limits<V>::digits
+                                                                : int(length * 8) - (std::is_signed<V>::value ? 1 : 0);
+    static const bool value = (std::is_floating_point<M>::value || !std::is_floating_point<V>::value)
+                           && (std::is_signed<M>::value || !std::is_signed<V>::value)
+                           && std::numeric_limits<M>::digits >= digits;
+};
+
+template <typename T, typename M, typename V, unsigned length>
+bool makeNum(const Table& table, Field* field, M T::* member, PtrColumn<T>& column, std::true_type)
+{
+    const auto num = dynamic_cast<const Field_num<V, length>*>(field);
+    if (num && !Holds<M, V, length>::value)
+        mismatch(table, *field, "narrower member");
+    if (num)
+        column.reset(new NumColumn<T, M, V, length>(num, member));
+    return num;
+}
+
+template <typename T, typename M, typename V, unsigned length>
+bool makeNum(const Table& table, Field* field, M T::* member, PtrColumn<T>& column, std::false_type)
+{
+    if (dynamic_cast<const Field_num<V, length>*>(field))
+        mismatch(table, *field, "non-arithmetic member");
+    return false;
+}
+
+template <typename T, typename M, typename F>
+bool makeString(const Table& table, Field* field, M T::* member, PtrColumn<T>& column, std::true_type)
+{
+    const auto str = dynamic_cast<const F*>(field);
+    if (str)
+        column.reset(new StringColumn<T, M, F>(str, member));
+    return str;
+}
+
+template <typename T, typename M, typename F>
+bool makeString(const Table& table, Field* field, M T::* member, PtrColumn<T>& column, std::false_type)
+{
+    if (dynamic_cast<const F*>(field))
+        mismatch(table, *field, "member other than std::string or boost::string_view");
+    return false;
+}
+
+template <typename T, typename M>
+PtrColumn<T> makeColumn(const Table& table, Field* field, M T::* member)
+{
+    typedef std::integral_constant<bool, std::is_arithmetic<M>::value> number;
+    typedef std::integral_constant<bool, std::is_same<M, std::string>::value
+                                      || std::is_same<M, boost::string_view>::value> text;
+
+    PtrColumn<T> column;
+    makeNum<T, M, uint16, 1>(table, field, member, column, number())
+        || makeNum<T, M, uint16, 2>(table, field, member, column, number())
+        || makeNum<T, M, uint32, 3>(table, field, member, column, number())
+        || makeNum<T, M, uint32, 4>(table, field, member, column, number())
+        || makeNum<T, M, ulonglong, 8>(table, field, member, column, number())
+        || makeNum<T, M, int16, 1>(table, field, member, column, number())
+        || makeNum<T, M, int16, 2>(table, field, member, column, number())
+        || makeNum<T, M, int32, 3>(table, field, member, column, number())
+        || makeNum<T, M, int32, 4>(table, field, member, column, number())
+        || makeNum<T, M, longlong, 8>(table, field, member, column, number())
+        || makeNum<T, M, float, 4>(table, field, member, column, number())
+        || makeNum<T, M, double, 8>(table, field, member, column, number())
+        || makeString<T, M, Field_string>(table, field, member, column, text())
+        || makeString<T, M, Field_blob>(table, field, member, column, text());
+
+    if (!column)
+    {
+        if (field->value_type() != typeid(M))
+            mismatch(table, *field, "member of type other than Field::value_type()");
+        const auto json = dynamic_cast<const Field_json*>(field);
+        if (json && json->diffs_type() != typeid(M))
+            mismatch(table, *field, "member, which does not hold partial JSON update (see PartialJsonMode)");
+        column.reset(new AnyColumn<T, M>(field, member));
+    }
+    return column;
+}
+
+template <typename T, typename V, unsigned length>
+bool makeSkipNum(Field* field, PtrColumn<T>& column)
+{
+    if (dynamic_cast<const Field_num<V, length>*>(field))
+        column.reset(new SkipFixedColumn<T, length>());
+    return bool(column);
+}
+
+template <typename T, typename F>
+bool makeSkipString(Field* field, PtrColumn<T>& column)
+{
+    if (const auto str = dynamic_cast<const F*>(field))
+        column.reset(new SkipStringColumn<T, F>(str));
+    return bool(column);
+}
+
+template <typename T>
+PtrColumn<T> makeSkipColumn(Field* field)
+{
+    PtrColumn<T> column;
+    makeSkipNum<T, uint16, 1>(field, column)
+        || makeSkipNum<T, uint16, 2>(field, column)
+        || makeSkipNum<T, uint32, 3>(field, column)
+        || makeSkipNum<T, uint32, 4>(field, column)
+        || makeSkipNum<T, ulonglong, 8>(field, column)
+        || makeSkipNum<T, int16, 1>(field, column)
+        || makeSkipNum<T, int16, 2>(field, column)
+        || makeSkipNum<T, int32, 3>(field, column)
+        || makeSkipNum<T, int32, 4>(field, column)
+        || makeSkipNum<T, longlong, 8>(field, column)
+        || makeSkipNum<T, float, 4>(field, column)
+        || makeSkipNum<T, double, 8>(field, column)
+        || makeSkipString<T, Field_string>(field, column)
+        || makeSkipString<T, Field_blob>(field, column);
+
+    if (!column)
+        column.reset(new SkipColumn<T>(field));
+    return column;
+}
+
+template <typename T>
+class Binder : public RowBinder
+{
+public:
+
+    typedef std::function<void (const BoundRow<T>&)> callback_t;
+
+    Binder(std::vector<PtrColumn<T>>&& columns, const Table& table, const callback_t& callback)
+    :   m_columns(std::move(columns))
+    ,   m_callback(callback)
+    ,   m_full_name(table.full_name)
+    {
+        for (const auto& field : table.fields)
+            m_json.push_back(dynamic_cast<Field_json*>(field.get()));
+    }
+
+    unsigned char* unpack(unsigned colcnt, unsigned char* row, const std::vector<unsigned char>& cols, bool before,
+                          const unsigned char* partial_bits, const std::vector<unsigned char>* cols_bi)
+    {
+        if (colcnt != m_columns.size()) {
+            LOG_ERROR(log, "Field count mismatch in unpacking row for "
+                      << m_full_name << ": " << colcnt << " != " << m_columns.size());
+            throw std::runtime_error("RowBinder::unpack failed");
+        }
+
+        T& out = before ? m_row.old_row : m_row.row;
+
+        unsigned present = 0;
+        for (unsigned i = 0; i < colcnt; i++)
+            if (cols[i / 8] & (1 << (i & 7)))
+                present++;
+
+        // Same layout as in unpack_row()
+        const unsigned char* null_ptr = row;
+        const char* ptr = (const char*)row + (present + 7) / 8;
+        unsigned int null_mask = 1U;
+        unsigned char null_bits = *null_ptr++;
+        unsigned json_index = 0;
+
+        for (unsigned i = 0; i < colcnt; i++)
+        {
+            const Column<T>& column = *m_columns[i];
+
+            Field_json* partial = nullptr;
+            if (partial_bits && m_json[i] && (cols_bi->empty() || (*cols_bi)[i / 8] & (1 << (i & 7)))) {
+                if (partial_bits[json_index / 8] & (1 << (json_index & 7)))
+                    partial = m_json[i];
+                json_index++;
+            }
+
+            if (!(cols[i / 8] & (1 << (i & 7)))) {
+                column.clear(out);
+                continue;
+            }
+
+            if ((null_mask & 0xFF) == 0) {
+                null_mask = 1U;
+                null_bits = *null_ptr++;
+            }
+
+            if (null_bits & null_mask)
+                column.clear(out);
+            else if (partial)
+                ptr = column.unpack_diffs(*partial, ptr, out);
+            else
+                ptr = column.unpack(ptr, out);
+
+            null_mask <<= 1;
+        }
+
+        return (unsigned char*)ptr;
+    }
+
+    void call(RecordSet::TypeEvent type, time_t when, unsigned int master_id)
+    {
+        m_row.type_event = type;
+        m_row.when = when;
+        m_row.master_id = master_id;
+        m_callback(m_row);
+    }
+
+private:
+
+    std::vector<PtrColumn<T>> m_columns;
+    std::vector<Field_json*>  m_json;
+    callback_t                m_callback;
+    BoundRow<T>               m_row;
+    std::string               m_full_name;
+};
+
+}// binding
+
+// Binding of table columns to members of T, e.g.:
+//
+//     struct Order { int64_t id; boost::string_view sku; uint32_t qty; };
+//
+//     slave::RowBinding<Order> binding([](const slave::BoundRow<Order>& r) { ... });
+//     binding.column("id", &Order::id).column("sku", &Order::sku).column("qty", &Order::qty);
+//     slave.setCallback("shop", "orders", binding);
+//
+// Columns are checked against table structure when it is created. Numbers are read into
+// arithmetic members, which hold every value of the column, strings and blobs into std::string
+// or boost::string_view (valid only inside of callback), without FieldValue. Other types are
+// taken from Field::field_data into members of Field::value_type().
+// NULL values and columns absent in the row image give value-initialized members.
+template <typename T>
+class RowBinding : public RowBindingIface
+{
+public:
+
+    typedef std::function<void (const BoundRow<T>&)> callback_t;
+
+    explicit RowBinding(const callback_t& callback) : m_callback(callback) {}
+
+    template <typename M>
+    RowBinding& column(const std::string& name, M T::* member)
+    {
+        m_columns.emplace_back(name, [member](const Table& table, Field* field)
+        {
+            return binding::makeColumn<T, M>(table, field, member);
+        });
+        return *this;
+    }
+
+    std::unique_ptr<RowBinder> bind(const Table& table) const
+    {
+        std::vector<binding::PtrColumn<T>> columns;
+        for (const auto& field : table.fields)
+            columns.push_back(binding::makeSkipColumn<T>(field.get()));
+
+        for (const auto& x : m_columns)
+        {
+            const auto it = table.schema->field_index.find(x.first);
+            if (it == table.schema->field_index.end()) {
+                LOG_ERROR(log, "RowBinding: there is no column " << x.first << " in " << table.full_name);
+                throw std::runtime_error("RowBinding: no column " + table.full_name + "." + x.first);
+            }
+            columns[it->second] = x.second(table, table.fields[it->second].get());
+        }
+
+        return std::unique_ptr<RowBinder>(new binding::Binder<T>(std::move(columns), table, m_callback));
+    }
+
+private:
+
+    typedef std::function<binding::PtrColumn<T> (const Table&, Field*)> factory_t;
+
+    callback_t m_callback;
+    std::vector<std::pair<std::string, factory_t>> m_columns;
+};
+
+}// slave
+
+#endif
@@ -0,0 +1,550 @@
+/* Copyright 2011 ZAO "Begun".
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+#include "schema_cache.h"
+
+#include "Logging.h"
+
+#include <mysql.h>
+
+namespace
+{
+// File layout (host byte order, file is not intended to be moved between hosts):
+// magic, version, tables count, then for every table: db, table, versions count, and
+// for every version: DDL point, fingerprint, columns count, columns, TABLE_MAP types,
+// TABLE_MAP metadata.
+const uint32_t cache_magic   = 0x4353534c; // "LSSC"
+const uint32_t cache_version = 2;
+
+const uint64_t fnv_offset = 14695981039346656037ULL;
+const uint64_t fnv_prime  = 1099511628211ULL;
+
+inline uint64_t fnv1a(uint64_t h, const void* data, size_t len)
+{
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < len; ++i)
+    {
+        h ^= p[i];
+        h *= fnv_prime;
+    }
+    return h;
+}
+
+template <typename T>
+inline uint64_t fnv1a(uint64_t h, const T& value)
+{
+    return fnv1a(h, &value, sizeof(value));
+}
+
+inline uint64_t fnv1a(uint64_t h, const std::string& s)
+{
+    // length goes first, so that ("ab", "c") and ("a", "bc") differ
+    return fnv1a(fnv1a(h, static_cast<uint32_t>(s.size())), s.data(), s.size());
+}
+
+class Writer
+{
+    std::ofstream& m_out;
+
+public:
+    explicit Writer(std::ofstream& out) : m_out(out) {}
+
+    template <typename T>
+    void put(T value) { m_out.write(reinterpret_cast<const char*>(&value), sizeof(value)); }
+
+    void put(const std::string& s)
+    {
+        put(static_cast<uint32_t>(s.size()));
+        m_out.write(s.data(), s.size());
+    }
+
+    void put(const std::vector<unsigned char>& v)
+    {
+        put(static_cast<uint32_t>(v.size()));
+        m_out.write(reinterpret_cast<const char*>(v.data()), v.size());
+    }
+};
+
+class Reader
+{
+    std::ifstream& m_in;
+
+    void check()
+    {
+        if (!m_in)
+            throw std::runtime_error("unexpected end of file");
+    }
+
+public:
+    explicit Reader(std::ifstream& in) : m_in(in) {}
+
+    template <typename T>
+    void get(T& value)
+    {
+        m_in.read(reinterpret_cast<char*>(&value), sizeof(value));
+        check();
+    }
+
+    void get(std::string& s)
+    {
+        uint32_t size;
+        get(size);
+        s.resize(size);
+        m_in.read(&s[0], size);
+        check();
+    }
+
+    void get(std::vector<unsigned char>& v)
+    {
+        uint32_t size;
+        get(size);
+        v.resize(size);
+        m_in.read(reinterpret_cast<char*>(v.data()), size);
+        check();
+    }
+};
+
+// Is point "a" earlier in binlog than point "b". Points from different servers
+// (i.e. after failover in GTID mode) are not comparable, the newer one is appended then.
+bool precedes(const slave::SchemaPoint& a, const slave::SchemaPoint& b)
+{
+    if (a.log_name.empty() || b.log_name.empty())
+        return false;
+    return a.log_name < b.log_name || (a.log_name == b.log_name && a.log_pos < b.log_pos);
+}
+
+// Number of quoted values in ENUM or SET type, '' inside quotes is an escaped quote
+size_t countLabels(const std::string& type)
+{
+    size_t n = 0;
+    bool instr = false;
+    for (size_t i = 0; i < type.size(); ++i)
+    {
+        if (type[i] != '\'')
+            continue;
+        if (!instr)
+        {
+            instr = true;
+            ++n;
+        }
+        else if (i + 1 < type.size() && type[i + 1] == '\'')
+            ++i;
+        else
+            instr = false;
+    }
+    return n;
+}
+
+// see get_blob_type_from_length() @ field.cc, text types are recognized by name
+// because MYSQL_FIELD length of them is multiplied by charset width
+unsigned char blobPackLength(const std::string& type)
+{
+    if (type.compare(0, 4, "tiny") == 0)   return 1;
+    if (type.compare(0, 6, "medium") == 0) return 3;
+    if (type.compare(0, 4, "long") == 0)   return 4;
+    return 2;
+}
+}// anonymous-namespace
+
+namespace slave
+{
+
+uint64_t columnsFingerprint(const columns_t& columns)
+{
+    uint64_t h = fnv1a(fnv_offset, static_cast<uint32_t>(columns.size()));
+    for (const auto& c : columns)
+    {
+        h = fnv1a(h, c.name);
+        h = fnv1a(h, c.type);
+        h = fnv1a(h, c.mysql_type);
+        h = fnv1a(h, static_cast<uint64_t>(c.length));
+        h = fnv1a(h, c.flags);
+        h = fnv1a(h, c.decimals);
+    }
+    return h;
+}
+
+// see save_field_metadata() of Field classes @ field.cc
+void tableMapSignature(const columns_t& columns, bool old_temporal,
+                       std::vector<unsigned char>& types,
+                       std::vector<unsigned char>& metadata)
+{
+    types.clear();
+    metadata.clear();
+
+    for (const auto& c : columns)
+    {
+        unsigned char type = c.mysql_type;
+
+        switch (c.mysql_type) {
+            case MYSQL_TYPE_NEWDECIMAL:
+                // see my_decimal_length_to_precision() @ my_decimal.h
+                metadata.push_back(c.length - (c.decimals ? 1 : 0) - (c.flags & UNSIGNED_FLAG || !c.length ? 0 : 1));
+                metadata.push_back(c.decimals);
+                break;
+
+            case MYSQL_TYPE_FLOAT:
+                metadata.push_back(4);
+                break;
+
+            case MYSQL_TYPE_DOUBLE:
+                metadata.push_back(8);
+                break;
+
+            case MYSQL_TYPE_TIMESTAMP:
+            case MYSQL_TYPE_TIMESTAMP2:
+            case MYSQL_TYPE_DATETIME:
+            case MYSQL_TYPE_DATETIME2:
+            case MYSQL_TYPE_TIME:
+            case MYSQL_TYPE_TIME2:
+                if (c.mysql_type == MYSQL_TYPE_TIMESTAMP || c.mysql_type == MYSQL_TYPE_TIMESTAMP2)
+                    type = old_temporal ? MYSQL_TYPE_TIMESTAMP : MYSQL_TYPE_TIMESTAMP2;
+                else if (c.mysql_type == MYSQL_TYPE_DATETIME || c.mysql_type == MYSQL_TYPE_DATETIME2)
+                    type = old_temporal ? MYSQL_TYPE_DATETIME : MYSQL_TYPE_DATETIME2;
+                else
+                    type = old_temporal ? MYSQL_TYPE_TIME : MYSQL_TYPE_TIME2;
+                if (!old_temporal)
+                    metadata.push_back(c.decimals);
+                break;
+
+            case MYSQL_TYPE_NEWDATE:
+                type = MYSQL_TYPE_DATE;
+                break;
+
+            case MYSQL_TYPE_VARCHAR:
+            case MYSQL_TYPE_VAR_STRING:
+                type = MYSQL_TYPE_VARCHAR;
+                metadata.push_back(c.length & 0xFF);
+                metadata.push_back((c.length >> 8) & 0xFF);
+                break;
+
+            case MYSQL_TYPE_STRING:
+                if (c.flags & ENUM_FLAG)
+                {
+                    metadata.push_back(MYSQL_TYPE_ENUM);
+                    metadata.push_back(countLabels(c.type) < 256 ? 1 : 2);
+                }
+                else if (c.flags & SET_FLAG)
+                {
+                    const size_t bytes = (countLabels(c.type) + 7) / 8;
+                    metadata.push_back(MYSQL_TYPE_SET);
+                    metadata.push_back(bytes > 4 ? 8 : bytes);
+                }
+                else
+                {
+                    metadata.push_back(MYSQL_TYPE_STRING ^ ((c.length & 0x300) >> 4));
+                    metadata.push_back(c.length & 0xFF);
+                }
+                break;
+
+            case MYSQL_TYPE_BIT:
+                metadata.push_back(c.length % 8);
+                metadata.push_back(c.length / 8);
+                break;
+
+            case MYSQL_TYPE_TINY_BLOB:
+            case MYSQL_TYPE_MEDIUM_BLOB:
+            case MYSQL_TYPE_LONG_BLOB:
+            case MYSQL_TYPE_BLOB:
+                type = MYSQL_TYPE_BLOB;
+                metadata.push_back(blobPackLength(c.type));
+                break;
+
+            case MYSQL_TYPE_JSON:
+            case MYSQL_TYPE_GEOMETRY:
+                metadata.push_back(4);
+                break;
+
+            default:
+                break;
+        }
+
+        types.push_back(type);
+    }
+}
+
+bool SchemaPoint::reachedBy(const Position& pos) const
+{
+    if (empty())
+        return true;
+
+    if (!gtid.first.empty() && !pos.gtid_executed.empty())
+        return pos.hasGtid(gtid);
+
+    if (log_name.empty() || pos.log_name.empty())
+        return false;
+
+    return pos.log_name > log_name || (pos.log_name == log_name && pos.log_pos >= log_pos);
+}
+
+bool SchemaCache::load()
+{
+    m_entries.clear();
+    m_dirty = false;
+
+    std::ifstream in(m_path.c_str(), std::ios::binary);
+    if (!in)
+    {
+        LOG_INFO(log, "Schema cache '" << m_path << "' does not exist yet");
+        return false;
+    }
+
+    try
+    {
+        Reader r(in);
+
+        uint32_t magic, version, count;
+        r.get(magic);
+        r.get(version);
+        if (magic != cache_magic || version != cache_version)
+            throw std::runtime_error("unknown format");
+
+        r.get(count);
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            key_t key;
+            r.get(key.first);
+            r.get(key.second);
+
+            uint32_t versions;
+            r.get(versions);
+
+            history_t& history = m_entries[key];
+            history.resize(versions);
+            for (auto& entry : history)
+            {
+                uint64_t log_pos;
+                r.get(entry.since.log_name);
+                r.get(log_pos);
+                r.get(entry.since.gtid.first);
+                r.get(entry.since.gtid.second);
+                entry.since.log_pos = log_pos;
+
+                r.get(entry.fingerprint);
+
+                uint32_t columns;
+                r.get(columns);
+                entry.columns.resize(columns);
+                for (auto& c : entry.columns)
+                {
+                    r.get(c.name);
+                    r.get(c.type);
+                    r.get(c.mysql_type);
+                    r.get(log_pos);
+                    r.get(c.flags);
+                    r.get(c.decimals);
+                    c.length = log_pos;
+                }
+                r.get(entry.map_types);
+                r.get(entry.map_metadata);
+
+                if (entry.fingerprint != columnsFingerprint(entry.columns))
+                    throw std::runtime_error("fingerprint mismatch for " + key.first + "." + key.second);
+            }
+        }
+    }
+    catch (const std::exception& e)
+    {
+        LOG_WARNING(log, "Ignoring schema cache '" << m_path << "': " << e.what());
+        m_entries.clear();
+        return false;
+    }
+
+    LOG_INFO(log, "Loaded schema cache '" << m_path << "': " << m_entries.size() << " tables");
+    return true;
+}
+
+void SchemaCache::save()
+{
+    const std::string tmp = m_path + ".tmp";
+    {
+        std::ofstream out(tmp.c_str(), std::ios::binary | std::ios::trunc);
+        Writer w(out);
+
+        w.put(cache_magic);
+        w.put(cache_version);
+        w.put(static_cast<uint32_t>(m_entries.size()));
+        for (const auto& x : m_entries)
+        {
+            w.put(x.first.first);
+            w.put(x.first.second);
+            w.put(static_cast<uint32_t>(x.second.size()));
+            for (const auto& entry : x.second)
+            {
+                w.put(entry.since.log_name);
+                w.put(static_cast<uint64_t>(entry.since.log_pos));
+                w.put(entry.since.gtid.first);
+                w.put(entry.since.gtid.second);
+                w.put(entry.fingerprint);
+                w.put(static_cast<uint32_t>(entry.columns.size()));
+                for (const auto& c : entry.columns)
+                {
+                    w.put(c.name);
+                    w.put(c.type);
+                    w.put(c.mysql_type);
+                    w.put(static_cast<uint64_t>(c.length));
+                    w.put(c.flags);
+                    w.put(c.decimals);
+                }
+                w.put(entry.map_types);
+                w.put(entry.map_metadata);
+            }
+        }
+
+        out.flush();
+        if (!out)
+        {
+            LOG_ERROR(log, "Failed to write schema cache '" << tmp << "'");
+            std::remove(tmp.c_str());
+            return;
+        }
+    }
+
+    if (0 != std::rename(tmp.c_str(), m_path.c_str()))
+    {
+        LOG_ERROR(log, "Failed to rename '" << tmp << "' to '" << m_path << "': " << errno);
+        std::remove(tmp.c_str());
+        return;
+    }
+
+    m_dirty = false;
+}
+
+const SchemaCache::Entry* SchemaCache::find(const key_t& key, const Position& pos) const
+{
+    const auto it = m_entries.find(key);
+    if (it == m_entries.end() || it->second.empty())
+        return nullptr;
+
+    const history_t& history = it->second;
+    if (pos.empty())
+        return &history.back();
+
+    for (auto i = history.rbegin(); i != history.rend(); ++i)
+        if (i->since.reachedBy(pos))
+            return &*i;
+
+    return nullptr;
+}
+
+const SchemaCache::Entry* SchemaCache::find(const key_t& key, const SchemaPoint& point) const
+{
+    const auto it = m_entries.find(key);
+    if (it == m_entries.end())
+        return nullptr;
+
+    for (const auto& entry : it->second)
+        if (entry.since == point)
+            return &entry;
+
+    return nullptr;
+}
+
+void SchemaCache::put(const key_t& key, const columns_t& columns, const SchemaPoint& since)
+{
+    const uint64_t fingerprint = columnsFingerprint(columns);
+
+    history_t& history = m_entries[key];
+    for (auto& entry : history)
+    {
+        if (!(entry.since == since))
+            continue;
+
+        if (entry.fingerprint == fingerprint)
+            return;
+
+        entry.fingerprint = fingerprint;
+        entry.columns = columns;
+        entry.map_types.clear();
+        entry.map_metadata.clear();
+        m_dirty = true;
+        return;
+    }
+
+    auto it = history.end();
+    if (since.empty())
+        it = history.begin();
+    else
+        while (it != history.begin() && precedes(since, std::prev(it)->since))
+            --it;
+
+    Entry entry;
+    entry.since = since;
+    entry.fingerprint = fingerprint;
+    entry.columns = columns;
+    history.insert(it, std::move(entry));
+    m_dirty = true;
+}
+
+void SchemaCache::prune(const Position& pos)
+{
+    if (pos.empty())
+        return;
+
+    for (auto& x : m_entries)
+    {
+        history_t& history = x.second;
+        for (size_t i = history.size(); i > 1; --i)
+        {
+            if (history[i - 1].since.reachedBy(pos))
+            {
+                history.erase(history.begin(), history.begin() + (i - 1));
+                m_dirty = true;
+                break;
+            }
+        }
+    }
+}
+
+bool SchemaCache::checkSignature(const key_t& key, uint64_t fingerprint, bool old_temporal,
+                                 const std::vector<unsigned char>& types,
+                                 const std::vector<unsigned char>& metadata)
+{
+    const auto it = m_entries.find(key);
+    if (it == m_entries.end())
+        return true;
+
+    for (auto entry = it->second.rbegin(); entry != it->second.rend(); ++entry)
+    {
+        if (entry->fingerprint != fingerprint)
+            continue;
+
+        if (entry->map_types == types && entry->map_metadata == metadata)
+            return true;
+
+        bool same = false;
+        if (entry->map_types.empty())
+        {
+            std::vector<unsigned char> expected_types, expected_metadata;
+            tableMapSignature(entry->columns, old_temporal, expected_types, expected_metadata);
+            same = expected_types == types && expected_metadata == metadata;
+        }
+
+        entry->map_types = types;
+        entry->map_metadata = metadata;
+        m_dirty = true;
+        return same;
+    }
+
+    return true;
+}
+
+}// slave
@@ -0,0 +1,149 @@
+/* Copyright 2011 ZAO "Begun".
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __SLAVE_SCHEMA_CACHE_H_
+#define __SLAVE_SCHEMA_CACHE_H_
+
+#include <inttypes.h>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "binlog_pos.h"
+
+namespace slave
+{
+
+// Description of one column as read from master: the row of SHOW FULL COLUMNS
+// plus MYSQL_FIELD attributes. It is everything createTable() needs to build a Field.
+struct ColumnInfo
+{
+    std::string   name;
+    std::string   type;
+    unsigned      mysql_type = 0;
+    unsigned long length     = 0;
+    unsigned      flags      = 0;
+    unsigned      decimals   = 0;
+
+    bool operator== (const ColumnInfo& other) const
+    {
+        return name == other.name && type == other.type && mysql_type == other.mysql_type
+            && length == other.length && flags == other.flags && decimals == other.decimals;
+    }
+};
+
+typedef std::vector<ColumnInfo> columns_t;
+
+// Hash of table structure, changes when any column is added, removed or altered.
+uint64_t columnsFingerprint(const columns_t& columns);
+
+// Column types and metadata, which master writes to TABLE_MAP event for such columns.
+// Temporal columns are in pre-5.6.4 format if old_temporal is set.
+void tableMapSignature(const columns_t& columns, bool old_temporal,
+                       std::vector<unsigned char>& types,
+                       std::vector<unsigned char>& metadata);
+
+// Binlog point of DDL which changed table structure: end position of the QUERY event
+// and GTID of its transaction (if any). Empty point means structure, which was read
+// without knowing its DDL, it is used for any position.
+struct SchemaPoint
+{
+    std::string   log_name;
+    unsigned long log_pos = 0;
+    gtid_t        gtid;
+
+    SchemaPoint() {}
+
+    SchemaPoint(const std::string& _log_name, unsigned long _log_pos, const gtid_t& _gtid)
+    :   log_name(_log_name), log_pos(_log_pos), gtid(_gtid)
+    {}
+
+    bool empty() const { return log_name.empty() && gtid.first.empty(); }
+
+    // Is DDL at this point already executed at given position
+    bool reachedBy(const Position& pos) const;
+
+    bool operator== (const SchemaPoint& other) const
+    {
+        return log_name == other.log_name && log_pos == other.log_pos && gtid == other.gtid;
+    }
+};
+
+// On-disk history of table structures. It allows to skip metadata queries on restart
+// and to decode events written before later ALTERs when catching up from old position.
+// Cached entries are trusted until the first TABLE_MAP event of the table: column types
+// and metadata from it are compared against ones remembered from the previous run, or
+// against ones expected from cached columns.
+class SchemaCache
+{
+public:
+
+    typedef std::pair<std::string, std::string> key_t;
+
+    // One version of the table structure
+    struct Entry
+    {
+        SchemaPoint                since;
+        uint64_t                   fingerprint = 0;
+        columns_t                  columns;
+        // Column types and metadata of the last checked TABLE_MAP event, empty if not seen yet.
+        std::vector<unsigned char> map_types;
+        std::vector<unsigned char> map_metadata;
+    };
+
+    // Versions of one table in binlog order
+    typedef std::vector<Entry> history_t;
+    typedef std::map<key_t, history_t> entries_t;
+
+    explicit SchemaCache(const std::string& path) : m_path(path) {}
+
+    // Reads cache file. Returns false if file is absent or broken, cache is empty then.
+    bool load();
+    // Writes cache file atomically (via temporary file and rename).
+    void save();
+
+    // Returns version of the table structure, which is actual at given position,
+    // or the latest one if position is empty.
+    const Entry* find(const key_t& key, const Position& pos) const;
+    // Returns version, created by DDL at given point.
+    const Entry* find(const key_t& key, const SchemaPoint& point) const;
+
+    // Stores table structure created by DDL at given point. Remembered TABLE_MAP signature
+    // is dropped if structure at this point is changed.
+    void put(const key_t& key, const columns_t& columns, const SchemaPoint& since);
+
+    // Forgets versions, which can not be used when reading binlog starting from given position.
+    void prune(const Position& pos);
+
+    // Compares TABLE_MAP signature with the remembered one for the version with given
+    // fingerprint, or with the one expected from its columns if nothing is remembered yet,
+    // and remembers the new one. Returns false on mismatch, true only if it matches or
+    // the version is not in cache.
+    bool checkSignature(const key_t& key, uint64_t fingerprint, bool old_temporal,
+                        const std::vector<unsigned char>& types,
+                        const std::vector<unsigned char>& metadata);
+
+    bool dirty() const { return m_dirty; }
+    const std::string& path() const { return m_path; }
+
+private:
+
+    const std::string m_path;
+    entries_t         m_entries;
+    bool              m_dirty = false;
+};
+
+}// slave
+
+#endif
@@ -0,0 +1,50 @@
+/* Copyright 2011 ZAO "Begun".
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "schema_pool.h"
+
+using namespace slave;
+
+PtrColumns SchemaPool::intern(uint64_t fingerprint, const columns_t& columns)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    const auto range = m_columns.equal_range(fingerprint);
+    for (auto it = range.first; it != range.second; )
+    {
+        if (PtrColumns existing = it->second.lock())
+        {
+            if (*existing == columns)
+                return existing;
+            ++it;
+        }
+        else
+            it = m_columns.erase(it);
+    }
+
+    PtrColumns result = std::make_shared<const columns_t>(columns);
+    m_columns.emplace(fingerprint, result);
+    return result;
+}
+
+size_t SchemaPool::size() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    size_t result = 0;
+    for (const auto& x : m_columns)
+        result += !x.second.expired();
+    return result;
+}
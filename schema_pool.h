@@ -0,0 +1,51 @@
+/* Copyright 2011 ZAO "Begun".
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef __SLAVE_SCHEMA_POOL_H_
+#define __SLAVE_SCHEMA_POOL_H_
+
+#include <inttypes.h>
+#include <map>
+#include <memory>
+#include <mutex>
+
+#include "schema_cache.h"
+
+namespace slave
+{
+
+typedef std::shared_ptr<const columns_t> PtrColumns;
+
+// Column definitions shared between slaves, e.g. of SlaveGroup following masters with
+// identical schemas. Fields are not shared: they hold the value of the row being decoded.
+class SchemaPool
+{
+public:
+
+    // Returns definitions equal to columns, which are already used by another table, or a new copy
+    PtrColumns intern(uint64_t fingerprint, const columns_t& columns);
+
+    // Number of definitions in use
+    size_t size() const;
+
+private:
+
+    mutable std::mutex m_mutex;
+    std::multimap<uint64_t, std::weak_ptr<const columns_t>> m_columns;
+};
+
+}// slave
+
+#endif
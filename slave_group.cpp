@@ -0,0 +1,315 @@
+/* Copyright 2011 ZAO "Begun".
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "slave_group.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <stdexcept>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "Logging.h"
+#include "MysqlGuard.h"
+
+using namespace slave;
+
+SlaveGroup::Entry::Entry(Slave& s)
+    : slave(&s)
+    , backoff(std::chrono::milliseconds(s.masterInfo().reconnect_initial_ms),
+              std::chrono::seconds(s.masterInfo().connect_retry))
+{}
+
+SlaveGroup::SlaveGroup(size_t reactors, size_t workers)
+    : m_reactor_count(std::max<size_t>(reactors, 1))
+    , m_worker_count(std::max<size_t>(workers, 1))
+    , m_schema_pool(std::make_shared<SchemaPool>())
+{
+    for (size_t i = 0; i < m_reactor_count; ++i)
+    {
+        std::unique_ptr<Reactor> reactor(new Reactor);
+        reactor->epoll_fd = ::epoll_create1(EPOLL_CLOEXEC);
+        reactor->wake_fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+        epoll_event ev = {};
+        ev.events = EPOLLIN;
+        ev.data.ptr = nullptr;
+        if (reactor->epoll_fd < 0 || reactor->wake_fd < 0
+            || ::epoll_ctl(reactor->epoll_fd, EPOLL_CTL_ADD, reactor->wake_fd, &ev) != 0)
+        {
+            if (reactor->epoll_fd >= 0)
+                ::close(reactor->epoll_fd);
+            if (reactor->wake_fd >= 0)
+                ::close(reactor->wake_fd);
+            for (const auto& r : m_reactors)
+            {
+                ::close(r->epoll_fd);
+                ::close(r->wake_fd);
+            }
+            throw std::runtime_error("SlaveGroup: can't create epoll");
+        }
+        m_reactors.push_back(std::move(reactor));
+    }
+}
+
+SlaveGroup::~SlaveGroup()
+{
+    stop();
+    for (const auto& reactor : m_reactors)
+    {
+        ::close(reactor->epoll_fd);
+        ::close(reactor->wake_fd);
+    }
+}
+
+void SlaveGroup::add(Slave& slave)
+{
+    if (m_started)
+        throw std::runtime_error("SlaveGroup::add(): group is already started");
+
+    std::unique_ptr<Entry> entry(new Entry(slave));
+    entry->reactor = m_reactors[m_entries.size() % m_reactors.size()].get();
+    entry->reactor->entries.push_back(entry.get());
+    slave.setSchemaPool(m_schema_pool);
+    m_entries.push_back(std::move(entry));
+}
+
+void SlaveGroup::start()
+{
+    if (m_started)
+        return;
+    m_started = true;
+    m_stop = false;
+
+    for (const auto& reactor : m_reactors)
+        reactor->thread = std::thread([this, &reactor]() { reactorLoop(*reactor); });
+    for (size_t i = 0; i < m_worker_count; ++i)
+        m_workers.emplace_back([this]() { workerLoop(); });
+
+    for (const auto& entry : m_entries)
+    {
+        Entry* const e = entry.get();
+        post([this, e]() { open(*e); });
+    }
+}
+
+void SlaveGroup::stop()
+{
+    if (!m_started)
+        return;
+    m_started = false;
+
+    {
+        std::lock_guard<std::mutex> lock(m_tasks_mutex);
+        m_stop = true;
+    }
+    m_tasks_cond.notify_all();
+
+    for (const auto& reactor : m_reactors)
+    {
+        wake(*reactor);
+        reactor->thread.join();
+        reactor->retries.clear();
+    }
+    for (auto& worker : m_workers)
+        worker.join();
+    m_workers.clear();
+    m_tasks.clear();
+
+    for (const auto& entry : m_entries)
+    {
+        if (entry->open)
+        {
+            entry->slave->close_remote_binlog();
+            entry->open = false;
+        }
+        entry->armed = false;
+        entry->backoff.reset();
+    }
+    m_connected = 0;
+}
+
+void SlaveGroup::reactorLoop(Reactor& reactor)
+{
+    const int max_events = 64;
+    epoll_event events[max_events];
+    // Period of checks for silent masters
+    const int check_timeout = 1000;
+
+    while (!m_stop)
+    {
+        int timeout = reactor.entries.empty() ? -1 : check_timeout;
+        {
+            std::lock_guard<std::mutex> lock(reactor.mutex);
+            if (!reactor.retries.empty())
+            {
+                const auto wait = reactor.retries.begin()->first - clock::now();
+                const int due = std::max<int>(0, std::chrono::duration_cast<std::chrono::milliseconds>(wait).count() + 1);
+                timeout = timeout < 0 ? due : std::min(timeout, due);
+            }
+        }
+
+        const int n = ::epoll_wait(reactor.epoll_fd, events, max_events, timeout);
+        if (n < 0 && errno != EINTR)
+        {
+            LOG_ERROR(log, "SlaveGroup: epoll_wait() failed: " << errno);
+            break;
+        }
+
+        for (int i = 0; i < n; ++i)
+        {
+            if (events[i].data.ptr == nullptr)
+            {
+                uint64_t value;
+                while (::read(reactor.wake_fd, &value, sizeof(value)) > 0) {}
+                continue;
+            }
+            Entry* const entry = static_cast<Entry*>(events[i].data.ptr);
+            if (entry->armed.exchange(false))
+                post([this, entry]() { pump(*entry); });
+        }
+
+        // pump() of a silent master closes its binlog
+        for (Entry* entry : reactor.entries)
+        {
+            if (entry->armed && entry->slave->stalled() && entry->armed.exchange(false))
+                post([this, entry]() { pump(*entry); });
+        }
+
+        std::vector<Entry*> due;
+        {
+            std::lock_guard<std::mutex> lock(reactor.mutex);
+            const auto now = clock::now();
+            while (!reactor.retries.empty() && reactor.retries.begin()->first <= now)
+            {
+                due.push_back(reactor.retries.begin()->second);
+                reactor.retries.erase(reactor.retries.begin());
+            }
+        }
+        for (Entry* entry : due)
+            post([this, entry]() { open(*entry); });
+    }
+}
+
+void SlaveGroup::workerLoop()
+{
+    mysql_guard::MysqlGuard::init();
+
+    std::unique_lock<std::mutex> lock(m_tasks_mutex);
+    for (;;)
+    {
+        m_tasks_cond.wait(lock, [this]() { return m_stop || !m_tasks.empty(); });
+        // Not started tasks are dropped, binlogs are closed by stop()
+        if (m_stop)
+            return;
+
+        const std::function<void ()> task = std::move(m_tasks.front());
+        m_tasks.pop_front();
+        lock.unlock();
+        task();
+        lock.lock();
+    }
+}
+
+void SlaveGroup::post(std::function<void ()> task)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_tasks_mutex);
+        m_tasks.push_back(std::move(task));
+    }
+    m_tasks_cond.notify_one();
+}
+
+void SlaveGroup::wake(Reactor& reactor)
+{
+    const uint64_t value = 1;
+    if (::write(reactor.wake_fd, &value, sizeof(value)) < 0)
+        LOG_ERROR(log, "SlaveGroup: write to eventfd failed: " << errno);
+}
+
+void SlaveGroup::open(Entry& entry)
+{
+    try
+    {
+        entry.slave->open_remote_binlog();
+    }
+    catch (const std::exception& e)
+    {
+        LOG_ERROR(log, "SlaveGroup: can't open binlog: " << e.what());
+        retry(entry);
+        return;
+    }
+
+    entry.open = true;
+    ++m_connected;
+    arm(entry, EPOLL_CTL_ADD);
+}
+
+void SlaveGroup::pump(Entry& entry)
+{
+    size_t handled = 0;
+    try
+    {
+        handled = entry.slave->pump(m_budget);
+    }
+    catch (const std::exception& e)
+    {
+        // Binlog is closed by Slave, its socket is removed from epoll on close
+        LOG_WARNING(log, "SlaveGroup: " << e.what());
+        entry.open = false;
+        --m_connected;
+        retry(entry);
+        return;
+    }
+
+    // Not on the fake rotate or a heartbeat: master may drop each dump right after them, see Slave::lost()
+    if (!entry.slave->lost())
+        entry.backoff.reset();
+
+    // More events may be buffered, other slaves are handled first
+    if (handled == m_budget)
+        post([this, &entry]() { pump(entry); });
+    else
+        arm(entry, EPOLL_CTL_MOD);
+}
+
+void SlaveGroup::arm(Entry& entry, int op)
+{
+    // One shot: the socket is not reported again until its events are handled
+    epoll_event ev = {};
+    ev.events = EPOLLIN | EPOLLONESHOT;
+    ev.data.ptr = &entry;
+    entry.armed = true;
+    if (::epoll_ctl(entry.reactor->epoll_fd, op, entry.slave->binlog_fd(), &ev) != 0)
+    {
+        LOG_ERROR(log, "SlaveGroup: epoll_ctl() failed: " << errno);
+        entry.armed = false;
+        entry.slave->close_remote_binlog();
+        entry.open = false;
+        --m_connected;
+        retry(entry);
+    }
+}
+
+void SlaveGroup::retry(Entry& entry)
+{
+    const auto at = clock::now() + entry.backoff.next();
+    {
+        std::lock_guard<std::mutex> lock(entry.reactor->mutex);
+        entry.reactor->retries.emplace(at, &entry);
+    }
+    wake(*entry.reactor);
+}
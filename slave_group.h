@@ -0,0 +1,132 @@
+/* Copyright 2011 ZAO "Begun".
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef __SLAVE_SLAVE_GROUP_H_
+#define __SLAVE_SLAVE_GROUP_H_
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Slave.h"
+#include "backoff.h"
+#include "schema_pool.h"
+
+namespace slave
+{
+
+// Many masters followed by a few threads instead of a thread per Slave. Reactor threads wait
+// for binlog sockets (see Slave::open_remote_binlog) with epoll, events are decoded and
+// callbacks are called on the worker pool. Events of one Slave are handled by one worker at
+// a time, in order. Every Slave keeps its own position, ExtStateIface and stats, column
+// definitions are shared through SchemaPool.
+//
+// Connecting blocks a worker. After a lost connection the Slave is reopened by a worker at
+// once, then with growing delays up to MasterInfo::connect_retry seconds (see Backoff).
+// Reactors check for silent masters every second (see Slave::stalled).
+class SlaveGroup
+{
+public:
+
+    SlaveGroup(size_t reactors, size_t workers);
+    ~SlaveGroup();
+
+    SlaveGroup(const SlaveGroup&) = delete;
+    SlaveGroup& operator= (const SlaveGroup&) = delete;
+
+    // Slave must outlive the group. Call before its createDatabaseStructure, so that its
+    // structure uses the shared pool, and before start().
+    void add(Slave& slave);
+
+    // Number of events a worker handles for one Slave before it lets other slaves go
+    void setBudget(size_t budget) { m_budget = budget; }
+
+    // Opens binlogs of all slaves on the workers and starts reactors
+    void start();
+    // Waits for the running handlers and closes binlogs. Called by destructor.
+    void stop();
+
+    size_t size() const { return m_entries.size(); }
+    // Slaves with open binlog
+    size_t connected() const { return m_connected; }
+    const std::shared_ptr<SchemaPool>& schemaPool() const { return m_schema_pool; }
+
+private:
+
+    typedef std::chrono::steady_clock clock;
+
+    struct Reactor;
+
+    struct Entry
+    {
+        explicit Entry(Slave& s);
+
+        Slave*            slave;
+        Reactor*          reactor = nullptr;
+        bool              open = false;
+        // Socket is waited for by the reactor, nobody else handles the Slave
+        std::atomic<bool> armed {false};
+        Backoff           backoff;
+    };
+
+    struct Reactor
+    {
+        int               epoll_fd = -1;
+        int               wake_fd = -1;
+        std::thread       thread;
+        std::vector<Entry*> entries;
+        std::mutex        mutex;
+        // Slaves to be reopened, by time
+        std::multimap<clock::time_point, Entry*> retries;
+    };
+
+    void reactorLoop(Reactor& reactor);
+    void workerLoop();
+    void post(std::function<void ()> task);
+    void wake(Reactor& reactor);
+
+    // Tasks of workers
+    void open(Entry& entry);
+    void pump(Entry& entry);
+    void arm(Entry& entry, int op);
+    void retry(Entry& entry);
+
+    const size_t m_reactor_count;
+    const size_t m_worker_count;
+    size_t m_budget = 100;
+
+    std::shared_ptr<SchemaPool> m_schema_pool;
+    std::vector<std::unique_ptr<Entry>> m_entries;
+    std::vector<std::unique_ptr<Reactor>> m_reactors;
+    std::atomic<size_t> m_connected {0};
+    std::atomic<bool> m_stop {false};
+    bool m_started = false;
+
+    std::vector<std::thread> m_workers;
+    std::mutex m_tasks_mutex;
+    std::condition_variable m_tasks_cond;
+    std::deque<std::function<void ()>> m_tasks;
+};
+
+}// slave
+
+#endif
@@ -24,8 +24,8 @@
 
 #include <mysql.h>
 
-#include <zlib.h>
 
+#include "checksum.h"
 #include "relayloginfo.h"
 #include "slave_log_event.h"
 
@@ -152,6 +152,7 @@ Row_event_info::Row_event_info(const char* buf, const unsigned int event_len, co
     }
 
     has_after_image = is_update;
+    has_value_options = (slave::Log_event_type)buf[EVENT_TYPE_OFFSET] == PARTIAL_UPDATE_ROWS_EVENT;
     unsigned char* p_header = (unsigned char*)buf + LOG_EVENT_HEADER_LEN;
 
     p_header += ROWS_MAPID_OFFSET;
@@ -260,17 +261,13 @@ inline void check_format_description(const char* buf, unsigned int event_len, bo
         check_format_description_postlen(event_lens, UPDATE_ROWS_EVENT, ROWS_HEADER_LEN);
         check_format_description_postlen(event_lens, DELETE_ROWS_EVENT, ROWS_HEADER_LEN);
     }
+    if (number_of_event_types >= PARTIAL_UPDATE_ROWS_EVENT)
+        check_format_description_postlen(event_lens, PARTIAL_UPDATE_ROWS_EVENT, ROWS_HEADER_LEN);
 
 }
 
 
-inline uint32_t checksum_crc32(uint32_t crc, const unsigned char* pos, size_t length)
-{
-    return static_cast<uint32_t>(::crc32(static_cast<unsigned int>(crc), pos, static_cast<unsigned int>(length)));
-}
-
-
-bool read_log_event(const char* buf, uint event_len, Basic_event_info& bei, EventStatIface* event_stat, bool master_ge_56, MasterInfo& master_info)
+bool read_log_event(const char* buf, uint event_len, Basic_event_info& bei, EventStatIface* event_stat, bool master_ge_56, MasterInfo& master_info, bool checksummed, bool verify)
 
 {
 
@@ -294,19 +291,22 @@ bool read_log_event(const char* buf, uint event_len, Basic_event_info& bei, Even
             master_info.checksum_alg = alg;
     }
 
-    if (master_info.checksumEnabled())
+    if (checksummed && master_info.checksumEnabled())
     {
-        uint32_t incoming;
-        ::memcpy(&incoming, buf + event_len - BINLOG_CHECKSUM_LEN, sizeof(incoming));
-        incoming = le32toh(incoming);
+        if (verify || bei.type == FORMAT_DESCRIPTION_EVENT)
+        {
+            uint32_t incoming;
+            ::memcpy(&incoming, buf + event_len - BINLOG_CHECKSUM_LEN, sizeof(incoming));
+            incoming = le32toh(incoming);
 
-        uint32_t computed = checksum_crc32(0L, nullptr, 0);
-        computed = checksum_crc32(computed, (const unsigned char*)buf, event_len - BINLOG_CHECKSUM_LEN);
+            uint32_t computed = slave::crc32(0L, nullptr, 0);
+            computed = slave::crc32(computed, (const unsigned char*)buf, event_len - BINLOG_CHECKSUM_LEN);
 
-        if (incoming != computed)
-        {
-            LOG_ERROR(log, "CRC32 check failed: incoming (" << incoming << ") != computed (" << computed << ")");
-            throw std::runtime_error("slave::read_log_event failed");
+            if (incoming != computed)
+            {
+                LOG_ERROR(log, "CRC32 check failed: incoming (" << incoming << ") != computed (" << computed << ")");
+                throw std::runtime_error("slave::read_log_event failed");
+            }
         }
         bei.event_len -= BINLOG_CHECKSUM_LEN;
     }
@@ -347,6 +347,7 @@ bool read_log_event(const char* buf, uint event_len, Basic_event_info& bei, Even
     case WRITE_ROWS_EVENT:
     case UPDATE_ROWS_EVENT:
     case DELETE_ROWS_EVENT:
+    case PARTIAL_UPDATE_ROWS_EVENT:
         // event_stat->tickModify is called from other place.
         return true;
     case TABLE_MAP_EVENT:
@@ -355,6 +356,9 @@ bool read_log_event(const char* buf, uint event_len, Basic_event_info& bei, Even
         break;
     case GTID_LOG_EVENT:
         return true;
+    case TRANSACTION_PAYLOAD_EVENT:
+        // event_stat->tickTransactionPayload is called from other place.
+        return true;
     case LOAD_EVENT:
     case NEW_LOAD_EVENT:
     case SLAVE_EVENT: /* can never happen (unused event) */
@@ -457,12 +461,15 @@ void reserve_row<slave::RowVector>(const slave::Table& table, slave::RowVector&
         row.resize(table.column_filter_count);
 }
 
+// partial_bits mark JSON columns of before image (cols_bi), which are given as diffs in after image
 template <typename T>
 unsigned char* unpack_row(const slave::Table& table,
                           T& _row,
                           unsigned int colcnt,
                           unsigned char* row,
-                          const std::vector<unsigned char>& cols)
+                          const std::vector<unsigned char>& cols,
+                          const unsigned char* partial_bits = nullptr,
+                          const std::vector<unsigned char>* cols_bi = nullptr)
 {
 
     LOG_TRACE(log, "Unpacking row: " << "fields in the table " << table.fields.size() << ", fields in the event " << colcnt
@@ -488,10 +495,24 @@ unsigned char* unpack_row(const slave::Table& table,
 
     reserve_row<T>(table, _row);
 
+    unsigned json_index = 0;
+    const std::vector<unsigned>& json_columns = table.schema->json_columns;
+    auto json = json_columns.begin();
+
     for (unsigned i = 0; i < colcnt; i++)
     {
         const auto& field = table.fields[i];
 
+        Field_json* partial = nullptr;
+        if (partial_bits && json != json_columns.end() && *json == i) {
+            ++json;
+            if (cols_bi->empty() || (*cols_bi)[i / 8] & (1 << (i & 7))) {
+                if (partial_bits[json_index / 8] & (1 << (json_index & 7)))
+                    partial = static_cast<Field_json*>(field.get());
+                json_index++;
+            }
+        }
+
         if (!cols.empty() && !(cols[i / 8] & (1 << (i & 7)))) {
 
             LOG_TRACE(log, "field " << field->getFieldName() << " is not in column list.");
@@ -518,7 +539,10 @@ unsigned char* unpack_row(const slave::Table& table,
         else
         {
             // We unpack the field to some certain value if it was NOT NULL
-            ptr = (unsigned char*)field->unpack((const char*)ptr);
+            if (partial)
+                ptr = (unsigned char*)partial->unpack_diffs((const char*)ptr);
+            else
+                ptr = (unsigned char*)field->unpack((const char*)ptr);
             fill_row<T>(table, _row, i, field->field_data);
         }
 
@@ -538,6 +562,14 @@ unsigned char* do_writedelete_row(const slave::Table& table,
                                   unsigned char* row_start,
                                   ExtStateIface &ext_state) {
 
+    const auto type_event = (bei.type == WRITE_ROWS_EVENT_V1 || bei.type == WRITE_ROWS_EVENT ? slave::RecordSet::Write : slave::RecordSet::Delete);
+
+    if (table.m_binder) {
+        unsigned char* t = table.m_binder->unpack(roi.m_width, row_start, roi.m_cols, false);
+        table.call_binder(type_event, bei.when, bei.server_id, ext_state);
+        return t;
+    }
+
     slave::RecordSet _record_set;
 
     unsigned char* t = nullptr;
@@ -554,7 +586,7 @@ unsigned char* do_writedelete_row(const slave::Table& table,
     _record_set.when = bei.when;
     _record_set.tbl_name = table.table_name;
     _record_set.db_name = table.database_name;
-    _record_set.type_event = (bei.type == WRITE_ROWS_EVENT_V1 || bei.type == WRITE_ROWS_EVENT ? slave::RecordSet::Write : slave::RecordSet::Delete);
+    _record_set.type_event = type_event;
     _record_set.master_id = bei.server_id;
 
     table.call_callback(_record_set, ext_state);
@@ -571,7 +603,9 @@ unsigned char* do_update_row(const slave::Table& table,
     slave::RecordSet _record_set;
 
     unsigned char* t = nullptr;
-    if (table.row_type == RowType::Map)
+    if (table.m_binder)
+        t = table.m_binder->unpack(roi.m_width, row_start, roi.m_cols, true);
+    else if (table.row_type == RowType::Map)
         t = unpack_row(table, _record_set.m_old_row, roi.m_width, row_start, roi.m_cols);
     else
         t = unpack_row(table, _record_set.m_old_row_vec, roi.m_width, row_start, roi.m_cols);
@@ -580,10 +614,30 @@ unsigned char* do_update_row(const slave::Table& table,
         return NULL;
     }
 
+    // see Rows_log_event::write_data_body() @ log_event.cc
+    const unsigned char* partial_bits = nullptr;
+    if (roi.has_value_options) {
+        const unsigned long long value_options = net_field_length_ll(&t);
+        if (value_options & PARTIAL_JSON_UPDATES) {
+            partial_bits = t;
+            unsigned json_columns = 0;
+            for (const unsigned i : table.schema->json_columns)
+                if (i < roi.m_width && (roi.m_cols.empty() || roi.m_cols[i / 8] & (1 << (i & 7))))
+                    json_columns++;
+            t += (json_columns + 7) / 8;
+        }
+    }
+
+    if (table.m_binder) {
+        t = table.m_binder->unpack(roi.m_width, t, roi.m_cols_ai, false, partial_bits, &roi.m_cols);
+        table.call_binder(slave::RecordSet::Update, bei.when, bei.server_id, ext_state);
+        return t;
+    }
+
     if (table.row_type == RowType::Map)
-        t = unpack_row(table, _record_set.m_row, roi.m_width, t, roi.m_cols_ai);
+        t = unpack_row(table, _record_set.m_row, roi.m_width, t, roi.m_cols_ai, partial_bits, &roi.m_cols);
     else
-        t = unpack_row(table, _record_set.m_row_vec, roi.m_width, t, roi.m_cols_ai);
+        t = unpack_row(table, _record_set.m_row_vec, roi.m_width, t, roi.m_cols_ai, partial_bits, &roi.m_cols);
 
     if (t == NULL) {
         return NULL;
@@ -610,7 +664,8 @@ namespace // anonymous
         case WRITE_ROWS_EVENT_V1:
         case WRITE_ROWS_EVENT:    return eInsert;
         case UPDATE_ROWS_EVENT_V1:
-        case UPDATE_ROWS_EVENT:   return eUpdate;
+        case UPDATE_ROWS_EVENT:
+        case PARTIAL_UPDATE_ROWS_EVENT: return eUpdate;
         case DELETE_ROWS_EVENT_V1:
         case DELETE_ROWS_EVENT:   return eDelete;
         default: throw std::logic_error("is not processable kind");
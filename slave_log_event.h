@@ -87,6 +87,12 @@ enum Log_event_type
 
   XA_PREPARE_LOG_EVENT= 38,
 
+  // 8.0 new events
+
+  PARTIAL_UPDATE_ROWS_EVENT = 39,
+
+  TRANSACTION_PAYLOAD_EVENT = 40,
+
   ENUM_END_EVENT
 };
 
@@ -126,6 +132,9 @@ enum Temporal_type
 #define ROWS_FLAGS_OFFSET      6
 #define ROWS_HEADER_LEN        10
 
+// value_options of after image in PARTIAL_UPDATE_ROWS_EVENT
+#define PARTIAL_JSON_UPDATES   1
+
 #define ENCODED_FLAG_LENGTH 1
 #define ENCODED_SID_LENGTH  16
 #define ENCODED_GNO_LENGTH  8
@@ -204,6 +213,8 @@ struct Row_event_info {
     unsigned char* m_rows_end;
 
     bool has_after_image;
+    // After image starts with value_options (PARTIAL_UPDATE_ROWS_EVENT)
+    bool has_value_options;
 
     Row_event_info(const char* buf, const unsigned int event_len, const bool is_update, const bool is_v2_event);
 };
@@ -217,7 +228,9 @@ struct Gtid_event_info
 };
 
 
-bool read_log_event(const char* buf, unsigned int event_len, Basic_event_info& info, EventStatIface* event_stat, bool master_ge_56, MasterInfo& master_info);
+// Events of TRANSACTION_PAYLOAD_EVENT are read with checksummed = false, they have no checksums.
+// With verify = false checksum is stripped, but not checked (except FORMAT_DESCRIPTION_EVENT).
+bool read_log_event(const char* buf, unsigned int event_len, Basic_event_info& info, EventStatIface* event_stat, bool master_ge_56, MasterInfo& master_info, bool checksummed = true, bool verify = true);
 
 void apply_row_event(const slave::RelayLogInfo& rli, const Basic_event_info& bei, const Row_event_info& roi, ExtStateIface& ext_state, EventStatIface* event_stat);
 
@@ -24,6 +24,8 @@
 
 #include "field.h"
 #include "recordset.h"
+#include "schema_cache.h"
+#include "schema_pool.h"
 #include "SlaveStats.h"
 
 
@@ -38,11 +40,52 @@ typedef EventKind filter;
 
 inline bool should_process(EventKind filter, EventKind kind) { return (filter & kind) == kind; }
 
-class Table {
+class Table;
 
+// Decodes rows of one table into user structure and calls its callback, see RowBinding
+class RowBinder
+{
 public:
+    virtual ~RowBinder() {}
+
+    // Same as unpack_row(), into the before or after image of the row
+    virtual unsigned char* unpack(unsigned colcnt, unsigned char* row, const std::vector<unsigned char>& cols, bool before,
+                                  const unsigned char* partial_bits = nullptr, const std::vector<unsigned char>* cols_bi = nullptr) = 0;
+    virtual void call(RecordSet::TypeEvent type, time_t when, unsigned int master_id) = 0;
+};
 
+// Creates RowBinder for a table, checking the binding against its structure
+class RowBindingIface
+{
+public:
+    virtual ~RowBindingIface() {}
+    virtual std::unique_ptr<RowBinder> bind(const Table& table) const = 0;
+};
+
+typedef std::shared_ptr<const RowBindingIface> PtrRowBinding;
+
+// Decoding part of table structure. Tables with identical columns (i.e. shards of one table)
+// share one TableSchema, only names, callbacks and filters are kept per table.
+struct TableSchema
+{
+    uint64_t fingerprint = 0;
+    PtrColumns columns;
+    FieldOptions options;
     std::vector<PtrField> fields;
+    // field name -> index in fields
+    std::map<std::string, unsigned> field_index;
+    // Indexes of Field_json in fields, ascending: partial JSON updates refer to JSON columns by number
+    std::vector<unsigned> json_columns;
+};
+
+typedef std::shared_ptr<TableSchema> PtrTableSchema;
+
+class Table {
+
+public:
+
+    const PtrTableSchema schema;
+    const std::vector<PtrField>& fields;
     std::vector<unsigned char> column_filter;
     std::vector<unsigned> column_filter_fields;
     unsigned column_filter_count;
@@ -50,6 +93,13 @@ public:
 
     callback m_callback;
     EventKind m_filter;
+    // Rows are decoded by it instead of m_callback, if set
+    std::unique_ptr<RowBinder> m_binder;
+
+    // Structure was taken from SchemaCache and is not confirmed by TABLE_MAP event yet.
+    bool from_cache = false;
+    // Signature of TABLE_MAP event was compared with SchemaCache.
+    bool map_checked = false;
 
     void call_callback(slave::RecordSet& _rs, ExtStateIface &ext_state) const
     {
@@ -60,6 +110,14 @@ public:
         m_callback(_rs);
     }
 
+    void call_binder(RecordSet::TypeEvent type, time_t when, unsigned int master_id, ExtStateIface &ext_state) const
+    {
+        ext_state.incTableCount(full_name);
+        ext_state.setLastFilteredUpdateTime();
+
+        m_binder->call(type, when, master_id);
+    }
+
     void set_column_filter(const std::vector<std::string> &_column_filter) {
         if (_column_filter.empty()) {
             column_filter.clear();
@@ -68,25 +126,16 @@ public:
             return;
         }
 
-        column_filter.resize((fields.size() + 7)/8);
-        column_filter_fields.resize(fields.size());
+        column_filter.assign((fields.size() + 7)/8, 0);
+        column_filter_fields.assign(fields.size(), 0);
         column_filter_count = _column_filter.size();
-        for (unsigned i = 0; i < column_filter.size(); i++) {
-            column_filter[i] = 0;
-            column_filter_fields[i] = 0;
-        }
 
-        // FIXME: this loop has complexity factor of O(N*M)
         for (auto i = _column_filter.begin(); i != _column_filter.end(); ++i) {
-            const auto &field_name = *i;
-            for (auto j = fields.begin(); j != fields.end(); ++j) {
-                const auto &field = *j;
-                if (field->getFieldName() == field_name) {
-                    const int index = j - fields.begin();
-                    column_filter[index>>3] |= (1<<(index&7));
-                    column_filter_fields[index] = i - _column_filter.begin();
-                    break;
-                }
+            const auto j = schema->field_index.find(*i);
+            if (j != schema->field_index.end()) {
+                const unsigned index = j->second;
+                column_filter[index>>3] |= (1<<(index&7));
+                column_filter_fields[index] = i - _column_filter.begin();
             }
         }
     }
@@ -96,14 +145,14 @@ public:
 
     std::string full_name;
 
-    Table(const std::string& db_name, const std::string& tbl_name) :
+    Table(const std::string& db_name, const std::string& tbl_name, const PtrTableSchema& _schema) :
+        schema(_schema),
+        fields(schema->fields),
         column_filter_count(0),
         table_name(tbl_name), database_name(db_name),
         full_name(database_name + "." + table_name)
         {}
 
-    Table() {}
-
 };
 
 }
@@ -0,0 +1,101 @@
+/* Copyright 2011 ZAO "Begun".
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "table_pattern.h"
+
+namespace
+{
+// Classic glob matching with backtracking to the last '*'
+bool globMatch(const char* p, const char* s)
+{
+    const char* star = nullptr;
+    const char* retry = nullptr;
+
+    while (*s)
+    {
+        if (*p == '*')
+        {
+            star = ++p;
+            retry = s;
+        }
+        else if (*p == '?' || *p == *s)
+        {
+            ++p;
+            ++s;
+        }
+        else if (star)
+        {
+            p = star;
+            s = ++retry;
+        }
+        else
+            return false;
+    }
+
+    while (*p == '*')
+        ++p;
+
+    return *p == '\0';
+}
+}// anonymous-namespace
+
+namespace slave
+{
+
+NamePattern::NamePattern(const std::string& pattern)
+:   m_pattern(pattern), m_kind(Glob)
+{
+    const std::string::size_type first = pattern.find_first_of("*?");
+
+    if (first == std::string::npos)
+    {
+        m_kind = Exact;
+        m_literal = pattern;
+    }
+    else if (pattern == "*")
+    {
+        m_kind = Any;
+    }
+    else if (first == pattern.size() - 1 && pattern[first] == '*')
+    {
+        m_kind = Prefix;
+        m_literal = pattern.substr(0, first);
+    }
+    else if (first == 0 && pattern[0] == '*' && pattern.find_first_of("*?", 1) == std::string::npos)
+    {
+        m_kind = Suffix;
+        m_literal = pattern.substr(1);
+    }
+}
+
+bool NamePattern::match(const std::string& name) const
+{
+    switch (m_kind)
+    {
+    case Exact:
+        return name == m_literal;
+    case Any:
+        return true;
+    case Prefix:
+        return name.compare(0, m_literal.size(), m_literal) == 0;
+    case Suffix:
+        return name.size() >= m_literal.size()
+            && name.compare(name.size() - m_literal.size(), m_literal.size(), m_literal) == 0;
+    case Glob:
+        break;
+    }
+    return globMatch(m_pattern.c_str(), name.c_str());
+}
+
+}// slave
@@ -0,0 +1,74 @@
+/* Copyright 2011 ZAO "Begun".
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __SLAVE_TABLE_PATTERN_H_
+#define __SLAVE_TABLE_PATTERN_H_
+
+#include <string>
+#include <utility>
+
+namespace slave
+{
+
+// Shell-like pattern of database or table name: '*' matches any sequence of characters,
+// '?' matches any single character. Common forms (exact name, "prefix*", "*suffix", "*")
+// are recognized once at construction and matched without backtracking.
+class NamePattern
+{
+public:
+
+    explicit NamePattern(const std::string& pattern);
+
+    bool match(const std::string& name) const;
+
+    bool hasWildcards() const { return m_kind != Exact; }
+    const std::string& str() const { return m_pattern; }
+
+private:
+
+    enum Kind { Exact, Any, Prefix, Suffix, Glob };
+
+    std::string m_pattern;
+    // Literal part for Exact, Prefix and Suffix kinds
+    std::string m_literal;
+    Kind        m_kind;
+};
+
+// Pattern of (database, table) pair, i.e. ("shop_*", "orders") or ("*", "audit_log").
+class TablePattern
+{
+public:
+
+    TablePattern(const std::string& db_pattern, const std::string& tbl_pattern)
+    :   m_db(db_pattern), m_tbl(tbl_pattern)
+    {}
+
+    bool match(const std::pair<std::string, std::string>& key) const
+    {
+        return m_tbl.match(key.second) && m_db.match(key.first);
+    }
+
+    bool hasWildcards() const { return m_db.hasWildcards() || m_tbl.hasWildcards(); }
+
+    std::string str() const { return m_db.str() + "." + m_tbl.str(); }
+
+private:
+
+    NamePattern m_db;
+    NamePattern m_tbl;
+};
+
+}// slave
+
+#endif
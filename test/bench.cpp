@@ -0,0 +1,740 @@
+// Micro-benchmarks of event parsing and row decoding. Events are generated in memory,
+// no MySQL server is needed: end-to-end case reads them from fake::Master.
+// Usage: bench [--profile] [--budget file] [filter], only benchmarks with filter in their names are run.
+// --profile reports heap allocations, allocated bytes, instructions and cache misses per row
+// instead of speed, --budget also fails if they exceed limits from the file (test/data/bench_budget.conf).
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "DefaultExtState.h"
+#include "Slave.h"
+#include "checksum.h"
+#include "fake_master.h"
+#include "row_binding.h"
+
+// ----- allocation counting -----------------------------------------------------------------------
+
+namespace
+{
+std::atomic<size_t> g_allocs{0};
+std::atomic<size_t> g_alloc_bytes{0};
+}// anonymous-namespace
+
+void* operator new(size_t size)
+{
+    g_allocs.fetch_add(1, std::memory_order_relaxed);
+    g_alloc_bytes.fetch_add(size, std::memory_order_relaxed);
+    if (void* p = ::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t size) { return operator new(size); }
+void operator delete(void* p) noexcept { ::free(p); }
+void operator delete[](void* p) noexcept { ::free(p); }
+void operator delete(void* p, size_t) noexcept { ::free(p); }
+void operator delete[](void* p, size_t) noexcept { ::free(p); }
+
+namespace
+{
+const unsigned rows_per_event = 100;
+const double min_seconds = 0.3;
+
+// ----- encoding ----------------------------------------------------------------------------------
+
+void putLE(std::string& s, uint64_t value, unsigned bytes)
+{
+    for (unsigned i = 0; i < bytes; ++i, value >>= 8)
+        s += static_cast<char>(value & 0xFF);
+}
+
+void putBE(std::string& s, uint64_t value, unsigned bytes)
+{
+    for (unsigned i = bytes; i; --i)
+        s += static_cast<char>((value >> (8 * (i - 1))) & 0xFF);
+}
+
+void putString(std::string& s, const std::string& value, unsigned length_bytes)
+{
+    putLE(s, value.size(), length_bytes);
+    s += value;
+}
+
+std::string makeEvent(slave::Log_event_type type, const std::string& body, bool checksum)
+{
+    std::string event = fake::event(type, body);
+    if (checksum)
+    {
+        std::string len;
+        putLE(len, event.size() + 4, 4);
+        event.replace(EVENT_LEN_OFFSET, 4, len);
+        putLE(event, slave::crc32(0, (const unsigned char*)event.data(), event.size()), 4);
+    }
+    return event;
+}
+
+// Column of the type from test/data/OneField, value(i) appends its packed i-th value
+struct ColumnSpec
+{
+    const char*   name;
+    const char*   type;
+    unsigned      binlog_type;
+    unsigned      mysql_type;
+    unsigned long length;
+    unsigned      flags;
+    unsigned      decimals;
+    std::string   metadata;     // of TABLE_MAP_EVENT
+    std::function<void (std::string&, unsigned)> value;
+};
+
+std::string text(unsigned i, size_t size)
+{
+    std::string s = "value " + std::to_string(i) + " ";
+    s.resize(size, 'x');
+    return s;
+}
+
+const std::vector<ColumnSpec>& columnSpecs()
+{
+    static const std::vector<ColumnSpec> specs = {
+        {"TINYINT", "tinyint(4)", MYSQL_TYPE_TINY, MYSQL_TYPE_TINY, 4, 0, 0, "",
+            [](std::string& s, unsigned i) { putLE(s, i % 100, 1); }},
+        {"SMALLINT", "smallint(6)", MYSQL_TYPE_SHORT, MYSQL_TYPE_SHORT, 6, 0, 0, "",
+            [](std::string& s, unsigned i) { putLE(s, i % 30000, 2); }},
+        {"INT", "int(11)", MYSQL_TYPE_LONG, MYSQL_TYPE_LONG, 11, 0, 0, "",
+            [](std::string& s, unsigned i) { putLE(s, i * 7, 4); }},
+        {"BIGINT", "bigint(20) unsigned", MYSQL_TYPE_LONGLONG, MYSQL_TYPE_LONGLONG, 20, UNSIGNED_FLAG, 0, "",
+            [](std::string& s, unsigned i) { putLE(s, i * 1000000007ULL, 8); }},
+        {"DECIMAL", "decimal(10,2)", MYSQL_TYPE_NEWDECIMAL, MYSQL_TYPE_NEWDECIMAL, 12, 0, 2, std::string("\x0A\x02", 2),
+            [](std::string& s, unsigned i)
+            {
+                // 8 integer digits in 4 bytes, 2 fractional in 1 byte, sign bit set for positive
+                const size_t pos = s.size();
+                putBE(s, i, 4);
+                putBE(s, i % 100, 1);
+                s[pos] ^= 0x80;
+            }},
+        {"BIT", "bit(8)", MYSQL_TYPE_BIT, MYSQL_TYPE_BIT, 8, UNSIGNED_FLAG, 0, std::string("\x00\x01", 2),
+            [](std::string& s, unsigned i) { putLE(s, i & 0xFF, 1); }},
+        {"YEAR", "year(4)", MYSQL_TYPE_YEAR, MYSQL_TYPE_YEAR, 4, UNSIGNED_FLAG, 0, "",
+            [](std::string& s, unsigned i) { putLE(s, 100 + i % 50, 1); }},
+        {"DATE", "date", MYSQL_TYPE_DATE, MYSQL_TYPE_DATE, 10, 0, 0, "",
+            [](std::string& s, unsigned i) { putLE(s, (1 + i % 28) | (1 + i % 12) << 5 | (2000 + i % 20) << 9, 3); }},
+        {"TIME", "time", MYSQL_TYPE_TIME2, MYSQL_TYPE_TIME, 10, 0, 0, std::string(1, 0),
+            [](std::string& s, unsigned i) { putBE(s, 0x800000 + ((i % 24) << 12 | (i % 60) << 6 | (i % 60)), 3); }},
+        {"DATETIME", "datetime", MYSQL_TYPE_DATETIME2, MYSQL_TYPE_DATETIME, 19, 0, 0, std::string(1, 0),
+            [](std::string& s, unsigned i)
+            {
+                const uint64_t ymd = ((2000 + i % 20) * 13ULL + 1 + i % 12) << 5 | (1 + i % 28);
+                const uint64_t hms = (i % 24) << 12 | (i % 60) << 6 | (i % 60);
+                putBE(s, 0x8000000000ULL + (ymd << 17 | hms), 5);
+            }},
+        {"TIMESTAMP", "timestamp", MYSQL_TYPE_TIMESTAMP2, MYSQL_TYPE_TIMESTAMP, 19, 0, 0, std::string(1, 0),
+            [](std::string& s, unsigned i) { putBE(s, 1500000000 + i * 61, 4); }},
+        {"CHAR", "char(20)", MYSQL_TYPE_STRING, MYSQL_TYPE_STRING, 20, 0, 0, std::string("\xFE\x14", 2),
+            [](std::string& s, unsigned i) { putString(s, text(i, 20), 1); }},
+        {"VARCHAR", "varchar(300)", MYSQL_TYPE_VARCHAR, MYSQL_TYPE_VAR_STRING, 300, 0, 0, std::string("\x2C\x01", 2),
+            [](std::string& s, unsigned i) { putString(s, text(i, 40), 2); }},
+        {"TINYTEXT", "tinytext", MYSQL_TYPE_BLOB, MYSQL_TYPE_BLOB, 255, 0, 0, "\x01",
+            [](std::string& s, unsigned i) { putString(s, text(i, 60), 1); }},
+        {"TEXT", "text", MYSQL_TYPE_BLOB, MYSQL_TYPE_BLOB, 65535, 0, 0, "\x02",
+            [](std::string& s, unsigned i) { putString(s, text(i, 200), 2); }},
+        {"SET", "set('a','b','c','d','e')", MYSQL_TYPE_STRING, MYSQL_TYPE_STRING, 9, SET_FLAG, 0, std::string("\xF8\x01", 2),
+            [](std::string& s, unsigned i) { putLE(s, i % 32, 1); }},
+    };
+    return specs;
+}
+
+struct TableSpec
+{
+    std::string db;
+    std::string tbl;
+    std::vector<const ColumnSpec*> columns;
+
+    slave::columns_t columnInfo() const
+    {
+        // Columns are named by type and number of the type in the table: int_0, int_1, ...
+        std::map<std::string, unsigned> counts;
+        slave::columns_t result;
+        for (size_t i = 0; i < columns.size(); ++i)
+        {
+            std::string name = columns[i]->name;
+            std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+
+            slave::ColumnInfo c;
+            c.name = name + "_" + std::to_string(counts[name]++);
+            c.type = columns[i]->type;
+            c.mysql_type = columns[i]->mysql_type;
+            c.length = columns[i]->length;
+            c.flags = columns[i]->flags;
+            c.decimals = columns[i]->decimals;
+            result.push_back(c);
+        }
+        return result;
+    }
+};
+
+std::string tableMapEvent(const TableSpec& table, uint64_t table_id)
+{
+    std::string body;
+    putLE(body, table_id, 6);
+    putLE(body, 1, 2);
+    putString(body, table.db, 1);
+    body += '\0';
+    putString(body, table.tbl, 1);
+    body += '\0';
+    putLE(body, table.columns.size(), 1);
+    for (const auto c : table.columns)
+        body += static_cast<char>(c->binlog_type);
+    std::string metadata;
+    for (const auto c : table.columns)
+        metadata += c->metadata;
+    putLE(body, metadata.size(), 1);
+    body += metadata;
+    putLE(body, 0, (table.columns.size() + 7) / 8);                     // null bits
+    return makeEvent(slave::TABLE_MAP_EVENT, body, false);
+}
+
+std::string writeRowsEvent(const TableSpec& table, uint64_t table_id, unsigned first_row, bool checksum = false)
+{
+    const size_t width = table.columns.size();
+    std::string body;
+    putLE(body, table_id, 6);
+    putLE(body, 1, 2);                                                  // STMT_END_F
+    putLE(body, 2, 2);                                                  // no extra row info
+    putLE(body, width, 1);
+    body.append((width + 7) / 8, '\xFF');
+    for (unsigned r = first_row; r < first_row + rows_per_event; ++r)
+    {
+        body.append((width + 7) / 8, '\0');                             // no NULLs
+        for (const auto c : table.columns)
+            c->value(body, r);
+    }
+    return makeEvent(slave::WRITE_ROWS_EVENT, body, checksum);
+}
+
+// ----- harness -----------------------------------------------------------------------------------
+
+// Slave with tables created from generated structure, without connection to master
+class BenchSlave : public slave::Slave
+{
+public:
+
+    explicit BenchSlave(const slave::MasterInfo& master_info) : Slave(master_info) {}
+
+    slave::Table& addTable(const TableSpec& spec)
+    {
+        setCallback(spec.db, spec.tbl, [](slave::RecordSet&) {});
+        createTable(rli, spec.db, spec.tbl, spec.columnInfo(), false);
+        slave::Table& table = *rli.m_table_map[std::make_pair(spec.db, spec.tbl)];
+        table.m_callback = [this](slave::RecordSet&) { ++rows; };
+        table.m_filter = slave::eAll;
+        return table;
+    }
+
+    void process(const std::string& event)
+    {
+        slave::Basic_event_info bei;
+        bei.parse(event.data(), event.size());
+        process_event(bei, rli);
+    }
+
+    slave::RelayLogInfo rli;
+    size_t rows = 0;
+};
+
+const char* g_filter = nullptr;
+bool g_profile = false;
+
+bool selected(const std::string& name)
+{
+    return !g_filter || name.find(g_filter) != std::string::npos;
+}
+
+// Hardware counters of the calling thread, user space only. They are unavailable
+// without kernel support or with kernel.perf_event_paranoid > 2.
+class PerfCounters
+{
+public:
+
+    enum Counter { INSTRUCTIONS, CACHE_MISSES, COUNTERS };
+
+    PerfCounters()
+    {
+#ifdef __linux__
+        const uint64_t configs[COUNTERS] = {PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES};
+        for (int i = 0; i < COUNTERS; ++i)
+        {
+            perf_event_attr attr;
+            ::memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = configs[i];
+            attr.disabled = 1;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            m_fd[i] = ::syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+        }
+#endif
+    }
+
+    ~PerfCounters()
+    {
+#ifdef __linux__
+        for (int fd : m_fd)
+            if (fd >= 0)
+                ::close(fd);
+#endif
+    }
+
+    void start()
+    {
+#ifdef __linux__
+        for (int fd : m_fd)
+            if (fd >= 0)
+            {
+                ::ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+                ::ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+            }
+#endif
+    }
+
+    void stop()
+    {
+#ifdef __linux__
+        for (int i = 0; i < COUNTERS; ++i)
+        {
+            m_value[i] = -1;
+            uint64_t value = 0;
+            if (m_fd[i] >= 0 && ::ioctl(m_fd[i], PERF_EVENT_IOC_DISABLE, 0) == 0
+                && ::read(m_fd[i], &value, sizeof(value)) == sizeof(value))
+                m_value[i] = static_cast<double>(value);
+        }
+#endif
+    }
+
+    // Counted between start() and stop(), negative if the counter is unavailable
+    double value(Counter counter) const { return m_value[counter]; }
+
+private:
+
+    int    m_fd[COUNTERS] = {-1, -1};
+    double m_value[COUNTERS] = {-1, -1};
+};
+
+// Per unit (row or event) values by metric name: allocs, bytes, instructions, cache_misses
+typedef std::map<std::string, double> metrics_t;
+
+std::map<std::string, metrics_t> g_budgets;
+std::map<std::string, bool> g_budget_checked;
+unsigned g_budget_failures = 0;
+
+// Lines of the file are "<benchmark name> <metric>=<limit> ...", '#' starts a comment
+void loadBudgets(const char* path)
+{
+    std::ifstream f(path);
+    if (!f)
+    {
+        ::fprintf(stderr, "can't open budget file %s\n", path);
+        ::exit(2);
+    }
+
+    std::string line;
+    while (std::getline(f, line))
+    {
+        line.erase(std::find(line.begin(), line.end(), '#'), line.end());
+
+        std::istringstream tokens(line);
+        std::string token, name;
+        metrics_t limits;
+        while (tokens >> token)
+        {
+            const size_t eq = token.find('=');
+            if (eq == std::string::npos)
+                name += (name.empty() ? "" : " ") + token;
+            else
+                limits[token.substr(0, eq)] = ::atof(token.c_str() + eq + 1);
+        }
+        if (!name.empty())
+        {
+            g_budgets[name] = limits;
+            g_budget_checked[name] = false;
+        }
+    }
+}
+
+void checkBudget(const std::string& name, const metrics_t& metrics)
+{
+    const auto it = g_budgets.find(name);
+    if (it == g_budgets.end())
+        return;
+
+    g_budget_checked[name] = true;
+    for (const auto& limit : it->second)
+    {
+        const auto m = metrics.find(limit.first);
+        if (m == metrics.end())
+            continue;   // counter is not available on this machine
+        if (m->second > limit.second)
+        {
+            ::printf("BUDGET EXCEEDED: %s %s %.2f > %g\n", name.c_str(), limit.first.c_str(), m->second, limit.second);
+            ++g_budget_failures;
+        }
+    }
+}
+
+std::string formatMetric(const metrics_t& metrics, const char* metric, const char* format)
+{
+    const auto it = metrics.find(metric);
+    if (it == metrics.end())
+        return "n/a";
+    char buf[32];
+    ::snprintf(buf, sizeof(buf), format, it->second);
+    return buf;
+}
+
+// Runs warmed up body once under allocation and hardware counters
+void profile(const std::string& name, size_t units, const char* unit, const std::function<void ()>& body)
+{
+    static PerfCounters counters;
+
+    body();     // warm up: table structures, caches and buffers reserved by the first rows
+
+    const size_t allocs = g_allocs;
+    const size_t bytes = g_alloc_bytes;
+    counters.start();
+    body();
+    counters.stop();
+
+    metrics_t metrics;
+    metrics["allocs"] = double(g_allocs - allocs) / units;
+    metrics["bytes"] = double(g_alloc_bytes - bytes) / units;
+    if (counters.value(PerfCounters::INSTRUCTIONS) >= 0)
+        metrics["instructions"] = counters.value(PerfCounters::INSTRUCTIONS) / units;
+    if (counters.value(PerfCounters::CACHE_MISSES) >= 0)
+        metrics["cache_misses"] = counters.value(PerfCounters::CACHE_MISSES) / units;
+
+    ::printf("%-56s %8s allocs %10s bytes %10s instructions %8s cache misses per %s\n", name.c_str(),
+             formatMetric(metrics, "allocs", "%.2f").c_str(), formatMetric(metrics, "bytes", "%.1f").c_str(),
+             formatMetric(metrics, "instructions", "%.0f").c_str(), formatMetric(metrics, "cache_misses", "%.2f").c_str(),
+             unit);
+
+    checkBudget(name, metrics);
+}
+
+void report(const std::string& name, double units, const char* unit, double seconds)
+{
+    ::printf("%-56s %12.0f %s/s %10.1f ns/%s\n", name.c_str(), units / seconds, unit, seconds * 1e9 / units, unit);
+}
+
+// Runs body (which handles `units` rows or events) until min_seconds pass
+void run(const std::string& name, size_t units, const char* unit, const std::function<void ()>& body)
+{
+    if (!selected(name))
+        return;
+
+    if (g_profile)
+    {
+        profile(name, units, unit, body);
+        return;
+    }
+
+    typedef std::chrono::steady_clock clock;
+    body();     // warm up
+
+    size_t iterations = 0;
+    const auto start = clock::now();
+    double seconds = 0;
+    do {
+        body();
+        ++iterations;
+        seconds = std::chrono::duration<double>(clock::now() - start).count();
+    } while (seconds < min_seconds);
+
+    report(name, double(units) * iterations, unit, seconds);
+}
+
+// ----- benchmarks --------------------------------------------------------------------------------
+
+TableSpec oneField(const ColumnSpec& column)
+{
+    return {"bench", std::string("one_") + column.name, {&column}};
+}
+
+TableSpec wideTable(unsigned repeat)
+{
+    TableSpec spec{"bench", "wide", {}};
+    for (unsigned i = 0; i < repeat; ++i)
+        for (const auto& c : columnSpecs())
+            spec.columns.push_back(&c);
+    return spec;
+}
+
+void benchReadLogEvent()
+{
+    const TableSpec spec = wideTable(1);
+    for (bool checksum : {false, true})
+    {
+        slave::MasterInfo master_info;
+        master_info.checksum_alg = checksum ? slave::BINLOG_CHECKSUM_ALG_CRC32 : slave::BINLOG_CHECKSUM_ALG_OFF;
+
+        std::vector<std::string> events;
+        for (unsigned i = 0; i < 100; ++i)
+            events.push_back(writeRowsEvent(spec, 1, i * rows_per_event, checksum));
+
+        run(std::string("read_log_event") + (checksum ? " crc32" : ""), events.size(), "event", [&]()
+        {
+            for (const auto& e : events)
+            {
+                slave::Basic_event_info bei;
+                slave::read_log_event(e.data(), e.size(), bei, nullptr, true, master_info);
+            }
+        });
+    }
+}
+
+void benchTableMap()
+{
+    slave::MasterInfo master_info;
+    BenchSlave slave(master_info);
+
+    const unsigned tables = 1000;
+    std::vector<TableSpec> specs;
+    for (unsigned i = 0; i < tables; ++i)
+    {
+        specs.push_back(wideTable(1));
+        specs.back().tbl = "t" + std::to_string(i);
+        slave.addTable(specs.back());
+    }
+
+    std::vector<std::string> stable, churn;
+    for (unsigned i = 0; i < tables; ++i)
+        stable.push_back(tableMapEvent(specs[i], i + 1));
+
+    run("TABLE_MAP 1000 tables", stable.size(), "event", [&]()
+    {
+        for (const auto& e : stable)
+            slave.process(e);
+    });
+
+    // New table_id for every event, as after FLUSH TABLES or table cache eviction
+    uint64_t next_id = tables + 1;
+    run("TABLE_MAP 1000 tables, table_id churn", tables, "event", [&]()
+    {
+        churn.clear();
+        for (unsigned i = 0; i < tables; ++i)
+            churn.push_back(tableMapEvent(specs[i], next_id++));
+        for (const auto& e : churn)
+            slave.process(e);
+    });
+}
+
+void benchOneField()
+{
+    for (const auto& column : columnSpecs())
+    {
+        const TableSpec spec = oneField(column);
+
+        std::vector<std::string> events;
+        for (unsigned i = 0; i < 100; ++i)
+            events.push_back(writeRowsEvent(spec, 1, i * rows_per_event));
+
+        for (auto row_type : {slave::RowType::Map, slave::RowType::Vector})
+        {
+            slave::MasterInfo master_info;
+            master_info.is_old_storage = false;
+            BenchSlave slave(master_info);
+
+            slave.addTable(spec).row_type = row_type;
+            slave.process(tableMapEvent(spec, 1));
+
+            const std::string name = std::string("apply_row_event ") + column.name
+                                   + (row_type == slave::RowType::Map ? ", Map" : ", Vector");
+            run(name, events.size() * rows_per_event, "row", [&]()
+            {
+                for (const auto& e : events)
+                    slave.process(e);
+            });
+        }
+    }
+}
+
+struct WideRow
+{
+    int32_t            id;
+    uint64_t           big;
+    boost::string_view name;
+    std::string        note;
+};
+
+void benchWide()
+{
+    const TableSpec spec = wideTable(4);
+
+    std::vector<std::string> events;
+    for (unsigned i = 0; i < 20; ++i)
+        events.push_back(writeRowsEvent(spec, 1, i * rows_per_event));
+
+    const slave::Slave::cols_t filter = {"int_0", "bigint_0", "varchar_0", "text_0"};
+
+    for (auto row_type : {slave::RowType::Map, slave::RowType::Vector})
+        for (bool column_filter : {false, true})
+        {
+            slave::MasterInfo master_info;
+            master_info.is_old_storage = false;
+            BenchSlave slave(master_info);
+
+            slave::Table& table = slave.addTable(spec);
+            table.row_type = row_type;
+            if (column_filter)
+                table.set_column_filter(filter);
+            slave.process(tableMapEvent(spec, 1));
+
+            const std::string name = std::string("apply_row_event wide 64 columns, ")
+                                   + (row_type == slave::RowType::Map ? "Map" : "Vector")
+                                   + (column_filter ? ", 4 columns filtered" : "");
+            run(name, events.size() * rows_per_event, "row", [&]()
+            {
+                for (const auto& e : events)
+                    slave.process(e);
+            });
+        }
+
+    slave::MasterInfo master_info;
+    master_info.is_old_storage = false;
+    BenchSlave slave(master_info);
+    slave::Table& table = slave.addTable(spec);
+    size_t bound = 0;
+    slave::RowBinding<WideRow> binding([&bound](const slave::BoundRow<WideRow>& r) { bound += r.row.id != 0; });
+    binding.column("int_0", &WideRow::id).column("bigint_0", &WideRow::big)
+           .column("varchar_0", &WideRow::name).column("text_0", &WideRow::note);
+    table.m_binder = binding.bind(table);
+    slave.process(tableMapEvent(spec, 1));
+
+    run("apply_row_event wide 64 columns, RowBinding of 4", events.size() * rows_per_event, "row", [&]()
+    {
+        for (const auto& e : events)
+            slave.process(e);
+    });
+}
+
+void benchManyTables()
+{
+    slave::MasterInfo master_info;
+    master_info.is_old_storage = false;
+    BenchSlave slave(master_info);
+
+    const unsigned tables = 1000;
+    std::vector<std::string> events;
+    for (unsigned i = 0; i < tables; ++i)
+    {
+        TableSpec spec = wideTable(1);
+        spec.tbl = "t" + std::to_string(i);
+        slave.addTable(spec);
+        slave.process(tableMapEvent(spec, i + 1));
+        events.push_back(writeRowsEvent(spec, i + 1, i));
+    }
+
+    run("apply_row_event 1000 tables", events.size() * rows_per_event, "row", [&]()
+    {
+        for (const auto& e : events)
+            slave.process(e);
+    });
+}
+
+// Slave::get_remote_binlog reading from local fake master: protocol, checksums and row decoding
+void benchRemoteBinlog(bool native_reader)
+{
+    // Dump and session threads of the fake master would be counted as well
+    const std::string name = std::string("get_remote_binlog wide 16 columns") + (native_reader ? ", native reader" : "");
+    if (!selected(name) || g_profile)
+        return;
+
+    const TableSpec spec = wideTable(1);
+    fake::Master master;
+    master.addTable(spec.db, spec.tbl, spec.columnInfo());
+
+    const unsigned transactions = 2000;
+    for (unsigned i = 0; i < transactions; ++i)
+    {
+        master.append(fake::queryEvent(spec.db, "BEGIN"));
+        master.append(tableMapEvent(spec, 1));
+        master.append(writeRowsEvent(spec, 1, i * rows_per_event));
+        master.append(fake::xidEvent(i));
+    }
+    const size_t total = size_t(transactions) * rows_per_event;
+
+    slave::DefaultExtState ext_state;
+    ext_state.setMasterPosition(slave::Position(master.position().log_name, 4));
+
+    slave::MasterInfo master_info;
+    master_info.conn_options.mysql_host = "127.0.0.1";
+    master_info.conn_options.mysql_port = master.port();
+    master_info.conn_options.mysql_user = "root";
+    master_info.native_reader = native_reader;
+
+    slave::Slave slave(master_info, ext_state);
+    size_t rows = 0;
+    slave.setCallback(spec.db, spec.tbl, [&rows](slave::RecordSet&) { ++rows; });
+    slave.init();
+    slave.createDatabaseStructure();
+
+    const auto start = std::chrono::steady_clock::now();
+    slave.get_remote_binlog([&rows, total]() { return rows >= total; });
+    report(name, total, "row", std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+}
+}// anonymous-namespace
+
+int main(int argc, char** argv)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        if (!::strcmp(argv[i], "--profile"))
+            g_profile = true;
+        else if (!::strcmp(argv[i], "--budget") && i + 1 < argc)
+        {
+            g_profile = true;
+            loadBudgets(argv[++i]);
+        }
+        else
+            g_filter = argv[i];
+    }
+
+    benchReadLogEvent();
+    benchTableMap();
+    benchOneField();
+    benchWide();
+    benchManyTables();
+    benchRemoteBinlog(false);
+    benchRemoteBinlog(true);
+
+    if (!g_filter)
+        for (const auto& checked : g_budget_checked)
+            if (!checked.second)
+            {
+                ::printf("BUDGET NOT MEASURED: %s\n", checked.first.c_str());
+                ++g_budget_failures;
+            }
+
+    return g_budget_failures ? 1 : 0;
+}
@@ -0,0 +1,956 @@
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <stdexcept>
+
+#include "checksum.h"
+#include "fake_master.h"
+
+namespace
+{
+enum : uint8_t {
+    COM_QUIT_ = 1,
+    COM_INIT_DB_ = 2,
+    COM_QUERY_ = 3,
+    COM_FIELD_LIST_ = 4,
+    COM_PING_ = 14,
+    COM_BINLOG_DUMP_ = 18,
+    COM_REGISTER_SLAVE_ = 21,
+    COM_BINLOG_DUMP_GTID_ = 30
+};
+
+// CLIENT_LONG_PASSWORD | CLIENT_FOUND_ROWS | CLIENT_LONG_FLAG | CLIENT_CONNECT_WITH_DB | CLIENT_PROTOCOL_41
+// | CLIENT_TRANSACTIONS | CLIENT_SECURE_CONNECTION | CLIENT_MULTI_STATEMENTS | CLIENT_MULTI_RESULTS
+// | CLIENT_PLUGIN_AUTH
+const uint32_t server_capabilities = 0x1 | 0x2 | 0x4 | 0x8 | 0x200 | 0x2000 | 0x8000 | 0x10000 | 0x20000 | 0x80000;
+const uint8_t  utf8_general_ci = 33;
+const uint8_t  binary_collation = 63;
+const uint16_t status_autocommit = 2;
+const uint16_t status_more_results = 8;
+const uint16_t log_event_artificial_f = 0x20;
+const size_t   max_packet = 0xFFFFFF;
+const char     binlog_magic[] = "\xFE" "bin";
+const size_t   binlog_header_size = 4;
+const size_t   flags_offset = 17;
+
+void putLE(std::string& s, uint64_t value, unsigned bytes)
+{
+    for (unsigned i = 0; i < bytes; ++i, value >>= 8)
+        s += static_cast<char>(value & 0xFF);
+}
+
+void setLE(std::string& s, size_t pos, uint64_t value, unsigned bytes)
+{
+    for (unsigned i = 0; i < bytes; ++i, value >>= 8)
+        s[pos + i] = static_cast<char>(value & 0xFF);
+}
+
+uint64_t getLE(const char* p, unsigned bytes)
+{
+    uint64_t value = 0;
+    for (unsigned i = bytes; i; --i)
+        value = value << 8 | static_cast<unsigned char>(p[i - 1]);
+    return value;
+}
+
+void putLenenc(std::string& s, uint64_t value)
+{
+    if (value < 251) {
+        putLE(s, value, 1);
+    } else if (value < 0x10000) {
+        s += '\xFC';
+        putLE(s, value, 2);
+    } else if (value < 0x1000000) {
+        s += '\xFD';
+        putLE(s, value, 3);
+    } else {
+        s += '\xFE';
+        putLE(s, value, 8);
+    }
+}
+
+void putLenencString(std::string& s, const std::string& value)
+{
+    putLenenc(s, value.size());
+    s += value;
+}
+
+std::string upper(std::string s)
+{
+    std::transform(s.begin(), s.end(), s.begin(), ::toupper);
+    return s;
+}
+
+std::string unquote(std::string s)
+{
+    s.erase(std::remove(s.begin(), s.end(), '`'), s.end());
+    return s;
+}
+
+bool startsWith(const std::string& s, const std::string& prefix)
+{
+    return s.compare(0, prefix.size(), prefix) == 0;
+}
+
+void addChecksum(std::string& event)
+{
+    putLE(event, slave::crc32(0, (const unsigned char*)event.data(), event.size()), 4);
+}
+
+// Event, which was not appended to a binlog
+void addLenChecksum(std::string& event)
+{
+    setLE(event, EVENT_LEN_OFFSET, event.size() + 4, 4);
+    addChecksum(event);
+}
+
+void setChecksum(std::string& event)
+{
+    event.resize(event.size() - 4);
+    addChecksum(event);
+}
+
+slave::Log_event_type eventType(const std::string& event)
+{
+    return static_cast<slave::Log_event_type>(static_cast<unsigned char>(event[EVENT_TYPE_OFFSET]));
+}
+
+std::string rotateEvent(const std::string& binlog_name, uint64_t pos, uint32_t server_id, uint16_t flags)
+{
+    std::string body;
+    putLE(body, pos, 8);
+    body += binlog_name;
+    std::string event = fake::event(slave::ROTATE_EVENT, body, 0, server_id);
+    setLE(event, flags_offset, flags, 2);
+    return event;
+}
+
+std::string formatDescriptionEvent(const std::string& version, uint32_t server_id, bool checksum)
+{
+    // Post-header lengths of MySQL 8.0 for every event type
+    const size_t event_types = slave::ENUM_END_EVENT - 1;
+    static const unsigned char post_header_len[event_types] = {
+        56, 13, 0, 8, 0, 18, 0, 4, 4, 4, 4, 18, 0, 0, START_V3_HEADER_LEN + 1 + event_types, 0, 4, 26, 8, 0,
+        0, 0, 8, 8, 8, 2, 0, 0, 0, 10, 10, 10, 42, 42, 0, 18, 52, 0, 10, 0
+    };
+
+    std::string body;
+    putLE(body, 4, 2);
+    std::string server_version = version;
+    server_version.resize(ST_SERVER_VER_LEN, '\0');
+    body += server_version;
+    putLE(body, 0, 4);
+    putLE(body, LOG_EVENT_HEADER_LEN, 1);
+    body.append((const char*)post_header_len, sizeof(post_header_len));
+    putLE(body, checksum ? slave::BINLOG_CHECKSUM_ALG_CRC32 : slave::BINLOG_CHECKSUM_ALG_OFF, 1);
+    return fake::event(slave::FORMAT_DESCRIPTION_EVENT, body, 0, server_id);
+}
+
+std::string hex(const char* p, size_t len)
+{
+    static const char digits[] = "0123456789abcdef";
+    std::string result;
+    for (size_t i = 0; i < len; ++i) {
+        result += digits[static_cast<unsigned char>(p[i]) >> 4];
+        result += digits[static_cast<unsigned char>(p[i]) & 0xF];
+    }
+    return result;
+}
+
+// Inverse of slave::Position::encodeGtid
+slave::Position decodeGtid(const char* p, size_t len)
+{
+    slave::Position result;
+    if (len < 8)
+        return result;
+    const char* const end = p + len;
+    for (uint64_t n_sids = getLE(p, 8); p += 8, n_sids && p + 24 <= end; --n_sids) {
+        const std::string sid = hex(p, 16);
+        uint64_t n_intervals = getLE(p + 16, 8);
+        p += 16;
+        auto& intervals = result.gtid_executed[sid];
+        for (; n_intervals && p + 24 <= end; --n_intervals, p += 16)
+            intervals.emplace_back(getLE(p + 8, 8), getLE(p + 16, 8) - 1);
+    }
+    return result;
+}
+
+slave::gtid_t gtidOf(const std::string& event)
+{
+    const slave::Gtid_event_info info(event.data(), event.size());
+    return slave::gtid_t(info.m_sid, info.m_gno);
+}
+
+typedef std::vector<std::string> row_t;
+}// anonymous-namespace
+
+namespace fake
+{
+
+std::string event(slave::Log_event_type type, const std::string& body, uint32_t when, uint32_t server_id)
+{
+    std::string result;
+    putLE(result, when, 4);
+    result += static_cast<char>(type);
+    putLE(result, server_id, 4);
+    putLE(result, LOG_EVENT_HEADER_LEN + body.size(), 4);
+    putLE(result, 0, 4);
+    putLE(result, 0, 2);
+    return result + body;
+}
+
+std::string queryEvent(const std::string& db, const std::string& query)
+{
+    std::string body;
+    putLE(body, 1, 4);          // thread_id
+    putLE(body, 0, 4);          // exec_time
+    putLE(body, db.size(), 1);
+    putLE(body, 0, 2);          // error_code
+    putLE(body, 0, 2);          // status_vars_len
+    body += db;
+    body += '\0';
+    body += query;
+    return event(slave::QUERY_EVENT, body);
+}
+
+std::string xidEvent(uint64_t xid)
+{
+    std::string body;
+    putLE(body, xid, 8);
+    return event(slave::XID_EVENT, body);
+}
+
+std::string gtidEvent(const slave::gtid_t& gtid)
+{
+    if (gtid.first.size() != 32)
+        throw std::runtime_error("fake::gtidEvent(): sid must be of 32 hex digits: " + gtid.first);
+
+    std::string body;
+    putLE(body, 1, 1);          // commit_flag
+    for (size_t i = 0; i < 32; i += 2)
+        body += static_cast<char>(std::stoi(gtid.first.substr(i, 2), nullptr, 16));
+    putLE(body, gtid.second, 8);
+    putLE(body, 2, 1);          // logical timestamps
+    putLE(body, 0, 8);
+    putLE(body, 0, 8);
+    return event(slave::GTID_LOG_EVENT, body);
+}
+
+// One client connection, served by its own thread
+class Master::Session
+{
+public:
+
+    Session(Master& master, int fd) : m_master(master), m_fd(fd) {}
+
+    void run()
+    {
+        try {
+            handshake();
+            std::string packet;
+            while (!m_master.m_stop && readPacket(packet)) {
+                if (packet.empty() || !command(packet))
+                    break;
+            }
+        } catch (const std::exception&) {
+            // Connection is broken, nothing to report it to
+        }
+    }
+
+private:
+
+    bool readAll(char* buf, size_t len)
+    {
+        while (len) {
+            const ssize_t n = ::recv(m_fd, buf, len, 0);
+            if (n <= 0)
+                return false;
+            buf += n;
+            len -= n;
+        }
+        return true;
+    }
+
+    void writeAll(const char* buf, size_t len)
+    {
+        while (len) {
+            const ssize_t n = ::send(m_fd, buf, len, MSG_NOSIGNAL);
+            if (n <= 0)
+                throw std::runtime_error("fake::Master: send() failed");
+            buf += n;
+            len -= n;
+        }
+    }
+
+    bool readPacket(std::string& payload)
+    {
+        payload.clear();
+        for (;;) {
+            char header[4];
+            if (!readAll(header, sizeof(header)))
+                return false;
+            const size_t len = getLE(header, 3);
+            m_seq = static_cast<uint8_t>(header[3]) + 1;
+            const size_t pos = payload.size();
+            payload.resize(pos + len);
+            if (!readAll(&payload[pos], len))
+                return false;
+            if (len < max_packet)
+                return true;
+        }
+    }
+
+    void writePacket(const std::string& payload)
+    {
+        size_t pos = 0;
+        for (;;) {
+            const size_t len = std::min(payload.size() - pos, max_packet);
+            std::string header;
+            putLE(header, len, 3);
+            header += static_cast<char>(m_seq++);
+            writeAll(header.data(), header.size());
+            writeAll(payload.data() + pos, len);
+            pos += len;
+            if (len < max_packet)
+                break;
+        }
+    }
+
+    void ok()
+    {
+        std::string p(1, '\0');
+        putLenenc(p, 0);
+        putLenenc(p, 0);
+        putLE(p, m_status, 2);
+        putLE(p, 0, 2);
+        writePacket(p);
+    }
+
+    void eof()
+    {
+        std::string p(1, '\xFE');
+        putLE(p, 0, 2);
+        putLE(p, m_status, 2);
+        writePacket(p);
+    }
+
+    void error(uint16_t code, const std::string& message)
+    {
+        m_failed = true;
+        std::string p(1, '\xFF');
+        putLE(p, code, 2);
+        p += "#HY000";
+        p += message;
+        writePacket(p);
+    }
+
+    void columnDefinition(const std::string& db, const std::string& tbl, const std::string& name,
+                          uint8_t collation, uint32_t length, uint8_t type, uint16_t flags, uint8_t decimals,
+                          bool field_list)
+    {
+        std::string p;
+        putLenencString(p, "def");
+        putLenencString(p, db);
+        putLenencString(p, tbl);
+        putLenencString(p, tbl);
+        putLenencString(p, name);
+        putLenencString(p, name);
+        putLenenc(p, 0x0C);
+        putLE(p, collation, 2);
+        putLE(p, length, 4);
+        putLE(p, type, 1);
+        putLE(p, flags, 2);
+        putLE(p, decimals, 1);
+        putLE(p, 0, 2);
+        if (field_list)
+            p += '\xFB';    // NULL default value
+        writePacket(p);
+    }
+
+    void resultSet(const row_t& names, const std::vector<row_t>& rows)
+    {
+        std::string p;
+        putLenenc(p, names.size());
+        writePacket(p);
+        for (const auto& name : names)
+            columnDefinition("", "", name, utf8_general_ci, 255, MYSQL_TYPE_VAR_STRING, 0, 0, false);
+        eof();
+        for (const auto& row : rows) {
+            p.clear();
+            for (const auto& value : row)
+                putLenencString(p, value);
+            writePacket(p);
+        }
+        eof();
+    }
+
+    void handshake()
+    {
+        m_seq = 0;
+
+        const std::string scramble = "0123456789abcdefghij";
+        std::string p(1, '\x0A');
+        p += m_master.m_options.version;
+        p += '\0';
+        putLE(p, m_fd, 4);
+        p += scramble.substr(0, 8);
+        p += '\0';
+        putLE(p, server_capabilities & 0xFFFF, 2);
+        putLE(p, utf8_general_ci, 1);
+        putLE(p, status_autocommit, 2);
+        putLE(p, server_capabilities >> 16, 2);
+        putLE(p, scramble.size() + 1, 1);
+        p.append(10, '\0');
+        p += scramble.substr(8);
+        p += '\0';
+        p += "mysql_native_password";
+        p += '\0';
+        writePacket(p);
+
+        // Any user and password are accepted
+        std::string response;
+        if (!readPacket(response))
+            throw std::runtime_error("fake::Master: no handshake response");
+        ok();
+    }
+
+    bool command(const std::string& packet)
+    {
+        const std::string arg = packet.substr(1);
+
+        switch (static_cast<uint8_t>(packet[0])) {
+        case COM_QUIT_:
+            return false;
+        case COM_INIT_DB_:
+            m_db = arg;
+            ok();
+            break;
+        case COM_PING_:
+            ok();
+            break;
+        case COM_QUERY_:
+            queries(arg);
+            break;
+        case COM_FIELD_LIST_:
+            fieldList(arg.substr(0, arg.find('\0')));
+            break;
+        case COM_REGISTER_SLAVE_: {
+            if (arg.size() >= 4) {
+                std::lock_guard<std::mutex> lock(m_master.m_mutex);
+                m_master.m_slaves[getLE(arg.data(), 4)] = "127.0.0.1";
+            }
+            ok();
+        }   break;
+        case COM_BINLOG_DUMP_:
+            if (arg.size() < 10) {
+                error(1064, "Malformed COM_BINLOG_DUMP");
+                break;
+            }
+            dump(arg.substr(10), getLE(arg.data(), 4), nullptr);
+            return false;
+        case COM_BINLOG_DUMP_GTID_: {
+            if (arg.size() < 10 || arg.size() < 10 + getLE(arg.data() + 6, 4) + 12) {
+                error(1064, "Malformed COM_BINLOG_DUMP_GTID");
+                break;
+            }
+            const size_t name_len = getLE(arg.data() + 6, 4);
+            const size_t gtid_pos = 10 + name_len + 12;
+            const slave::Position gtids = decodeGtid(arg.data() + gtid_pos, arg.size() - gtid_pos);
+            dump(arg.substr(10, name_len), getLE(arg.data() + 10 + name_len, 8), &gtids);
+            return false;
+        }
+        default:
+            error(1047, "Unknown command");
+            break;
+        }
+        return true;
+    }
+
+    // Statements separated by ';': every result but the last one has SERVER_MORE_RESULTS_EXISTS,
+    // execution stops at the first error
+    void queries(const std::string& q)
+    {
+        std::vector<std::string> statements;
+        bool quoted = false;
+        size_t start = 0;
+        for (size_t i = 0; i <= q.size(); ++i) {
+            if (i < q.size() && q[i] == '\'')
+                quoted = !quoted;
+            if (i == q.size() || (q[i] == ';' && !quoted)) {
+                const size_t b = q.find_first_not_of(" \t\r\n", start);
+                if (b < i)
+                    statements.push_back(q.substr(b, q.find_last_not_of(" \t\r\n", i - 1) + 1 - b));
+                start = i + 1;
+            }
+        }
+        if (statements.empty())
+            statements.push_back(q);
+
+        m_failed = false;
+        for (size_t i = 0; i < statements.size() && !m_failed; ++i) {
+            m_status = status_autocommit | (i + 1 < statements.size() ? status_more_results : 0);
+            query(statements[i]);
+        }
+        m_status = status_autocommit;
+    }
+
+    void query(const std::string& q)
+    {
+        const std::string uq = upper(q);
+
+        if (uq == "SELECT VERSION()") {
+            resultSet({"VERSION()"}, {{m_master.m_options.version}});
+
+        } else if (startsWith(uq, "SHOW GLOBAL VARIABLES LIKE '")) {
+            const std::string name = q.substr(28, q.find('\'', 28) - 28);
+            std::vector<row_t> rows;
+            if (name == "binlog_format")
+                rows.push_back({name, m_master.m_options.binlog_format});
+            else if (name == "gtid_mode")
+                rows.push_back({name, m_master.m_options.gtid_mode ? "ON" : "OFF"});
+            else if (name == "binlog_checksum")
+                rows.push_back({name, m_master.m_options.checksum ? "CRC32" : "NONE"});
+            else if (name == "server_id")
+                rows.push_back({name, std::to_string(m_master.m_options.server_id)});
+            resultSet({"Variable_name", "Value"}, rows);
+
+        } else if (uq == "SHOW MASTER STATUS") {
+            const slave::Position pos = m_master.position();
+            resultSet({"File", "Position", "Binlog_Do_DB", "Binlog_Ignore_DB", "Executed_Gtid_Set"},
+                      {{pos.log_name, std::to_string(pos.log_pos), "", "", pos.strGtid()}});
+
+        } else if (uq == "SHOW SLAVE HOSTS") {
+            std::vector<row_t> rows;
+            {
+                std::lock_guard<std::mutex> lock(m_master.m_mutex);
+                for (const auto& x : m_master.m_slaves)
+                    rows.push_back({std::to_string(x.first), x.second, "0", std::to_string(m_master.m_options.server_id)});
+            }
+            resultSet({"Server_id", "Host", "Port", "Master_id"}, rows);
+
+        } else if (uq == "SHOW CHARACTER SET") {
+            resultSet({"Charset", "Description", "Default collation", "Maxlen"},
+                      {{"binary", "Binary pseudo charset", "binary", "1"},
+                       {"latin1", "cp1252 West European", "latin1_swedish_ci", "1"},
+                       {"utf8", "UTF-8 Unicode", "utf8_general_ci", "3"},
+                       {"utf8mb4", "UTF-8 Unicode", "utf8mb4_general_ci", "4"}});
+
+        } else if (uq == "SHOW COLLATION") {
+            resultSet({"Collation", "Charset", "Id", "Default", "Compiled", "Sortlen"},
+                      {{"binary", "binary", "63", "Yes", "Yes", "1"},
+                       {"latin1_swedish_ci", "latin1", "8", "Yes", "Yes", "1"},
+                       {"utf8_general_ci", "utf8", "33", "Yes", "Yes", "1"},
+                       {"utf8mb4_general_ci", "utf8mb4", "45", "Yes", "Yes", "1"}});
+
+        } else if (startsWith(uq, "SHOW FULL COLUMNS FROM ")) {
+            // SHOW FULL COLUMNS FROM tbl IN db
+            std::istringstream in(q.substr(23));
+            std::string tbl, in_word, db;
+            in >> tbl >> in_word >> db;
+            slave::columns_t columns;
+            if (!m_master.findTable(unquote(db), unquote(tbl), columns)) {
+                error(1146, "Table '" + unquote(db) + "." + unquote(tbl) + "' doesn't exist");
+                return;
+            }
+            std::vector<row_t> rows;
+            for (const auto& c : columns)
+                rows.push_back({c.name, c.type, "", "YES", "", "", "", "select,insert,update,references", ""});
+            resultSet({"Field", "Type", "Collation", "Null", "Key", "Default", "Extra", "Privileges", "Comment"}, rows);
+
+        } else if (startsWith(uq, "SET @MASTER_BINLOG_CHECKSUM")) {
+            m_checksum_var = m_master.m_options.checksum ? "CRC32" : "NONE";
+            ok();
+
+        } else if (uq == "SELECT @MASTER_BINLOG_CHECKSUM") {
+            resultSet({"@master_binlog_checksum"}, {{m_checksum_var}});
+
+        } else if (startsWith(uq, "SET @MASTER_HEARTBEAT_PERIOD")) {
+            const size_t eq = q.find('=');
+            m_heartbeat = std::chrono::nanoseconds(eq == std::string::npos ? 0 : std::stoull(q.substr(eq + 1)));
+            ok();
+
+        } else if (startsWith(uq, "SET ")) {
+            ok();
+
+        } else {
+            error(1064, "fake::Master does not support query: " + q);
+        }
+    }
+
+    void fieldList(const std::string& tbl)
+    {
+        slave::columns_t columns;
+        if (!m_master.findTable(m_db, tbl, columns)) {
+            error(1146, "Table '" + m_db + "." + tbl + "' doesn't exist");
+            return;
+        }
+        for (const auto& c : columns) {
+            const bool text = c.mysql_type == MYSQL_TYPE_STRING || c.mysql_type == MYSQL_TYPE_VAR_STRING
+                           || c.mysql_type == MYSQL_TYPE_VARCHAR || c.mysql_type == MYSQL_TYPE_BLOB;
+            columnDefinition(m_db, tbl, c.name, text ? utf8_general_ci : binary_collation, c.length,
+                             c.mysql_type, c.flags, c.decimals, true);
+        }
+        eof();
+    }
+
+    bool clientGone()
+    {
+        char c;
+        return ::recv(m_fd, &c, 1, MSG_PEEK | MSG_DONTWAIT) == 0;
+    }
+
+    void sendEvent(const std::string& event)
+    {
+        std::string p(1, '\0');
+        p += event;
+        writePacket(p);
+
+        m_last_sent = std::chrono::steady_clock::now();
+        m_sent += p.size();
+        const size_t rate = m_master.m_rate;
+        if (rate) {
+            const auto due = m_started + std::chrono::microseconds(m_sent * 1000000 / rate);
+            std::this_thread::sleep_until(due);
+        }
+
+        size_t left = m_master.m_disconnect_after;
+        while (left && !m_master.m_disconnect_after.compare_exchange_weak(left, left - 1))
+            ;
+        if (left == 1)
+            throw std::runtime_error("fake::Master: disconnect is injected");
+    }
+
+    void dump(const std::string& binlog_name, uint64_t pos, const slave::Position* gtids)
+    {
+        ++m_master.m_dumps;
+        m_started = std::chrono::steady_clock::now();
+        m_last_sent = m_started;
+        m_sent = 0;
+
+        const bool checksum = m_master.m_options.checksum;
+        const uint32_t server_id = m_master.m_options.server_id;
+
+        std::unique_lock<std::mutex> lock(m_master.m_mutex);
+        m_master.m_dump_times.push_back(m_started);
+
+        auto binlog = m_master.m_binlogs.begin();
+        if (gtids || binlog_name.empty()) {
+            pos = binlog_header_size;
+        } else {
+            binlog = std::find_if(m_master.m_binlogs.begin(), m_master.m_binlogs.end(),
+                                  [&binlog_name](const Binlog& b) { return b.name == binlog_name; });
+            if (binlog == m_master.m_binlogs.end() || pos < binlog_header_size || pos > binlog->data.size()) {
+                lock.unlock();
+                error(1236, "Could not find first log file name in binary log index file");
+                return;
+            }
+        }
+
+        // Description of the binlog, which does not move position of slave
+        std::string fde;
+        if (pos > binlog_header_size) {
+            fde = binlog->data.substr(binlog_header_size, binlog->fde_end - binlog_header_size);
+            setLE(fde, LOG_POS_OFFSET, 0, 4);
+            setChecksum(fde);
+        }
+        lock.unlock();
+
+        std::string event = rotateEvent(binlog->name, pos, server_id, log_event_artificial_f);
+        if (checksum)
+            addLenChecksum(event);
+        sendEvent(event);
+        if (m_master.m_drop_dumps)
+            throw std::runtime_error("fake::Master: dump is dropped");
+        if (!fde.empty())
+            sendEvent(fde);
+
+        bool skip = false;
+        slave::Log_event_type last_type = slave::ROTATE_EVENT;
+        for (;;) {
+            lock.lock();
+            m_master.m_cond.wait_for(lock, std::chrono::milliseconds(100), [&]()
+            {
+                return m_master.m_stop || (!m_master.m_stalled
+                    && (pos < binlog->data.size() || std::next(binlog) != m_master.m_binlogs.end()));
+            });
+            if (m_master.m_stop)
+                return;
+
+            if (m_master.m_stalled) {
+                lock.unlock();
+                if (clientGone())
+                    return;
+                continue;
+            } else if (pos < binlog->data.size()) {
+                const size_t len = getLE(binlog->data.data() + pos + EVENT_LEN_OFFSET, 4);
+                event = binlog->data.substr(pos, len);
+                pos += len;
+            } else if (std::next(binlog) != m_master.m_binlogs.end()) {
+                ++binlog;
+                pos = binlog_header_size;
+                // Recorded binlogs may lack ROTATE_EVENT at the end
+                if (last_type == slave::ROTATE_EVENT) {
+                    lock.unlock();
+                    continue;
+                }
+                event = rotateEvent(binlog->name, pos, server_id, log_event_artificial_f);
+                if (checksum)
+                    addLenChecksum(event);
+            } else if (m_heartbeat.count() && std::chrono::steady_clock::now() - m_last_sent >= m_heartbeat) {
+                event = fake::event(slave::HEARTBEAT_LOG_EVENT, binlog->name, 0, server_id);
+                setLE(event, LOG_POS_OFFSET, pos, 4);
+                setLE(event, flags_offset, log_event_artificial_f, 2);
+                if (checksum)
+                    addLenChecksum(event);
+                lock.unlock();
+                sendEvent(event);
+                continue;
+            } else {
+                lock.unlock();
+                if (clientGone())
+                    return;
+                continue;
+            }
+            lock.unlock();
+
+            if (gtids) {
+                const slave::Log_event_type type = eventType(event);
+                if (type == slave::GTID_LOG_EVENT)
+                    skip = gtids->hasGtid(gtidOf(event));
+                else if (type == slave::ANONYMOUS_GTID_LOG_EVENT)
+                    skip = false;
+                if (skip && type != slave::ROTATE_EVENT && type != slave::FORMAT_DESCRIPTION_EVENT
+                         && type != slave::PREVIOUS_GTIDS_LOG_EVENT && type != slave::STOP_EVENT)
+                    continue;
+            }
+            last_type = eventType(event);
+            sendEvent(event);
+        }
+    }
+
+    Master&     m_master;
+    const int   m_fd;
+    uint8_t     m_seq = 0;
+    uint16_t    m_status = status_autocommit;
+    bool        m_failed = false;
+    std::string m_db;
+    std::string m_checksum_var;
+    // @master_heartbeat_period, 0 - disabled
+    std::chrono::nanoseconds m_heartbeat {0};
+    std::chrono::steady_clock::time_point m_last_sent;
+
+    std::chrono::steady_clock::time_point m_started;
+    size_t      m_sent = 0;
+};
+
+Master::Master() : Master(Options()) {}
+
+Master::Master(const Options& options) : m_options(options)
+{
+    startBinlog(m_options.binlog_name);
+
+    m_listen_fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (m_listen_fd < 0)
+        throw std::runtime_error("fake::Master: socket() failed");
+
+    const int on = 1;
+    ::setsockopt(m_listen_fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+    sockaddr_in addr;
+    ::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t addr_len = sizeof(addr);
+    if (::bind(m_listen_fd, (sockaddr*)&addr, sizeof(addr)) != 0
+        || ::listen(m_listen_fd, 16) != 0
+        || ::getsockname(m_listen_fd, (sockaddr*)&addr, &addr_len) != 0)
+    {
+        ::close(m_listen_fd);
+        throw std::runtime_error("fake::Master: could not listen on 127.0.0.1");
+    }
+    m_port = ntohs(addr.sin_port);
+
+    m_accept_thread = std::thread(&Master::acceptLoop, this);
+}
+
+Master::~Master()
+{
+    stop();
+}
+
+void Master::stop()
+{
+    m_stop = true;
+    ::shutdown(m_listen_fd, SHUT_RDWR);
+    if (m_accept_thread.joinable())
+        m_accept_thread.join();
+    ::close(m_listen_fd);
+
+    disconnect();
+    m_cond.notify_all();
+
+    std::vector<std::thread> sessions;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        sessions.swap(m_sessions);
+    }
+    for (auto& t : sessions)
+        t.join();
+}
+
+void Master::acceptLoop()
+{
+    while (!m_stop) {
+        const int fd = ::accept(m_listen_fd, nullptr, nullptr);
+        if (fd < 0) {
+            if (m_stop)
+                break;
+            continue;
+        }
+
+        ++m_connections;
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_clients.insert(fd);
+        m_sessions.emplace_back([this, fd]()
+        {
+            Session(*this, fd).run();
+
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_clients.erase(fd);
+            ::close(fd);
+        });
+    }
+}
+
+void Master::disconnect()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (int fd : m_clients)
+        ::shutdown(fd, SHUT_RDWR);
+}
+
+bool Master::findTable(const std::string& db, const std::string& tbl, slave::columns_t& columns) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    const auto it = m_tables.find(std::make_pair(db, tbl));
+    if (it == m_tables.end())
+        return false;
+    columns = it->second;
+    return true;
+}
+
+void Master::addTable(const std::string& db, const std::string& tbl, const slave::columns_t& columns)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_tables[std::make_pair(db, tbl)] = columns;
+}
+
+void Master::startBinlog(const std::string& name)
+{
+    m_binlogs.emplace_back();
+    Binlog& binlog = m_binlogs.back();
+    binlog.name = name;
+    binlog.data = binlog_magic;
+
+    std::string fde = formatDescriptionEvent(m_options.version, m_options.server_id, m_options.checksum);
+    setLE(fde, EVENT_LEN_OFFSET, fde.size() + 4, 4);
+    setLE(fde, LOG_POS_OFFSET, binlog.data.size() + fde.size() + 4, 4);
+    addChecksum(fde);
+    binlog.data += fde;
+    binlog.fde_end = binlog.data.size();
+
+    if (m_options.gtid_mode) {
+        std::string body;
+        putLE(body, 0, 8);
+        appendLocked(fake::event(slave::PREVIOUS_GTIDS_LOG_EVENT, body, 0, m_options.server_id));
+    }
+}
+
+void Master::appendLocked(std::string event)
+{
+    if (event.size() < LOG_EVENT_HEADER_LEN)
+        throw std::runtime_error("fake::Master::append(): event is shorter than its header");
+
+    Binlog& binlog = m_binlogs.back();
+    const size_t len = event.size() + (m_options.checksum ? 4 : 0);
+    setLE(event, EVENT_LEN_OFFSET, len, 4);
+    setLE(event, LOG_POS_OFFSET, binlog.data.size() + len, 4);
+    if (m_options.checksum)
+        addChecksum(event);
+    if (m_corrupt_next.exchange(false))
+        event.back() ^= 1;
+    binlog.data += event;
+
+    if (eventType(event) == slave::GTID_LOG_EVENT) {
+        slave::Position pos;
+        pos.gtid_executed.swap(m_gtid_executed);
+        pos.addGtid(gtidOf(event));
+        m_gtid_executed.swap(pos.gtid_executed);
+    }
+}
+
+void Master::append(const std::string& event)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        appendLocked(event);
+    }
+    m_cond.notify_all();
+}
+
+void Master::rotate(const std::string& binlog_name)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        appendLocked(rotateEvent(binlog_name, binlog_header_size, m_options.server_id, 0));
+        startBinlog(binlog_name);
+    }
+    m_cond.notify_all();
+}
+
+void Master::load(const std::string& path, const std::string& binlog_name)
+{
+    std::ifstream f(path.c_str(), std::ios::binary);
+    if (!f)
+        throw std::runtime_error("fake::Master::load(): can't open '" + path + "'");
+
+    Binlog binlog;
+    binlog.name = binlog_name;
+    binlog.data.assign(std::istreambuf_iterator<char>(f), std::istreambuf_iterator<char>());
+    if (binlog.data.compare(0, binlog_header_size, binlog_magic, binlog_header_size) != 0)
+        throw std::runtime_error("fake::Master::load(): '" + path + "' is not a binlog");
+    binlog.fde_end = binlog_header_size;
+    if (binlog.data.size() >= binlog_header_size + LOG_EVENT_HEADER_LEN)
+        binlog.fde_end += getLE(binlog.data.data() + binlog_header_size + EVENT_LEN_OFFSET, 4);
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_binlogs.push_back(std::move(binlog));
+    }
+    m_cond.notify_all();
+}
+
+slave::Position Master::position() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    slave::Position result(m_binlogs.back().name, m_binlogs.back().data.size());
+    result.gtid_executed = m_gtid_executed;
+    return result;
+}
+
+std::vector<std::chrono::steady_clock::time_point> Master::dumpTimes() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_dump_times;
+}
+
+}// fake
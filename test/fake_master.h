@@ -0,0 +1,140 @@
+// In-process server, which speaks enough of MySQL protocol to be a master for libslave:
+// handshake, the queries issued by Slave, COM_REGISTER_SLAVE, COM_BINLOG_DUMP and
+// COM_BINLOG_DUMP_GTID. Binlogs are generated with append() or loaded from files.
+// Idle dump connections send HEARTBEAT_LOG_EVENT if @master_heartbeat_period is set.
+
+#ifndef __SLAVE_FAKE_MASTER_H_
+#define __SLAVE_FAKE_MASTER_H_
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <list>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "binlog_pos.h"
+#include "schema_cache.h"
+#include "slave_log_event.h"
+
+namespace fake
+{
+
+// Event with 19-byte header. Length and position in the header are set by Master::append().
+std::string event(slave::Log_event_type type, const std::string& body, uint32_t when = 1500000000, uint32_t server_id = 1);
+std::string queryEvent(const std::string& db, const std::string& query);
+std::string xidEvent(uint64_t xid);
+// sid is 32 hex digits, as in slave::gtid_t
+std::string gtidEvent(const slave::gtid_t& gtid);
+
+class Master
+{
+public:
+
+    struct Options
+    {
+        std::string version       = "5.7.30-log";
+        std::string binlog_format = "ROW";
+        bool        gtid_mode     = false;
+        bool        checksum      = true;   // binlog_checksum=CRC32
+        uint32_t    server_id     = 1;
+        std::string binlog_name   = "mysql-bin.000001";
+    };
+
+    Master();
+    explicit Master(const Options& options);
+    ~Master();
+
+    Master(const Master&) = delete;
+    Master& operator= (const Master&) = delete;
+
+    // Listens on 127.0.0.1, port is chosen by the system
+    unsigned short port() const { return m_port; }
+
+    // Table for SHOW FULL COLUMNS and COM_FIELD_LIST
+    void addTable(const std::string& db, const std::string& tbl, const slave::columns_t& columns);
+
+    // Appends event to the current binlog: its length and log_pos are set and checksum is added.
+    // Dump threads waiting for new events are woken up.
+    void append(const std::string& event);
+    // The next appended event gets a wrong checksum
+    void corruptNext() { m_corrupt_next = true; }
+    // Finishes the current binlog with ROTATE_EVENT and starts a new one
+    void rotate(const std::string& binlog_name);
+    // Adds recorded binlog file, it is served as is and becomes the current one
+    void load(const std::string& path, const std::string& binlog_name);
+
+    // Limits speed of every dump connection, 0 - unlimited
+    void setRate(size_t bytes_per_second) { m_rate = bytes_per_second; }
+    // Closes dump connection after the given number of events are sent, once
+    void disconnectAfter(size_t events) { m_disconnect_after = events; }
+    // Closes every dump connection right after the fake ROTATE_EVENT, as a master which fails
+    // to read its binlog
+    void dropDumps(bool on) { m_drop_dumps = on; }
+    // Closes all client connections
+    void disconnect();
+    // Dump connections stay open, but send neither events nor heartbeats, as a hung master
+    void stall(bool on) { m_stalled = on; }
+
+    // Position after the last event, with GTIDs of all appended transactions
+    slave::Position position() const;
+    // Number of COM_BINLOG_DUMP and COM_BINLOG_DUMP_GTID requests
+    size_t dumps() const { return m_dumps; }
+    // Times of COM_BINLOG_DUMP and COM_BINLOG_DUMP_GTID requests
+    std::vector<std::chrono::steady_clock::time_point> dumpTimes() const;
+    // Number of accepted client connections
+    size_t connections() const { return m_connections; }
+
+    class Session;
+
+private:
+
+    friend class Session;
+
+    struct Binlog
+    {
+        std::string name;
+        std::string data;
+        // Offset after FORMAT_DESCRIPTION_EVENT
+        size_t      fde_end = 0;
+    };
+
+    bool findTable(const std::string& db, const std::string& tbl, slave::columns_t& columns) const;
+    void acceptLoop();
+    void startBinlog(const std::string& name);
+    void appendLocked(std::string event);
+    void stop();
+
+    const Options m_options;
+
+    int                 m_listen_fd = -1;
+    unsigned short      m_port = 0;
+    std::thread         m_accept_thread;
+    std::atomic<bool>   m_stop{false};
+
+    mutable std::mutex      m_mutex;
+    std::condition_variable m_cond;
+    std::list<Binlog>       m_binlogs;
+    slave::gtid_set_t       m_gtid_executed;
+    std::map<std::pair<std::string, std::string>, slave::columns_t> m_tables;
+    std::map<uint32_t, std::string> m_slaves;
+    std::set<int>           m_clients;
+    std::vector<std::thread> m_sessions;
+    std::vector<std::chrono::steady_clock::time_point> m_dump_times;
+
+    std::atomic<size_t> m_rate{0};
+    std::atomic<size_t> m_disconnect_after{0};
+    std::atomic<bool>   m_stalled{false};
+    std::atomic<bool>   m_drop_dumps{false};
+    std::atomic<bool>   m_corrupt_next{false};
+    std::atomic<size_t> m_dumps{0};
+    std::atomic<size_t> m_connections{0};
+};
+
+}// fake
+
+#endif
@@ -7,19 +7,37 @@ using namespace boost::unit_test;
 #include <boost/mpl/list.hpp>
 #include <boost/optional.hpp>
 
+#include <atomic>
 #include <cfloat>
+#include <chrono>
 #include <cmath>
 #include <condition_variable>
 #include <cstddef>  // for std::nullptr_t
 #include <fstream>
 #include <functional>
 #include <iostream>
+#include <limits>
 #include <mutex>
 #include <thread>
 
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#ifdef SLAVE_WITH_ZSTD
+#include <zstd.h>
+#endif
+
 #include "Slave.h"
+#include "binlog_stream.h"
+#include "slave_group.h"
+#include "checksum.h"
+#include "event_filter.h"
+#include "fake_master.h"
+#include "row_binding.h"
 #include "nanomysql.h"
 #include "types.h"
+#include "tz_table.h"
 
 namespace std
 {
@@ -187,6 +205,8 @@ namespace // anonymous
             uint64_t events_other              = 0;
             uint64_t events_modify             = 0;
             uint64_t rows_modify               = 0;
+            uint64_t reconnects                = 0;
+            unsigned failed_connects           = 0;
 
             struct Counter
             {
@@ -262,6 +282,12 @@ namespace // anonymous
                 map_kind[kind].row_done    += time;
                 map_detailed[key].row_done += time;
             }
+
+            void tickReconnect(uint64_t, unsigned failed) override
+            {
+                ++reconnects;
+                failed_connects += failed;
+            }
         };
 
         config cfg;
@@ -1712,6 +1738,1788 @@ namespace // anonymous
         BOOST_CHECK_EQUAL(ref2.size(), 1);
         BOOST_CHECK(ref2.front() == slave::gtid_interval_t(2, 2));
     }
+
+    void test_SchemaCache()
+    {
+        const std::string path = "/tmp/libslave_schema_cache." + std::to_string(::getpid());
+        const auto key = std::make_pair(std::string("test"), std::string("test"));
+
+        slave::columns_t columns(2);
+        columns[0].name = "id";
+        columns[0].type = "int(11)";
+        columns[0].mysql_type = 3;
+        columns[0].length = 11;
+        columns[1].name = "value";
+        columns[1].type = "varchar(50)";
+        columns[1].mysql_type = 253;
+        columns[1].length = 150;
+
+        const std::vector<unsigned char> types = {3, 15};
+        const std::vector<unsigned char> metadata = {150, 0};
+        const uint64_t fingerprint = slave::columnsFingerprint(columns);
+        {
+            slave::SchemaCache cache(path);
+            BOOST_CHECK(!cache.load());
+            cache.put(key, columns, slave::SchemaPoint());
+            BOOST_CHECK(cache.dirty());
+            BOOST_CHECK(cache.checkSignature(key, fingerprint, false, types, metadata));
+            cache.save();
+            BOOST_CHECK(!cache.dirty());
+        }
+        {
+            slave::SchemaCache cache(path);
+            BOOST_CHECK(cache.load());
+            const slave::SchemaCache::Entry* entry = cache.find(key, slave::Position());
+            BOOST_REQUIRE(entry);
+            BOOST_CHECK_EQUAL(entry->fingerprint, fingerprint);
+            BOOST_CHECK_EQUAL(entry->columns.size(), 2);
+            BOOST_CHECK_EQUAL(entry->columns[1].name, "value");
+            BOOST_CHECK_EQUAL(entry->columns[1].length, 150);
+            BOOST_CHECK(cache.checkSignature(key, fingerprint, false, types, metadata));
+            BOOST_CHECK(!cache.dirty());
+            BOOST_CHECK(!cache.checkSignature(key, fingerprint, false, {3, 15, 3}, {150, 0}));
+
+            // ALTER at mysql-bin.000002:1000 adds a version, old one stays for earlier positions
+            auto altered = columns;
+            altered[1].length = 300;
+            const slave::SchemaPoint alter("mysql-bin.000002", 1000, slave::gtid_t());
+            cache.put(key, altered, alter);
+            cache.save();
+        }
+        {
+            slave::SchemaCache cache(path);
+            BOOST_CHECK(cache.load());
+
+            const slave::SchemaPoint alter("mysql-bin.000002", 1000, slave::gtid_t());
+            BOOST_REQUIRE(cache.find(key, alter));
+            BOOST_CHECK_EQUAL(cache.find(key, alter)->columns[1].length, 300);
+
+            const slave::SchemaCache::Entry* entry = cache.find(key, slave::Position("mysql-bin.000002", 4));
+            BOOST_REQUIRE(entry);
+            BOOST_CHECK_EQUAL(entry->fingerprint, fingerprint);
+            entry = cache.find(key, slave::Position("mysql-bin.000002", 1000));
+            BOOST_REQUIRE(entry);
+            BOOST_CHECK_EQUAL(entry->columns[1].length, 300);
+            entry = cache.find(key, slave::Position());
+            BOOST_REQUIRE(entry);
+            BOOST_CHECK_EQUAL(entry->columns[1].length, 300);
+
+            // Position after ALTER does not need the old version any more
+            cache.prune(slave::Position("mysql-bin.000003", 4));
+            BOOST_CHECK(!cache.find(key, slave::Position("mysql-bin.000002", 4)));
+
+            // Nothing is remembered for the new version: TABLE_MAP is checked against its columns
+            auto altered = columns;
+            altered[1].length = 600;
+            cache.put(key, altered, alter);
+            BOOST_CHECK(!cache.checkSignature(key, slave::columnsFingerprint(altered), false, types, metadata));
+        }
+        ::unlink(path.c_str());
+
+        slave::columns_t all(6);
+        all[0].type = "decimal(10,2) unsigned";
+        all[0].mysql_type = MYSQL_TYPE_NEWDECIMAL;
+        all[0].length = 11;
+        all[0].decimals = 2;
+        all[0].flags = UNSIGNED_FLAG;
+        all[1].type = "char(100)";
+        all[1].mysql_type = MYSQL_TYPE_STRING;
+        all[1].length = 400;
+        all[2].type = "enum('a','it''s')";
+        all[2].mysql_type = MYSQL_TYPE_STRING;
+        all[2].flags = ENUM_FLAG;
+        all[3].type = "mediumtext";
+        all[3].mysql_type = MYSQL_TYPE_BLOB;
+        all[3].length = 50331645;
+        all[4].type = "datetime(3)";
+        all[4].mysql_type = MYSQL_TYPE_DATETIME;
+        all[4].decimals = 3;
+        all[5].type = "bit(10)";
+        all[5].mysql_type = MYSQL_TYPE_BIT;
+        all[5].length = 10;
+
+        std::vector<unsigned char> all_types, all_metadata;
+        slave::tableMapSignature(all, false, all_types, all_metadata);
+        BOOST_CHECK(all_types == std::vector<unsigned char>({246, 254, 254, 252, 18, 16}));
+        BOOST_CHECK(all_metadata == std::vector<unsigned char>({10, 2, 254 ^ 0x10, 144, 247, 1, 3, 3, 2, 1}));
+        slave::tableMapSignature(all, true, all_types, all_metadata);
+        BOOST_CHECK_EQUAL(all_types[4], MYSQL_TYPE_DATETIME);
+        BOOST_CHECK_EQUAL(all_metadata.size(), 9);
+    }
+
+    void test_SharedSchemas()
+    {
+        const auto table = [](const char* name, const slave::PtrTableSchema& schema)
+        {
+            return slave::PtrTable(new slave::Table("test", name, schema));
+        };
+
+        slave::RelayLogInfo rli;
+        auto schema = std::make_shared<slave::TableSchema>();
+        schema->fingerprint = 1;
+        rli.setSchema(schema);
+        rli.setTable("a", "test", table("a", schema));
+        rli.setTable("b", "test", table("b", schema));
+        schema.reset();
+
+        // Structure is kept while any table uses it
+        rli.eraseTable(std::make_pair(std::string("test"), std::string("a")));
+        BOOST_CHECK_EQUAL(rli.m_schemas.size(), 1);
+
+        auto altered = std::make_shared<slave::TableSchema>();
+        altered->fingerprint = 2;
+        rli.setSchema(altered);
+        rli.setTable("b", "test", table("b", altered));
+        altered.reset();
+        BOOST_REQUIRE_EQUAL(rli.m_schemas.size(), 1);
+        BOOST_CHECK_EQUAL(rli.m_schemas.begin()->first, 2);
+
+        rli.eraseTable(std::make_pair(std::string("test"), std::string("b")));
+        BOOST_CHECK(rli.m_schemas.empty());
+    }
+
+    void test_TablePattern()
+    {
+        const auto key = [](const char* db, const char* tbl) { return std::make_pair(std::string(db), std::string(tbl)); };
+
+        const slave::TablePattern shards("shop_*", "orders");
+        BOOST_CHECK(shards.hasWildcards());
+        BOOST_CHECK(shards.match(key("shop_001", "orders")));
+        BOOST_CHECK(shards.match(key("shop_", "orders")));
+        BOOST_CHECK(!shards.match(key("shop", "orders")));
+        BOOST_CHECK(!shards.match(key("shop_001", "orders_archive")));
+
+        const slave::TablePattern audit("*", "*_log");
+        BOOST_CHECK(audit.match(key("test", "audit_log")));
+        BOOST_CHECK(!audit.match(key("test", "audit_logs")));
+
+        const slave::TablePattern glob("db_??", "orders_*_2*");
+        BOOST_CHECK(glob.match(key("db_01", "orders_eu_2019")));
+        BOOST_CHECK(glob.match(key("db_01", "orders_eu_x_2")));
+        BOOST_CHECK(!glob.match(key("db_001", "orders_eu_2019")));
+        BOOST_CHECK(!glob.match(key("db_01", "orders_eu")));
+
+        BOOST_CHECK(!slave::TablePattern("test", "test").hasWildcards());
+    }
+
+    void test_TzTable()
+    {
+        const slave::TzTable& tz = slave::TzTable::local();
+        size_t hint = 0;
+
+        // Every ~1 hour 7 seconds over TIMESTAMP range, so that all hours and days are seen
+        for (int64_t t = 0; t < std::numeric_limits<int32_t>::max(); t += 3607)
+        {
+            const time_t ts = t;
+            struct tm tm_;
+            ::localtime_r(&ts, &tm_);
+            BOOST_REQUIRE_EQUAL(tz.offset(t, hint), tm_.tm_gmtoff);
+
+            const int64_t local = t + tm_.tm_gmtoff;
+            int year;
+            unsigned month, day;
+            slave::civilFromDays(local >= 0 ? local / 86400 : (local - 86399) / 86400, year, month, day);
+            BOOST_REQUIRE_EQUAL(year, tm_.tm_year + 1900);
+            BOOST_REQUIRE_EQUAL(month, tm_.tm_mon + 1);
+            BOOST_REQUIRE_EQUAL(day, tm_.tm_mday);
+        }
+    }
+
+    void test_DecimalModes()
+    {
+        // 1234567890.1234 and -1234567890.1234 as DECIMAL(14,4), see dec_util.h
+        const unsigned char pos[] = {0x81, 0x0D, 0xFB, 0x38, 0xD2, 0x04, 0xD2};
+        const unsigned char neg[] = {0x7E, 0xF2, 0x04, 0xC7, 0x2D, 0xFB, 0x2D};
+
+        slave::Field_decimal scaled("a", "decimal(14,4)", 16, 4, false, slave::DecimalMode::Scaled);
+        scaled.unpack((const char*)pos);
+        BOOST_CHECK_EQUAL(slave::get<int64_t>(scaled.field_data), 12345678901234LL);
+        scaled.unpack((const char*)neg);
+        BOOST_CHECK_EQUAL(slave::get<int64_t>(scaled.field_data), -12345678901234LL);
+
+        slave::Field_decimal dbl("a", "decimal(14,4)", 16, 4, false, slave::DecimalMode::Double);
+        dbl.unpack((const char*)neg);
+        BOOST_CHECK_CLOSE(slave::get<double>(dbl.field_data), -1234567890.1234, 1e-12);
+
+        slave::Field_decimal str("a", "decimal(14,4)", 16, 4, false);
+        str.unpack((const char*)neg);
+        BOOST_CHECK_EQUAL(slave::get<std::string>(str.field_data), "-1234567890.1234");
+    }
+
+    void test_TemporalPacked()
+    {
+        // 2011-03-13 as stored in binlog: day | month << 5 | year << 9
+        const uint32_t date = 13 | 3 << 5 | 2011 << 9;
+        const unsigned char raw[] = {uint8_t(date), uint8_t(date >> 8), uint8_t(date >> 16)};
+
+        slave::Field_date field("a", "date", slave::TemporalMode::Packed);
+        field.unpack((const char*)raw);
+        BOOST_CHECK_EQUAL(slave::get<slave::types::MY_DATE>(field.field_data), date);
+
+        struct tm t;
+        ::memset(&t, 0, sizeof(t));
+        t.tm_year = 2011 - 1900;
+        t.tm_mon = 2;
+        t.tm_mday = 13;
+        BOOST_CHECK_EQUAL(slave::types::date2epoch(date), ::timegm(&t));
+
+        t.tm_hour = 9;
+        t.tm_min = 49;
+        t.tm_sec = 9;
+        BOOST_CHECK_EQUAL(slave::types::datetime2epoch(20110313094909ULL), ::timegm(&t));
+
+        BOOST_CHECK_EQUAL(slave::types::datetime2epoch(0), 0);
+        BOOST_CHECK_EQUAL(slave::types::date2epoch(1 | 1 << 5 | 1970 << 9), 0);
+
+        // TIME(6) is stored as packed value + 0x800000000000, the packed value is negated for negative time
+        slave::Field_time time("t", "time(6)", 6, false, slave::TemporalMode::Packed);
+        time.unpack("\x7F\xFF\xFF\xF8\x5E\xE0");          // -00:00:00.500000
+        auto value = slave::get<slave::types::Time>(time.field_data);
+        BOOST_CHECK_EQUAL(value.time, 0);
+        BOOST_CHECK_EQUAL(value.usec, 500000);
+        BOOST_CHECK(value.neg);
+
+        time.unpack("\x80\x00\x00\x07\xA1\x20");          // 00:00:00.500000
+        value = slave::get<slave::types::Time>(time.field_data);
+        BOOST_CHECK_EQUAL(value.usec, 500000);
+        BOOST_CHECK(!value.neg);
+
+        time.unpack("\x7F\xEF\x7C\xF8\x5E\xE0");          // -01:02:03.500000
+        value = slave::get<slave::types::Time>(time.field_data);
+        BOOST_CHECK_EQUAL(value.time, -10203);
+        BOOST_CHECK_EQUAL(value.usec, 500000);
+        BOOST_CHECK(value.neg);
+    }
+
+    void test_EnumOrdinal()
+    {
+        const char two = 2;
+
+        slave::Field_enum enum_field("a", "enum('new','paid','it''s')", slave::EnumMode::Ordinal);
+        enum_field.unpack(&two);
+        const auto e = slave::get<slave::types::Enum>(enum_field.field_data);
+        BOOST_CHECK_EQUAL(e.ordinal, 2);
+        BOOST_REQUIRE(e.label());
+        BOOST_CHECK_EQUAL(*e.label(), "paid");
+        BOOST_CHECK_EQUAL(e.labels->back(), "it's");
+        BOOST_CHECK(!slave::types::Enum({4, e.labels}).label());
+        BOOST_CHECK(!slave::types::Enum({0, e.labels}).label());
+
+        const char five = 5;
+        slave::Field_set set_field("a", "set('a','b','c')", slave::EnumMode::Ordinal);
+        set_field.unpack(&five);
+        const auto x = slave::get<slave::types::Set>(set_field.field_data);
+        BOOST_CHECK_EQUAL(x.bits, 5);
+        BOOST_CHECK_EQUAL(x.labels->size(), 3);
+
+        slave::Field_set set_string("a", "set('a','b','c')");
+        set_string.unpack(&five);
+        BOOST_CHECK_EQUAL(slave::get<std::string>(set_string.field_data), "a,c");
+    }
+
+    // {"a": 1, "bb": [true, "x"]}: small object with inlined int16 and small array
+    const char json_doc[] = {
+        0x00, 0x02, 0x00, 0x21, 0x00,       // object, 2 members, 33 bytes
+        0x12, 0x00, 0x01, 0x00,             // key "a" at 18
+        0x13, 0x00, 0x02, 0x00,             // key "bb" at 19
+        0x05, 0x01, 0x00,                   // int16 1
+        0x02, 0x15, 0x00,                   // array at 21
+        'a', 'b', 'b',
+        0x02, 0x00, 0x0C, 0x00,             // array, 2 elements, 12 bytes
+        0x04, 0x01, 0x00,                   // true
+        0x0C, 0x0A, 0x00,                   // string at 10
+        0x01, 'x'
+    };
+
+    void test_JsonBinary()
+    {
+        const slave::json::Value v(json_doc, sizeof(json_doc));
+        BOOST_REQUIRE_EQUAL(v.type(), slave::json::Value::Object);
+        BOOST_CHECK_EQUAL(v.size(), 2);
+        BOOST_CHECK_EQUAL(v.key(1), "bb");
+        BOOST_CHECK_EQUAL(v.toString(), "{\"a\": 1, \"bb\": [true, \"x\"]}");
+
+        BOOST_CHECK_EQUAL(v.path("$.a").getInt(), 1);
+        BOOST_CHECK_EQUAL(v.path("$.bb[1]").getString(), "x");
+        BOOST_CHECK(v.path("$.\"bb\"[0]").getBool());
+        BOOST_CHECK_EQUAL(v.path("$").toString(), v.toString());
+        BOOST_CHECK(!v.path("$.c").valid());
+        BOOST_CHECK(!v.path("$.bb[2]").valid());
+        BOOST_CHECK(!v.path("$.a.b").valid());
+        BOOST_CHECK_THROW(v.path("a"), std::runtime_error);
+
+        // Truncated document
+        BOOST_CHECK(!slave::json::Value(json_doc, 20).valid());
+
+        const char negative[] = {0x05, '\xFE', '\xFF'};
+        BOOST_CHECK_EQUAL(slave::json::Value(negative, sizeof(negative)).getInt(), -2);
+
+        const char string[] = {0x0C, 0x03, 'a', '"', '\n'};
+        BOOST_CHECK_EQUAL(slave::json::Value(string, sizeof(string)).toString(), "\"a\\\"\\n\"");
+
+        char one[9] = {0x0B};
+        const double d = 1;
+        ::memcpy(one + 1, &d, sizeof(d));
+        BOOST_CHECK_EQUAL(slave::json::Value(one, sizeof(one)).toString(), "1.0");
+
+        // Field gives text by default, view on request
+        const char field[] = {sizeof(json_doc), 0, 0, 0};
+        std::string row(field, sizeof(field));
+        row.append(json_doc, sizeof(json_doc));
+
+        slave::Field_json text("j", "json");
+        BOOST_CHECK_EQUAL(text.unpack(row.data()), row.data() + row.size());
+        BOOST_CHECK_EQUAL(slave::get<std::string>(text.field_data), v.toString());
+
+        slave::Field_json view("j", "json", slave::JsonMode::View);
+        view.unpack(row.data());
+        BOOST_CHECK_EQUAL(slave::get<slave::json::Value>(view.field_data).path("$.bb[1]").getString(), "x");
+    }
+
+    void test_JsonPartialUpdate()
+    {
+        const char diffs[] = {
+            0x00, 0x03, '$', '.', 'a', 0x03, 0x05, 0x05, 0x00,                          // replace $.a with 5
+            0x01, 0x07, '$', '.', 'b', 'b', '[', '0', ']', 0x03, 0x0C, 0x01, 'y',      // insert "y" into $.bb[0]
+            0x01, 0x03, '$', '.', 'c', 0x02, 0x04, 0x00,                                // insert $.c = null
+            0x02, 0x07, '$', '.', 'b', 'b', '[', '2', ']'                               // remove $.bb[2]
+        };
+
+        slave::json::Diffs parsed;
+        slave::json::parseDiffs(diffs, sizeof(diffs), parsed);
+        BOOST_REQUIRE_EQUAL(parsed.size(), 4);
+        BOOST_CHECK_EQUAL(parsed[1].operation, slave::json::Diff::Insert);
+        BOOST_CHECK_EQUAL(parsed[1].path, "$.bb[0]");
+        BOOST_CHECK_EQUAL(parsed[1].value.getString(), "y");
+        BOOST_CHECK(!parsed[3].value.valid());
+
+        const slave::json::Value doc(json_doc, sizeof(json_doc));
+        BOOST_CHECK_EQUAL(slave::json::applyDiffs(doc, parsed), "{\"a\": 5, \"c\": null, \"bb\": [\"y\", true]}");
+
+        parsed.resize(1);
+        parsed[0].path = "$.d";
+        BOOST_CHECK_THROW(slave::json::applyDiffs(doc, parsed), std::runtime_error);
+        BOOST_CHECK_THROW(slave::json::parseDiffs(diffs, 7, parsed), std::runtime_error);
+
+        // Before image, then after image with diffs
+        const char doc_length[] = {sizeof(json_doc), 0, 0, 0};
+        std::string before(doc_length, sizeof(doc_length));
+        before.append(json_doc, sizeof(json_doc));
+        const char diffs_length[] = {sizeof(diffs), 0, 0, 0};
+        std::string after(diffs_length, sizeof(diffs_length));
+        after.append(diffs, sizeof(diffs));
+
+        slave::Field_json field("j", "json");
+        field.unpack(before.data());
+        BOOST_CHECK_EQUAL(field.unpack_diffs(after.data()), after.data() + after.size());
+        BOOST_CHECK_EQUAL(slave::get<slave::json::Diffs>(field.field_data).size(), 4);
+
+        slave::Field_json apply("j", "json", slave::JsonMode::Text, slave::PartialJsonMode::Apply);
+        apply.unpack(before.data());
+        apply.unpack_diffs(after.data());
+        BOOST_CHECK_EQUAL(slave::get<std::string>(apply.field_data), "{\"a\": 5, \"c\": null, \"bb\": [\"y\", true]}");
+    }
+
+    // Event with common header and body of given size filled with its type
+    std::string makeEvent(slave::Log_event_type type, uint32_t body)
+    {
+        std::string event(LOG_EVENT_HEADER_LEN + body, static_cast<char>(type));
+        const uint32_t header[] = {1, 0, LOG_EVENT_HEADER_LEN + body, 0};
+        ::memcpy(&event[0], &header[0], 4);
+        event[EVENT_TYPE_OFFSET] = type;
+        ::memcpy(&event[SERVER_ID_OFFSET], &header[1], 4);
+        ::memcpy(&event[EVENT_LEN_OFFSET], &header[2], 4);
+        ::memcpy(&event[LOG_POS_OFFSET], &header[3], 4);
+        return event;
+    }
+
+    std::string makePayloadEvent(const std::string& payload, unsigned char compression, size_t uncompressed)
+    {
+        std::string body;
+        const auto field = [&body](unsigned char type, uint32_t value)
+        {
+            body += type;
+            if (value < 251)
+            {
+                body += '\x01';
+                body += static_cast<char>(value);
+            }
+            else
+            {
+                body += '\x04';
+                body += '\xFD';
+                body.append(reinterpret_cast<const char*>(&value), 3);
+            }
+        };
+        field(1, payload.size());
+        field(2, compression);
+        field(3, uncompressed);
+        body += '\x00';
+        body += payload;
+
+        std::string event = makeEvent(slave::TRANSACTION_PAYLOAD_EVENT, body.size());
+        event.replace(LOG_EVENT_HEADER_LEN, body.size(), body);
+        return event;
+    }
+
+    void test_TransactionPayload()
+    {
+        // Large event does not fit into one decompression chunk
+        const std::string events = makeEvent(slave::QUERY_EVENT, 10)
+                                 + makeEvent(slave::WRITE_ROWS_EVENT, 300000)
+                                 + makeEvent(slave::XID_EVENT, 8);
+
+        slave::TransactionPayload reader;
+        std::vector<std::pair<int, unsigned>> got;
+        const auto collect = [&got](const char* buf, unsigned int len)
+        {
+            bool filled = true;
+            for (unsigned i = LOG_EVENT_HEADER_LEN; i < len; ++i)
+                filled = filled && buf[i] == buf[EVENT_TYPE_OFFSET];
+            BOOST_CHECK(filled);
+            got.emplace_back(buf[EVENT_TYPE_OFFSET], len);
+        };
+        const std::vector<std::pair<int, unsigned>> expected = {
+            {slave::QUERY_EVENT, LOG_EVENT_HEADER_LEN + 10},
+            {slave::WRITE_ROWS_EVENT, LOG_EVENT_HEADER_LEN + 300000},
+            {slave::XID_EVENT, LOG_EVENT_HEADER_LEN + 8}
+        };
+
+        const std::string plain = makePayloadEvent(events, 255, 0);
+        reader.read(plain.data(), plain.size(), collect);
+        BOOST_CHECK(got == expected);
+        BOOST_CHECK_EQUAL(reader.lastCompressed(), events.size());
+        BOOST_CHECK_EQUAL(reader.lastUncompressed(), events.size());
+
+        const std::string truncated = makePayloadEvent(events.substr(0, 100), 255, 0);
+        BOOST_CHECK_THROW(reader.read(truncated.data(), truncated.size(), collect), std::runtime_error);
+
+#ifdef SLAVE_WITH_ZSTD
+        std::string compressed(ZSTD_compressBound(events.size()), '\0');
+        compressed.resize(ZSTD_compress(&compressed[0], compressed.size(), events.data(), events.size(), 3));
+        const std::string zstd = makePayloadEvent(compressed, 0, events.size());
+
+        // Twice, the second one reuses decompression context and buffer
+        for (int i = 0; i < 2; ++i)
+        {
+            got.clear();
+            reader.read(zstd.data(), zstd.size(), collect);
+            BOOST_CHECK(got == expected);
+            BOOST_CHECK_EQUAL(reader.lastCompressed(), compressed.size());
+            BOOST_CHECK_EQUAL(reader.lastUncompressed(), events.size());
+        }
+        BOOST_CHECK_EQUAL(reader.uncompressedBytes(), 3 * events.size());
+
+        const std::string broken = makePayloadEvent(compressed.substr(0, compressed.size() / 2), 0, events.size());
+        BOOST_CHECK_THROW(reader.read(broken.data(), broken.size(), collect), std::runtime_error);
+#else
+        const std::string zstd = makePayloadEvent(events, 0, events.size());
+        BOOST_CHECK_THROW(reader.read(zstd.data(), zstd.size(), collect), std::runtime_error);
+#endif
+    }
+    // Bitwise CRC32 of zlib
+    uint32_t crc32Reference(const unsigned char* data, size_t len)
+    {
+        uint32_t crc = 0xFFFFFFFF;
+        for (size_t i = 0; i < len; ++i)
+        {
+            crc ^= data[i];
+            for (int k = 0; k < 8; ++k)
+                crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+        }
+        return ~crc;
+    }
+
+    void test_Crc32()
+    {
+        BOOST_CHECK_EQUAL(slave::crc32(0, (const unsigned char*)"123456789", 9), 0xCBF43926);
+
+        std::vector<unsigned char> data(100000);
+        uint32_t x = 1;
+        for (auto& c : data)
+        {
+            x = x * 1103515245 + 12345;
+            c = x >> 16;
+        }
+
+        // Unaligned starts and tails of every length around the folding block
+        for (size_t offset = 0; offset < 16; ++offset)
+            for (size_t len = 0; len < 300; ++len)
+                BOOST_CHECK_EQUAL(slave::crc32(0, &data[offset], len), crc32Reference(&data[offset], len));
+        BOOST_CHECK_EQUAL(slave::crc32(0, data.data(), data.size()), crc32Reference(data.data(), data.size()));
+
+        // Continued computation
+        const uint32_t head = slave::crc32(0, data.data(), 1000);
+        BOOST_CHECK_EQUAL(slave::crc32(head, &data[1000], 5000), crc32Reference(data.data(), 6000));
+
+        std::string event(1000, 'x');
+        const uint32_t crc = htole32(slave::crc32(0, (const unsigned char*)event.data(), event.size()));
+        event.append(reinterpret_cast<const char*>(&crc), sizeof(crc));
+
+        slave::AsyncChecksum async;
+        for (int i = 0; i < 100; ++i)
+            async.push(event.data(), event.size());
+        BOOST_CHECK_NO_THROW(async.sync());
+
+        std::string broken = event;
+        broken[10] = 'y';
+        async.push(event.data(), event.size());
+        async.push(broken.data(), broken.size());
+        async.push(event.data(), event.size());
+        BOOST_CHECK_THROW(async.sync(), std::runtime_error);
+        // Failure is reported once
+        async.push(event.data(), event.size());
+        BOOST_CHECK_NO_THROW(async.sync());
+    }
+    void test_EventFilter()
+    {
+        const auto header = [](slave::Log_event_type type, unsigned int server_id, time_t when)
+        {
+            slave::Basic_event_info info;
+            info.type = type;
+            info.server_id = server_id;
+            info.when = when;
+            return info;
+        };
+
+        slave::EventFilter filter;
+        BOOST_CHECK(filter.empty());
+
+        filter.denyServerId(2);
+        filter.denyType(slave::ROWS_QUERY_LOG_EVENT);
+        filter.setTimeWindow(1000, 2000);
+        filter.denyGtids("3e11fa47-71ca-11e1-9e33-c80aa9429562:10-20");
+        BOOST_CHECK(!filter.empty());
+
+        BOOST_CHECK(filter.accept(header(slave::WRITE_ROWS_EVENT, 1, 1500)));
+        BOOST_CHECK(!filter.accept(header(slave::WRITE_ROWS_EVENT, 2, 1500)));
+        BOOST_CHECK(!filter.accept(header(slave::ROWS_QUERY_LOG_EVENT, 1, 1500)));
+        BOOST_CHECK(!filter.accept(header(slave::WRITE_ROWS_EVENT, 1, 999)));
+        BOOST_CHECK(!filter.accept(header(slave::WRITE_ROWS_EVENT, 1, 2000)));
+        // Position and structure are tracked for every server
+        BOOST_CHECK(filter.accept(header(slave::XID_EVENT, 2, 1500)));
+        BOOST_CHECK(filter.accept(header(slave::ROTATE_EVENT, 2, 0)));
+        BOOST_CHECK(filter.accept(header(slave::QUERY_EVENT, 2, 1500)));
+
+        const std::string sid = "3e11fa4771ca11e19e33c80aa9429562";
+        filter.beginTransaction({sid, 15});
+        BOOST_CHECK(!filter.accept(header(slave::TABLE_MAP_EVENT, 1, 1500)));
+        BOOST_CHECK(filter.accept(header(slave::XID_EVENT, 1, 1500)));
+        filter.beginTransaction({sid, 21});
+        BOOST_CHECK(filter.accept(header(slave::TABLE_MAP_EVENT, 1, 1500)));
+        filter.beginTransaction({sid, 10});
+        BOOST_CHECK(filter.accept(header(slave::ANONYMOUS_GTID_LOG_EVENT, 1, 1500)));
+        BOOST_CHECK(filter.accept(header(slave::TABLE_MAP_EVENT, 1, 1500)));
+
+        slave::EventFilter allow;
+        allow.allowServerId(1);
+        allow.allowServerId(3);
+        allow.allowGtids("3e11fa47-71ca-11e1-9e33-c80aa9429562:1-5");
+        allow.add([](const slave::Basic_event_info& info) { return info.type != slave::DELETE_ROWS_EVENT; });
+        BOOST_CHECK(allow.accept(header(slave::WRITE_ROWS_EVENT, 3, 0)));
+        BOOST_CHECK(!allow.accept(header(slave::WRITE_ROWS_EVENT, 2, 0)));
+        BOOST_CHECK(!allow.accept(header(slave::DELETE_ROWS_EVENT, 1, 0)));
+        allow.beginTransaction({sid, 6});
+        BOOST_CHECK(!allow.accept(header(slave::WRITE_ROWS_EVENT, 1, 0)));
+        allow.beginTransaction({sid, 5});
+        BOOST_CHECK(allow.accept(header(slave::WRITE_ROWS_EVENT, 1, 0)));
+    }
+    struct Order
+    {
+        int64_t            id;
+        boost::string_view sku;
+        uint32_t           qty;
+        std::string        note;
+    };
+
+    void test_RowBinding()
+    {
+        auto schema = std::make_shared<slave::TableSchema>();
+        schema->fields.emplace_back(new slave::Field_num<longlong>("id", "bigint(20)"));
+        schema->fields.emplace_back(new slave::Field_num<int32>("skipped", "int(11)"));
+        schema->fields.emplace_back(new slave::Field_string("sku", "varchar(300)", 300));
+        schema->fields.emplace_back(new slave::Field_num<uint32, 3>("qty", "mediumint(8) unsigned"));
+        schema->fields.emplace_back(new slave::Field_blob("note", "text", 65535));
+        for (unsigned i = 0; i < schema->fields.size(); ++i)
+            schema->field_index[schema->fields[i]->field_name] = i;
+        const slave::Table table("shop", "orders", schema);
+
+        std::vector<slave::BoundRow<Order>> got;
+        slave::RowBinding<Order> binding([&got](const slave::BoundRow<Order>& row) { got.push_back(row); });
+        binding.column("id", &Order::id).column("sku", &Order::sku).column("qty", &Order::qty).column("note", &Order::note);
+        const auto binder = binding.bind(table);
+
+        // All columns are present, note is NULL
+        std::string image("\x10", 1);
+        image.append("\xFE\xFF\xFF\xFF\xFF\xFF\xFF\xFF", 8);      // -2
+        image.append("\x07\x00\x00\x00", 4);
+        image.append("\x05\x00" "ab-12", 7);                      // 2-byte length of varchar(300)
+        image.append("\x40\x42\x0F", 3);                           // 1000000
+        const std::vector<unsigned char> cols = {0x1F};
+
+        unsigned char* end = binder->unpack(5, (unsigned char*)&image[0], cols, false);
+        BOOST_CHECK_EQUAL(size_t((const char*)end - image.data()), image.size());
+        binder->call(slave::RecordSet::Write, 100, 3);
+
+        BOOST_REQUIRE_EQUAL(got.size(), 1);
+        BOOST_CHECK_EQUAL(got[0].row.id, -2);
+        BOOST_CHECK_EQUAL(got[0].row.sku, "ab-12");
+        BOOST_CHECK_EQUAL(got[0].row.qty, 1000000);
+        BOOST_CHECK(got[0].row.note.empty());
+        BOOST_CHECK_EQUAL(got[0].type_event, slave::RecordSet::Write);
+        BOOST_CHECK_EQUAL(got[0].when, 100);
+        BOOST_CHECK_EQUAL(got[0].master_id, 3);
+
+        // Minimal image: only id and note
+        std::string minimal("\x00", 1);
+        minimal.append("\x01\x00\x00\x00\x00\x00\x00\x00", 8);
+        minimal.append("\x03\x00" "abc", 5);
+        end = binder->unpack(5, (unsigned char*)&minimal[0], {0x11}, true);
+        BOOST_CHECK_EQUAL(size_t((const char*)end - minimal.data()), minimal.size());
+        binder->call(slave::RecordSet::Update, 101, 3);
+
+        BOOST_REQUIRE_EQUAL(got.size(), 2);
+        BOOST_CHECK_EQUAL(got[1].old_row.id, 1);
+        BOOST_CHECK_EQUAL(got[1].old_row.note, "abc");
+        BOOST_CHECK_EQUAL(got[1].old_row.qty, 0);
+        BOOST_CHECK_EQUAL(got[1].type_event, slave::RecordSet::Update);
+
+        // Checked against structure
+        slave::RowBinding<Order> wrong_type([](const slave::BoundRow<Order>&) {});
+        wrong_type.column("id", &Order::note);
+        BOOST_CHECK_THROW(wrong_type.bind(table), std::runtime_error);
+
+        slave::RowBinding<Order> wrong_name([](const slave::BoundRow<Order>&) {});
+        wrong_name.column("price", &Order::qty);
+        BOOST_CHECK_THROW(wrong_name.bind(table), std::runtime_error);
+
+        // bigint does not fit into uint32_t
+        slave::RowBinding<Order> narrowing([](const slave::BoundRow<Order>&) {});
+        narrowing.column("id", &Order::qty);
+        BOOST_CHECK_THROW(narrowing.bind(table), std::runtime_error);
+
+        // Values of other fields are checked against their type for the column options
+        struct Event
+        {
+            std::string          created;
+            slave::types::MY_DATE day;
+            uint8_t              flags;
+        };
+        auto dates = std::make_shared<slave::TableSchema>();
+        dates->fields.emplace_back(new slave::Field_datetime("created", "datetime", 0, false));
+        dates->fields.emplace_back(new slave::Field_date("day", "date", slave::TemporalMode::Packed));
+        dates->fields.emplace_back(new slave::Field_num<uint16, 1>("flags", "tinyint(3) unsigned"));
+        for (unsigned i = 0; i < dates->fields.size(); ++i)
+            dates->field_index[dates->fields[i]->field_name] = i;
+        const slave::Table events("shop", "events", dates);
+
+        slave::RowBinding<Event> matching([](const slave::BoundRow<Event>&) {});
+        matching.column("created", &Event::created).column("day", &Event::day).column("flags", &Event::flags);
+        BOOST_CHECK(matching.bind(events));
+
+        slave::RowBinding<Event> wrong_mode([](const slave::BoundRow<Event>&) {});
+        wrong_mode.column("day", &Event::created);
+        BOOST_CHECK_THROW(wrong_mode.bind(events), std::runtime_error);
+    }
+
+    void testFakeMaster(bool native_reader)
+    {
+        fake::Master master;
+
+        slave::columns_t columns(2);
+        columns[0].name = "id";
+        columns[0].type = "int(11)";
+        columns[0].mysql_type = MYSQL_TYPE_LONG;
+        columns[0].length = 11;
+        columns[1].name = "name";
+        columns[1].type = "varchar(20)";
+        columns[1].mysql_type = MYSQL_TYPE_VAR_STRING;
+        columns[1].length = 60;
+        master.addTable("test", "fake", columns);
+
+        // TABLE_MAP of (int, varchar(20) utf8) and WRITE_ROWS of one row
+        std::string table_map("\x01\x00\x00\x00\x00\x00" "\x01\x00", 8);
+        table_map.append("\x04" "test" "\x00" "\x04" "fake" "\x00", 12);
+        table_map.append("\x02" "\x03\x0F" "\x02" "\x3C\x00" "\x00", 7);
+        const auto transaction = [&master, &table_map](int32_t id, const std::string& name)
+        {
+            std::string rows("\x01\x00\x00\x00\x00\x00" "\x01\x00" "\x02\x00" "\x02" "\x03" "\x00", 13);
+            rows.append((const char*)&id, 4);
+            rows += static_cast<char>(name.size());
+            rows += name;
+
+            master.append(fake::queryEvent("test", "BEGIN"));
+            master.append(fake::event(slave::TABLE_MAP_EVENT, table_map));
+            master.append(fake::event(slave::WRITE_ROWS_EVENT, rows));
+            master.append(fake::xidEvent(id));
+        };
+        transaction(1, "one");
+        transaction(2, "two");
+
+        std::mutex mutex;
+        std::condition_variable cond;
+        std::vector<std::pair<int32_t, std::string>> got;
+
+        Fixture::TestExtState ext_state;
+        ext_state.setMasterPosition(slave::Position("mysql-bin.000001", 4));
+
+        slave::MasterInfo master_info;
+        master_info.conn_options.mysql_host = "127.0.0.1";
+        master_info.conn_options.mysql_port = master.port();
+        master_info.conn_options.mysql_user = "root";
+        master_info.native_reader = native_reader;
+        master_info.read_size = 256 * 1024;
+        master_info.socket_rcvbuf = 1 << 20;
+
+        slave::Slave slave(master_info, ext_state);
+        slave.setCallback("test", "fake", [&](slave::RecordSet& rs)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            got.emplace_back(boost::any_cast<int32_t>(rs.m_row.at("id")), boost::any_cast<std::string>(rs.m_row.at("name")));
+            cond.notify_all();
+        });
+        slave.init();
+        slave.createDatabaseStructure();
+        // Startup queries share one connection
+        BOOST_CHECK_EQUAL(master.connections(), 1);
+
+        std::atomic<bool> stop(false);
+        std::thread thread([&]()
+        {
+            slave.get_remote_binlog([&stop]() { return stop.load(); });
+            mysql_thread_end();
+        });
+
+        const auto wait = [&](size_t count)
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            return cond.wait_for(lock, std::chrono::seconds(5), [&]() { return got.size() >= count; });
+        };
+
+        BOOST_CHECK(wait(2));
+        BOOST_CHECK_EQUAL(master.connections(), 2);
+
+        // Events are appended while slave waits for them. Connection is broken after WRITE_ROWS
+        // of the last transaction, slave reconnects and reads its XID.
+        master.disconnectAfter(7);
+        transaction(3, "three");
+        transaction(4, "four");
+        BOOST_CHECK(wait(4));
+
+        for (size_t i = 0; i < 500 && ext_state.getIntransactionPos() != master.position().log_pos; ++i)
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        BOOST_CHECK_EQUAL(ext_state.getIntransactionPos(), master.position().log_pos);
+        BOOST_CHECK_EQUAL(master.dumps(), 2);
+        BOOST_CHECK_EQUAL(master.connections(), 3);
+
+        stop = true;
+        slave.close_connection();
+        thread.join();
+
+        // Lost control connection is opened again
+        master.disconnect();
+        BOOST_CHECK_EQUAL(slave.getLastBinlogPos().log_pos, master.position().log_pos);
+        BOOST_CHECK_EQUAL(master.connections(), 4);
+
+        BOOST_REQUIRE_EQUAL(got.size(), 4);
+        BOOST_CHECK_EQUAL(got[0].first, 1);
+        BOOST_CHECK_EQUAL(got[0].second, "one");
+        BOOST_CHECK_EQUAL(got[1].first, 2);
+        BOOST_CHECK_EQUAL(got[2].first, 3);
+        BOOST_CHECK_EQUAL(got[3].first, 4);
+        BOOST_CHECK_EQUAL(got[3].second, "four");
+    }
+
+    void test_FakeMaster()
+    {
+        testFakeMaster(false);
+    }
+
+    void test_NativeReader()
+    {
+        testFakeMaster(true);
+    }
+
+    void test_NanomysqlCursor()
+    {
+        int i = 0;
+        uint64_t u = 0;
+        double d = 0;
+        BOOST_CHECK(nanomysql::parse_number("-2147483648", i) && i == std::numeric_limits<int>::min());
+        BOOST_CHECK(!nanomysql::parse_number("2147483648", i));
+        BOOST_CHECK(nanomysql::parse_number("18446744073709551615", u) && u == std::numeric_limits<uint64_t>::max());
+        BOOST_CHECK(!nanomysql::parse_number("-1", u));
+        BOOST_CHECK(!nanomysql::parse_number("", i));
+        BOOST_CHECK(!nanomysql::parse_number("12a", i));
+        BOOST_CHECK(nanomysql::parse_number("1.5e3", d) && d == 1500);
+
+        fake::Master master;
+        slave::columns_t columns(2);
+        columns[0].name = "id";
+        columns[0].type = "int(11)";
+        columns[1].name = "name";
+        columns[1].type = "varchar(20)";
+        master.addTable("test", "fake", columns);
+
+        nanomysql::mysql_conn_opts opts;
+        opts.mysql_host = "127.0.0.1";
+        opts.mysql_port = master.port();
+        opts.mysql_user = "root";
+        nanomysql::Connection conn(opts);
+
+        conn.query("SHOW FULL COLUMNS FROM fake IN test");
+        {
+            nanomysql::Cursor cur = conn.cursor();
+            BOOST_CHECK_EQUAL(cur.size(), 9);
+            BOOST_CHECK_EQUAL(cur.find("Nonexistent"), nanomysql::Cursor::npos);
+            BOOST_CHECK_THROW(cur.index("Nonexistent"), std::runtime_error);
+            const size_t field = cur.index("Field");
+            const size_t type = cur.index("Type");
+
+            BOOST_REQUIRE(cur.next());
+            BOOST_CHECK_EQUAL(cur[field], "id");
+            BOOST_CHECK_EQUAL(cur[type], "int(11)");
+            BOOST_CHECK(!cur.is_null(field));
+            BOOST_CHECK_THROW(cur.as<int>(field), std::runtime_error);
+            BOOST_REQUIRE(cur.next());
+            BOOST_CHECK_EQUAL(cur[field], "name");
+            BOOST_CHECK(!cur.next());
+        }
+
+        // Not read rows are skipped, the connection is usable after
+        conn.query("SHOW CHARACTER SET");
+        {
+            nanomysql::Cursor cur = conn.cursor();
+            BOOST_REQUIRE(cur.next());
+        }
+        conn.query("SHOW CHARACTER SET");
+        std::map<std::string, int> maxlen;
+        {
+            nanomysql::Cursor cur = conn.cursor();
+            const size_t charset = cur.index("Charset");
+            const size_t len = cur.index("Maxlen");
+            while (cur.next())
+                maxlen[cur[charset].to_string()] = cur.as<int>(len);
+        }
+        BOOST_CHECK_EQUAL(maxlen.size(), 4);
+        BOOST_CHECK_EQUAL(maxlen["utf8mb4"], 4);
+
+        // Map interface goes through the cursor as well
+        conn.query("SHOW GLOBAL VARIABLES LIKE 'server_id'");
+        unsigned server_id = 0;
+        conn.use([&server_id](const nanomysql::fields_t& row) { server_id = row.at("Value"); });
+        BOOST_CHECK_EQUAL(server_id, 1);
+    }
+
+    void test_BinlogStream()
+    {
+        const auto packet = [](const std::string& payload)
+        {
+            const size_t n = payload.size();
+            std::string s;
+            s += static_cast<char>(n & 0xFF);
+            s += static_cast<char>((n >> 8) & 0xFF);
+            s += static_cast<char>((n >> 16) & 0xFF);
+            s += '\0';
+            return s + payload;
+        };
+
+        // Packet of 16M is followed by its continuation
+        std::string big(0xFFFFFF, 'a');
+        const std::string wire = packet("one") + packet(big) + packet("tail") + packet("two");
+        big += "tail";
+
+        int fds[2];
+        BOOST_REQUIRE_EQUAL(::socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+        std::thread writer([&wire, &fds]()
+        {
+            // Header of the first packet comes in pieces
+            size_t pos = 0;
+            for (; pos < 6; ++pos)
+            {
+                BOOST_CHECK_EQUAL(::write(fds[1], &wire[pos], 1), 1);
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            while (pos < wire.size())
+            {
+                const ssize_t n = ::write(fds[1], wire.data() + pos, wire.size() - pos);
+                if (n <= 0)
+                    break;
+                pos += n;
+            }
+            ::close(fds[1]);
+        });
+
+        slave::BinlogStream stream(4096);
+        std::vector<std::string> got;
+        bool closed = false;
+        while (!closed)
+        {
+            BOOST_REQUIRE(slave::BinlogStream::wait(fds[0], 5000));
+
+            const auto status = stream.fill(fds[0]);
+            closed = status == slave::BinlogStream::Status::Closed;
+            const char* data;
+            size_t size;
+            while (stream.next(data, size))
+                got.emplace_back(data, size);
+        }
+        writer.join();
+        ::close(fds[0]);
+
+        BOOST_REQUIRE_EQUAL(got.size(), 3);
+        BOOST_CHECK_EQUAL(got[0], "one");
+        BOOST_CHECK(got[1] == big);
+        BOOST_CHECK_EQUAL(got[2], "two");
+
+        BOOST_REQUIRE_EQUAL(::socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+        BOOST_CHECK(!slave::BinlogStream::wait(fds[0], 10));
+        ::close(fds[0]);
+        ::close(fds[1]);
+    }
+
+    void test_NonBlocking()
+    {
+        fake::Master master;
+
+        slave::columns_t columns(1);
+        columns[0].name = "id";
+        columns[0].type = "int(11)";
+        columns[0].mysql_type = MYSQL_TYPE_LONG;
+        columns[0].length = 11;
+        master.addTable("test", "fake", columns);
+
+        std::string table_map("\x01\x00\x00\x00\x00\x00" "\x01\x00", 8);
+        table_map.append("\x04" "test" "\x00" "\x04" "fake" "\x00", 12);
+        table_map.append("\x01" "\x03" "\x00" "\x00", 4);
+        const auto transaction = [&master, &table_map](int32_t id)
+        {
+            std::string rows("\x01\x00\x00\x00\x00\x00" "\x01\x00" "\x02\x00" "\x01" "\x01" "\x00", 13);
+            rows.append((const char*)&id, 4);
+
+            master.append(fake::queryEvent("test", "BEGIN"));
+            master.append(fake::event(slave::TABLE_MAP_EVENT, table_map));
+            master.append(fake::event(slave::WRITE_ROWS_EVENT, rows));
+            master.append(fake::xidEvent(id));
+        };
+        for (int32_t id = 1; id <= 10; ++id)
+            transaction(id);
+
+        Fixture::TestExtState ext_state;
+        ext_state.setMasterPosition(slave::Position("mysql-bin.000001", 4));
+
+        slave::MasterInfo master_info;
+        master_info.conn_options.mysql_host = "127.0.0.1";
+        master_info.conn_options.mysql_port = master.port();
+        master_info.conn_options.mysql_user = "root";
+
+        std::vector<int32_t> got;
+        slave::Slave slave(master_info, ext_state);
+        slave.setCallback("test", "fake", [&got](slave::RecordSet& rs)
+        {
+            got.push_back(boost::any_cast<int32_t>(rs.m_row.at("id")));
+        });
+        slave.init();
+        slave.createDatabaseStructure();
+
+        BOOST_CHECK_EQUAL(slave.binlog_fd(), -1);
+        slave.open_remote_binlog();
+        BOOST_REQUIRE(slave.binlog_fd() >= 0);
+        BOOST_REQUIRE(slave.cancel_fd() >= 0);
+
+        // Event loop of one stream, events are handled 3 at a time
+        const auto loop = [&](size_t count)
+        {
+            for (int i = 0; i < 500 && got.size() < count; ++i)
+            {
+                pollfd p[2] = {{slave.binlog_fd(), POLLIN, 0}, {slave.cancel_fd(), POLLIN, 0}};
+                ::poll(p, 2, 10);
+                if (p[1].revents)
+                    return false;
+                while (slave.pump(3) == 3) {}
+            }
+            return got.size() >= count;
+        };
+        BOOST_CHECK(loop(10));
+
+        // Lost connection is reported by pump(), reading is resumed from the saved position
+        master.disconnect();
+        BOOST_CHECK_THROW(loop(11), std::runtime_error);
+        BOOST_CHECK_EQUAL(slave.binlog_fd(), -1);
+        transaction(11);
+        slave.open_remote_binlog();
+        BOOST_CHECK(loop(11));
+        BOOST_CHECK_EQUAL(master.dumps(), 2);
+
+        // Cancel from another thread wakes up the loop
+        std::thread([&slave]() { slave.cancel(); }).join();
+        transaction(12);
+        BOOST_CHECK(!loop(12));
+        BOOST_CHECK_EQUAL(slave.pump(100), 0);
+        slave.close_remote_binlog();
+
+        BOOST_REQUIRE_EQUAL(got.size(), 11);
+        for (int32_t id = 1; id <= 11; ++id)
+            BOOST_CHECK_EQUAL(got[id - 1], id);
+    }
+    void test_SlaveGroup()
+    {
+        slave::columns_t columns(1);
+        columns[0].name = "id";
+        columns[0].type = "int(11)";
+        columns[0].mysql_type = MYSQL_TYPE_LONG;
+        columns[0].length = 11;
+
+        std::string table_map("\x01\x00\x00\x00\x00\x00" "\x01\x00", 8);
+        table_map.append("\x04" "test" "\x00" "\x04" "fake" "\x00", 12);
+        table_map.append("\x01" "\x03" "\x00" "\x00", 4);
+        const auto transaction = [&table_map](fake::Master& master, int32_t id)
+        {
+            std::string rows("\x01\x00\x00\x00\x00\x00" "\x01\x00" "\x02\x00" "\x01" "\x01" "\x00", 13);
+            rows.append((const char*)&id, 4);
+
+            master.append(fake::queryEvent("test", "BEGIN"));
+            master.append(fake::event(slave::TABLE_MAP_EVENT, table_map));
+            master.append(fake::event(slave::WRITE_ROWS_EVENT, rows));
+            master.append(fake::xidEvent(id));
+        };
+
+        const size_t count = 2;
+        fake::Master masters[count];
+        Fixture::TestExtState ext_states[count];
+        std::unique_ptr<slave::Slave> slaves[count];
+        std::mutex mutex;
+        std::vector<int32_t> got[count];
+
+        slave::SlaveGroup group(1, 2);
+        group.setBudget(3);
+        for (size_t i = 0; i < count; ++i)
+        {
+            masters[i].addTable("test", "fake", columns);
+            for (int32_t id = 1; id <= 10; ++id)
+                transaction(masters[i], id);
+            ext_states[i].setMasterPosition(slave::Position("mysql-bin.000001", 4));
+
+            slave::MasterInfo master_info;
+            master_info.conn_options.mysql_host = "127.0.0.1";
+            master_info.conn_options.mysql_port = masters[i].port();
+            master_info.conn_options.mysql_user = "root";
+            master_info.connect_retry = 1;
+
+            slaves[i].reset(new slave::Slave(master_info, ext_states[i]));
+            slaves[i]->setCallback("test", "fake", [&mutex, &got, i](slave::RecordSet& rs)
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                got[i].push_back(boost::any_cast<int32_t>(rs.m_row.at("id")));
+            });
+            group.add(*slaves[i]);
+            slaves[i]->init();
+            slaves[i]->createDatabaseStructure();
+        }
+        BOOST_CHECK_EQUAL(group.size(), count);
+        // Same table of both masters has one set of column definitions
+        BOOST_CHECK_EQUAL(group.schemaPool()->size(), 1);
+
+        const auto wait = [&](size_t rows)
+        {
+            for (int i = 0; i < 500; ++i)
+            {
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    if (got[0].size() >= rows && got[1].size() >= rows)
+                        return true;
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            }
+            return false;
+        };
+
+        group.start();
+        BOOST_CHECK(wait(10));
+        BOOST_CHECK_EQUAL(group.connected(), count);
+
+        // Lost master is reopened after connect_retry, the other one keeps streaming
+        masters[0].disconnect();
+        for (size_t i = 0; i < count; ++i)
+            transaction(masters[i], 11);
+        BOOST_CHECK(wait(11));
+        BOOST_CHECK_EQUAL(masters[0].dumps(), 2);
+        BOOST_CHECK_EQUAL(masters[1].dumps(), 1);
+
+        group.stop();
+        BOOST_CHECK_EQUAL(group.connected(), 0);
+        for (size_t i = 0; i < count; ++i)
+        {
+            BOOST_CHECK_EQUAL(slaves[i]->binlog_fd(), -1);
+            BOOST_REQUIRE_EQUAL(got[i].size(), 11);
+            for (int32_t id = 1; id <= 11; ++id)
+                BOOST_CHECK_EQUAL(got[i][id - 1], id);
+        }
+    }
+    void test_Reconnect()
+    {
+        // First retry is immediate, then delays double with jitter up to the limit
+        slave::Backoff backoff(std::chrono::milliseconds(100), std::chrono::milliseconds(1000));
+        BOOST_CHECK_EQUAL(backoff.next().count(), 0);
+        for (int64_t limit : {100, 200, 400, 800, 1000, 1000})
+        {
+            const int64_t delay = backoff.next().count();
+            BOOST_CHECK_GE(delay, limit / 2);
+            BOOST_CHECK_LE(delay, limit);
+        }
+        BOOST_CHECK_EQUAL(backoff.attempt(), 7);
+        backoff.reset();
+        BOOST_CHECK_EQUAL(backoff.next().count(), 0);
+
+        fake::Master master;
+
+        slave::columns_t columns(1);
+        columns[0].name = "id";
+        columns[0].type = "int(11)";
+        columns[0].mysql_type = MYSQL_TYPE_LONG;
+        columns[0].length = 11;
+        master.addTable("test", "fake", columns);
+
+        std::string table_map("\x01\x00\x00\x00\x00\x00" "\x01\x00", 8);
+        table_map.append("\x04" "test" "\x00" "\x04" "fake" "\x00", 12);
+        table_map.append("\x01" "\x03" "\x00" "\x00", 4);
+        const auto transaction = [&master, &table_map](int32_t id)
+        {
+            std::string rows("\x01\x00\x00\x00\x00\x00" "\x01\x00" "\x02\x00" "\x01" "\x01" "\x00", 13);
+            rows.append((const char*)&id, 4);
+
+            master.append(fake::queryEvent("test", "BEGIN"));
+            master.append(fake::event(slave::TABLE_MAP_EVENT, table_map));
+            master.append(fake::event(slave::WRITE_ROWS_EVENT, rows));
+            master.append(fake::xidEvent(id));
+        };
+        transaction(1);
+
+        Fixture::TestExtState ext_state;
+        ext_state.setMasterPosition(slave::Position("mysql-bin.000001", 4));
+        Fixture::TestSlaveStat stat;
+
+        slave::MasterInfo master_info;
+        master_info.conn_options.mysql_host = "127.0.0.1";
+        master_info.conn_options.mysql_port = master.port();
+        master_info.conn_options.mysql_user = "root";
+        master_info.heartbeat_period = 1;
+
+        std::vector<int32_t> got;
+        slave::Slave slave(master_info, ext_state);
+        slave.linkEventStat(&stat);
+        // Exception of callback is not a connection problem
+        slave.setCallback("test", "fake", [&got](slave::RecordSet& rs)
+        {
+            got.push_back(boost::any_cast<int32_t>(rs.m_row.at("id")));
+            if (got.back() == 1)
+                throw std::runtime_error("callback failed");
+        });
+        slave.init();
+        slave.createDatabaseStructure();
+        slave.open_remote_binlog();
+
+        const auto loop = [&](std::chrono::milliseconds duration)
+        {
+            const auto end = std::chrono::steady_clock::now() + duration;
+            while (std::chrono::steady_clock::now() < end)
+            {
+                pollfd p = {slave.binlog_fd(), POLLIN, 0};
+                ::poll(&p, 1, 50);
+                slave.pump(100);
+            }
+        };
+
+        // Idle master sends heartbeats, connection is kept
+        loop(std::chrono::milliseconds(2500));
+        BOOST_CHECK_EQUAL(got.size(), 1);
+        BOOST_CHECK(stat.events_other > 0);
+        BOOST_CHECK(!slave.stalled());
+
+        // Hung master is detected after 2 heartbeat periods
+        master.stall(true);
+        transaction(2);
+        const auto stalled_at = std::chrono::steady_clock::now();
+        BOOST_CHECK_THROW(loop(std::chrono::milliseconds(5000)), std::runtime_error);
+        BOOST_CHECK(std::chrono::steady_clock::now() - stalled_at >= std::chrono::seconds(2));
+        BOOST_CHECK_EQUAL(slave.binlog_fd(), -1);
+        BOOST_CHECK(!slave.stalled());
+
+        master.stall(false);
+        slave.open_remote_binlog();
+        loop(std::chrono::milliseconds(500));
+        slave.close_remote_binlog();
+
+        BOOST_CHECK_EQUAL(master.dumps(), 2);
+        BOOST_CHECK_EQUAL(stat.reconnects, 1);
+        BOOST_CHECK_EQUAL(stat.failed_connects, 0);
+        BOOST_REQUIRE_EQUAL(got.size(), 2);
+        BOOST_CHECK_EQUAL(got[1], 2);
+
+        // Master accepts dumps, but drops them right after the fake rotate: it is not
+        // a restored connection, so delays between dumps grow
+        fake::Master dropping;
+        dropping.addTable("test", "fake", columns);
+        dropping.dropDumps(true);
+
+        Fixture::TestExtState dropping_state;
+        dropping_state.setMasterPosition(slave::Position("mysql-bin.000001", 4));
+        Fixture::TestSlaveStat dropping_stat;
+
+        master_info.conn_options.mysql_port = dropping.port();
+        master_info.heartbeat_period = 0;
+        master_info.reconnect_initial_ms = 40;
+        master_info.connect_retry = 10;
+
+        std::atomic<size_t> rows(0);
+        slave::Slave reconnecting(master_info, dropping_state);
+        reconnecting.linkEventStat(&dropping_stat);
+        reconnecting.setCallback("test", "fake", [&rows](slave::RecordSet&) { ++rows; });
+        reconnecting.init();
+        reconnecting.createDatabaseStructure();
+
+        std::atomic<bool> stop(false);
+        std::thread thread([&]()
+        {
+            reconnecting.get_remote_binlog([&stop]() { return stop.load(); });
+            mysql_thread_end();
+        });
+
+        for (size_t i = 0; i < 300 && dropping.dumps() < 6; ++i)
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        const auto times = dropping.dumpTimes();
+        BOOST_REQUIRE_GE(times.size(), 6);
+        // Retry after the first drop is immediate, then [d/2, d] with d = 40, 80, 160, 320 ms
+        for (size_t i = 2; i < 6; ++i)
+            BOOST_CHECK(times[i] - times[i - 1] >= std::chrono::milliseconds(20 << (i - 2)));
+        BOOST_CHECK(times[5] - times[4] > times[2] - times[1]);
+
+        // Backoff is reset by a real event of the dump, which stays open
+        dropping.dropDumps(false);
+        const size_t dumps = dropping.dumps();
+        for (size_t i = 0; i < 300 && dropping.dumps() == dumps; ++i)
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        dropping.append(fake::queryEvent("test", "BEGIN"));
+        dropping.append(fake::event(slave::TABLE_MAP_EVENT, table_map));
+        std::string rows_event("\x01\x00\x00\x00\x00\x00" "\x01\x00" "\x02\x00" "\x01" "\x01" "\x00", 13);
+        rows_event.append("\x03\x00\x00\x00", 4);
+        dropping.append(fake::event(slave::WRITE_ROWS_EVENT, rows_event));
+        dropping.append(fake::xidEvent(3));
+        for (size_t i = 0; i < 300 && rows == 0; ++i)
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+        stop = true;
+        reconnecting.close_connection();
+        thread.join();
+
+        BOOST_CHECK_EQUAL(rows.load(), 1);
+        BOOST_CHECK_EQUAL(dropping_stat.reconnects, 1);
+    }
+    void test_HedgedReading()
+    {
+        slave::columns_t columns(1);
+        columns[0].name = "id";
+        columns[0].type = "int(11)";
+        columns[0].mysql_type = MYSQL_TYPE_LONG;
+        columns[0].length = 11;
+
+        std::string table_map("\x01\x00\x00\x00\x00\x00" "\x01\x00", 8);
+        table_map.append("\x04" "test" "\x00" "\x04" "fake" "\x00", 12);
+        table_map.append("\x01" "\x03" "\x00" "\x00", 4);
+        const std::string sid = "3e11fa4771ca11e19e33c80aa9429562";
+        const auto transaction = [&table_map, &sid](fake::Master& master, int32_t id)
+        {
+            std::string rows("\x01\x00\x00\x00\x00\x00" "\x01\x00" "\x02\x00" "\x01" "\x01" "\x00", 13);
+            rows.append((const char*)&id, 4);
+
+            master.append(fake::gtidEvent(slave::gtid_t(sid, id)));
+            master.append(fake::queryEvent("test", "BEGIN"));
+            master.append(fake::event(slave::TABLE_MAP_EVENT, table_map));
+            master.append(fake::event(slave::WRITE_ROWS_EVENT, rows));
+            master.append(fake::xidEvent(id));
+        };
+
+        // Master and its replica, which lags behind
+        fake::Master::Options options;
+        options.gtid_mode = true;
+        fake::Master master(options);
+        options.server_id = 2;
+        fake::Master replica(options);
+        for (int32_t id = 1; id <= 3; ++id)
+            transaction(master, id);
+        for (int32_t id = 1; id <= 2; ++id)
+            transaction(replica, id);
+
+        const auto claims = std::make_shared<slave::GtidClaims>();
+        std::vector<int32_t> got;
+        size_t xids = 0;
+
+        const size_t count = 2;
+        fake::Master* sources[count] = {&master, &replica};
+        Fixture::TestExtState ext_states[count];
+        std::unique_ptr<slave::Slave> slaves[count];
+        for (size_t i = 0; i < count; ++i)
+        {
+            ext_states[i].setMasterPosition(slave::Position("mysql-bin.000001", 4));
+
+            slave::MasterInfo master_info;
+            master_info.conn_options.mysql_host = "127.0.0.1";
+            master_info.conn_options.mysql_port = sources[i]->port();
+            master_info.conn_options.mysql_user = "root";
+
+            slaves[i].reset(new slave::Slave(master_info, ext_states[i]));
+            slaves[i]->setCallback("test", "fake", [&got](slave::RecordSet& rs)
+            {
+                got.push_back(boost::any_cast<int32_t>(rs.m_row.at("id")));
+            });
+            slaves[i]->setXidCallback([&xids](unsigned int) { ++xids; });
+            slaves[i]->setGtidClaims(claims);
+            slaves[i]->init();
+            slaves[i]->enableGtid();
+            slaves[i]->createDatabaseStructure();
+            slaves[i]->open_remote_binlog();
+        }
+
+        // Both streams are read by one loop
+        const auto loop = [&](size_t rows)
+        {
+            for (int i = 0; i < 500 && got.size() < rows; ++i)
+            {
+                std::vector<pollfd> p;
+                for (const auto& slave : slaves)
+                    if (slave->binlog_fd() >= 0)
+                        p.push_back({slave->binlog_fd(), POLLIN, 0});
+                ::poll(p.data(), p.size(), 10);
+                for (const auto& slave : slaves)
+                    if (slave->binlog_fd() >= 0)
+                        slave->pump(100);
+            }
+            // Duplicates from the lagging stream
+            for (int i = 0; i < 20; ++i)
+            {
+                for (const auto& slave : slaves)
+                    if (slave->binlog_fd() >= 0)
+                        slave->pump(100);
+                std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            }
+            return got.size() == rows;
+        };
+
+        BOOST_CHECK(loop(3));
+        BOOST_CHECK_EQUAL(claims->duplicates(), 2);
+
+        // Master fails, its replica goes on without reconnect
+        master.disconnect();
+        BOOST_CHECK_THROW(loop(3), std::runtime_error);
+        transaction(replica, 3);
+        transaction(replica, 4);
+        BOOST_CHECK(loop(4));
+        BOOST_CHECK_EQUAL(claims->duplicates(), 3);
+        BOOST_CHECK_EQUAL(xids, 4);
+
+        slave::Position pos;
+        ext_states[1].getMasterPosition(pos);
+        BOOST_CHECK_EQUAL(pos.strGtid(), sid + ":1-4");
+        BOOST_CHECK(claims->claimed().hasGtid(slave::gtid_t(sid, 4)));
+
+        // Broken transaction is not claimed, so the other source could still deliver it
+        replica.append(fake::gtidEvent(slave::gtid_t(sid, 5)));
+        replica.append(fake::queryEvent("test", "BEGIN"));
+        replica.append(fake::event(slave::TABLE_MAP_EVENT, table_map));
+        replica.corruptNext();
+        replica.append(fake::event(slave::WRITE_ROWS_EVENT, std::string("\x01\x00\x00\x00\x00\x00" "\x01\x00" "\x02\x00" "\x01" "\x01" "\x00" "\x05\x00\x00\x00", 17)));
+        replica.append(fake::xidEvent(5));
+        loop(4);
+        BOOST_CHECK(!claims->claimed().hasGtid(slave::gtid_t(sid, 5)));
+        BOOST_CHECK_EQUAL(xids, 4);
+        slaves[1]->close_remote_binlog();
+
+        BOOST_REQUIRE_EQUAL(got.size(), 4);
+        for (int32_t id = 1; id <= 4; ++id)
+            BOOST_CHECK_EQUAL(got[id - 1], id);
+    }
+    void test_CallbackPattern()
+    {
+        fake::Master master;
+
+        slave::columns_t columns(1);
+        columns[0].name = "id";
+        columns[0].type = "int(11)";
+        columns[0].mysql_type = MYSQL_TYPE_LONG;
+        columns[0].length = 11;
+        master.addTable("shop_1", "orders", columns);
+        master.addTable("other", "orders", columns);
+
+        const auto transaction = [&master](uint64_t table_id, const std::string& db, int32_t id)
+        {
+            std::string table_map((const char*)&table_id, 6);
+            table_map.append("\x01\x00", 2);
+            table_map += static_cast<char>(db.size());
+            table_map.append(db.c_str(), db.size() + 1);
+            table_map.append("\x06" "orders" "\x00", 8);
+            table_map.append("\x01" "\x03" "\x00" "\x00", 4);
+
+            std::string rows((const char*)&table_id, 6);
+            rows.append("\x01\x00" "\x02\x00" "\x01" "\x01" "\x00", 7);
+            rows.append((const char*)&id, 4);
+
+            master.append(fake::queryEvent(db, "BEGIN"));
+            master.append(fake::event(slave::TABLE_MAP_EVENT, table_map));
+            master.append(fake::event(slave::WRITE_ROWS_EVENT, rows));
+            master.append(fake::xidEvent(id));
+        };
+        transaction(1, "shop_1", 1);
+        transaction(2, "other", 2);
+        // Structure of shop_2.orders is not on master yet
+        transaction(3, "shop_2", 3);
+
+        std::mutex mutex;
+        std::condition_variable cond;
+        std::vector<std::pair<std::string, int32_t>> got;
+
+        Fixture::TestExtState ext_state;
+        ext_state.setMasterPosition(slave::Position("mysql-bin.000001", 4));
+
+        slave::MasterInfo master_info;
+        master_info.conn_options.mysql_host = "127.0.0.1";
+        master_info.conn_options.mysql_port = master.port();
+        master_info.conn_options.mysql_user = "root";
+
+        slave::Slave slave(master_info, ext_state);
+        slave.setCallbackPattern("shop_*", "orders", [&](slave::RecordSet& rs)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            got.emplace_back(rs.db_name, boost::any_cast<int32_t>(rs.m_row.at("id")));
+            cond.notify_all();
+        });
+        slave.init();
+        slave.createDatabaseStructure();
+
+        std::atomic<bool> stop(false);
+        std::thread thread([&]()
+        {
+            slave.get_remote_binlog([&stop]() { return stop.load(); });
+            mysql_thread_end();
+        });
+
+        const auto wait = [&](size_t count)
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            return cond.wait_for(lock, std::chrono::seconds(5), [&]() { return got.size() >= count; });
+        };
+
+        BOOST_CHECK(wait(1));
+        for (size_t i = 0; i < 500 && ext_state.getIntransactionPos() != master.position().log_pos; ++i)
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+        // Missing table is not subscribed until it gets another table_id, i.e. after CREATE
+        master.addTable("shop_2", "orders", columns);
+        transaction(3, "shop_2", 4);
+        transaction(4, "shop_2", 5);
+        BOOST_CHECK(wait(2));
+
+        stop = true;
+        slave.close_connection();
+        thread.join();
+
+        BOOST_REQUIRE_EQUAL(got.size(), 2);
+        BOOST_CHECK_EQUAL(got[0].first, "shop_1");
+        BOOST_CHECK_EQUAL(got[0].second, 1);
+        BOOST_CHECK_EQUAL(got[1].first, "shop_2");
+        BOOST_CHECK_EQUAL(got[1].second, 5);
+    }
+    void test_Subscriptions()
+    {
+        const std::string path = "/tmp/libslave_subscriptions." + std::to_string(::getpid());
+        fake::Master master;
+
+        slave::columns_t columns(1);
+        columns[0].name = "id";
+        columns[0].type = "int(11)";
+        columns[0].mysql_type = MYSQL_TYPE_LONG;
+        columns[0].length = 11;
+        master.addTable("test", "a", columns);
+        master.addTable("test", "b", columns);
+
+        // Rows of "a", then two rows of "b" and a row of "missing", which is absent on master
+        const auto transaction = [&master](int32_t id)
+        {
+            master.append(fake::queryEvent("test", "BEGIN"));
+            const std::pair<uint64_t, int32_t> rows_of[] = {{1, id}, {2, id}, {2, id + 1000}, {3, id}};
+            uint64_t mapped = 0;
+            for (const auto& x : rows_of)
+            {
+                const std::string tbl = x.first == 1 ? "a" : x.first == 2 ? "b" : "missing";
+                if (x.first != mapped)
+                {
+                    std::string table_map((const char*)&x.first, 6);
+                    table_map.append("\x01\x00" "\x04" "test" "\x00", 8);
+                    table_map += static_cast<char>(tbl.size());
+                    table_map.append(tbl.c_str(), tbl.size() + 1);
+                    table_map.append("\x01" "\x03" "\x00" "\x00", 4);
+                    master.append(fake::event(slave::TABLE_MAP_EVENT, table_map));
+                    mapped = x.first;
+                }
+                std::string rows((const char*)&x.first, 6);
+                rows.append("\x01\x00" "\x02\x00" "\x01" "\x01" "\x00", 7);
+                rows.append((const char*)&x.second, 4);
+                master.append(fake::event(slave::WRITE_ROWS_EVENT, rows));
+            }
+            master.append(fake::xidEvent(id));
+        };
+
+        std::mutex mutex;
+        std::vector<std::pair<std::string, int32_t>> got;
+        std::atomic<int32_t> remove_at(0);
+
+        Fixture::TestExtState ext_state;
+        ext_state.setMasterPosition(slave::Position("mysql-bin.000001", 4));
+
+        slave::MasterInfo master_info;
+        master_info.conn_options.mysql_host = "127.0.0.1";
+        master_info.conn_options.mysql_port = master.port();
+        master_info.conn_options.mysql_user = "root";
+
+        slave::Slave slave(master_info, ext_state);
+        std::function<slave::callback (const std::string&)> collect;
+        collect = [&](const std::string& tbl) -> slave::callback
+        {
+            return [&, tbl](slave::RecordSet& rs)
+            {
+                const int32_t id = boost::any_cast<int32_t>(rs.m_row.at("id"));
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    got.emplace_back(tbl, id);
+                }
+                // Changes are made in the middle of transactions
+                if (tbl == "a" && id == 1)
+                {
+                    slave.addSubscription("test", "b", collect("b"));
+                    slave.addSubscription("test", "missing", collect("missing"));
+                }
+                if (tbl == "b" && id == remove_at)
+                    slave.removeSubscription("test", "b");
+            };
+        };
+        slave.setSchemaCache(path);
+        slave.setCallback("test", "a", collect("a"));
+        slave.init();
+        slave.createDatabaseStructure();
+
+        std::atomic<bool> stop(false);
+        std::thread thread([&]()
+        {
+            slave.get_remote_binlog([&stop]() { return stop.load(); });
+            mysql_thread_end();
+        });
+
+        const auto sync = [&]()
+        {
+            for (size_t i = 0; i < 500 && ext_state.getIntransactionPos() != master.position().log_pos; ++i)
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            return ext_state.getIntransactionPos() == master.position().log_pos;
+        };
+        const auto count = [&](const std::string& tbl)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            return std::count_if(got.begin(), got.end(), [&tbl](const std::pair<std::string, int32_t>& x) { return x.first == tbl; });
+        };
+
+        // "b" is read in background and is delivered from the start of some later transaction
+        int32_t id = 1;
+        transaction(id);
+        BOOST_CHECK(sync());
+        while (count("b") == 0 && id < 50)
+        {
+            transaction(++id);
+            BOOST_CHECK(sync());
+        }
+        const int32_t first = id;
+        BOOST_CHECK_GT(first, 1);
+
+        remove_at = ++id;
+        transaction(id);
+        transaction(++id);
+        BOOST_CHECK(sync());
+
+        stop = true;
+        slave.close_connection();
+        thread.join();
+
+        std::vector<std::pair<std::string, int32_t>> expected;
+        for (int32_t i = 1; i <= id; ++i)
+        {
+            expected.emplace_back("a", i);
+            if (i >= first && i <= remove_at)
+            {
+                expected.emplace_back("b", i);
+                expected.emplace_back("b", i + 1000);
+            }
+        }
+        BOOST_CHECK(got == expected);
+
+        // Table added at runtime is remembered in the schema cache
+        slave::SchemaCache cache(path);
+        BOOST_CHECK(cache.load());
+        BOOST_CHECK(cache.find(std::make_pair(std::string("test"), std::string("b")), slave::Position()));
+        BOOST_CHECK(!cache.find(std::make_pair(std::string("test"), std::string("missing")), slave::Position()));
+        ::unlink(path.c_str());
+    }
+    void test_AsyncChecksum()
+    {
+        fake::Master master;
+
+        slave::columns_t columns(1);
+        columns[0].name = "id";
+        columns[0].type = "int(11)";
+        columns[0].mysql_type = MYSQL_TYPE_LONG;
+        columns[0].length = 11;
+        master.addTable("test", "fake", columns);
+
+        std::string table_map("\x01\x00\x00\x00\x00\x00" "\x01\x00", 8);
+        table_map.append("\x04" "test" "\x00" "\x04" "fake" "\x00", 12);
+        table_map.append("\x01" "\x03" "\x00" "\x00", 4);
+        const auto transaction = [&master, &table_map](int32_t id, bool broken)
+        {
+            std::string rows("\x01\x00\x00\x00\x00\x00" "\x01\x00" "\x02\x00" "\x01" "\x01" "\x00", 13);
+            rows.append((const char*)&id, 4);
+
+            master.append(fake::queryEvent("test", "BEGIN"));
+            master.append(fake::event(slave::TABLE_MAP_EVENT, table_map));
+            if (broken)
+                master.corruptNext();
+            master.append(fake::event(slave::WRITE_ROWS_EVENT, rows));
+            master.append(fake::xidEvent(id));
+        };
+        transaction(1, false);
+        const unsigned long committed = master.position().log_pos;
+        transaction(2, true);
+
+        Fixture::TestExtState ext_state;
+        ext_state.setMasterPosition(slave::Position("mysql-bin.000001", 4));
+
+        slave::MasterInfo master_info;
+        master_info.conn_options.mysql_host = "127.0.0.1";
+        master_info.conn_options.mysql_port = master.port();
+        master_info.conn_options.mysql_user = "root";
+        master_info.reconnect_initial_ms = 10;
+
+        std::atomic<size_t> rows(0);
+        slave::Slave slave(master_info, ext_state);
+        slave.setCallback("test", "fake", [&rows](slave::RecordSet&) { ++rows; });
+        slave.setChecksumPolicy(slave::ChecksumPolicy::Async);
+        slave.init();
+        slave.createDatabaseStructure();
+
+        std::atomic<bool> stop(false);
+        std::thread thread([&]()
+        {
+            slave.get_remote_binlog([&stop]() { return stop.load(); });
+            mysql_thread_end();
+        });
+
+        // Broken transaction is read again and again, its XID never gets into the position
+        for (size_t i = 0; i < 500 && master.dumps() < 3; ++i)
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        BOOST_CHECK_GE(master.dumps(), 3);
+
+        stop = true;
+        slave.close_connection();
+        thread.join();
+
+        slave::Position pos;
+        ext_state.getMasterPosition(pos);
+        BOOST_CHECK_EQUAL(pos.log_pos, committed);
+        BOOST_CHECK_GE(rows.load(), 3);
+    }
+    struct Item
+    {
+        int64_t id;
+    };
+
+    void test_BindingAlter()
+    {
+        fake::Master master;
+
+        slave::columns_t columns(1);
+        columns[0].name = "id";
+        columns[0].type = "int(11)";
+        columns[0].mysql_type = MYSQL_TYPE_LONG;
+        columns[0].length = 11;
+        master.addTable("test", "fake", columns);
+
+        std::string table_map("\x01\x00\x00\x00\x00\x00" "\x01\x00", 8);
+        table_map.append("\x04" "test" "\x00" "\x04" "fake" "\x00", 12);
+        table_map.append("\x01" "\x03" "\x00" "\x00", 4);
+        const auto transaction = [&master, &table_map](int32_t id)
+        {
+            std::string rows("\x01\x00\x00\x00\x00\x00" "\x01\x00" "\x02\x00" "\x01" "\x01" "\x00", 13);
+            rows.append((const char*)&id, 4);
+
+            master.append(fake::queryEvent("test", "BEGIN"));
+            master.append(fake::event(slave::TABLE_MAP_EVENT, table_map));
+            master.append(fake::event(slave::WRITE_ROWS_EVENT, rows));
+            master.append(fake::xidEvent(id));
+        };
+        transaction(1);
+
+        Fixture::TestExtState ext_state;
+        ext_state.setMasterPosition(slave::Position("mysql-bin.000001", 4));
+
+        slave::MasterInfo master_info;
+        master_info.conn_options.mysql_host = "127.0.0.1";
+        master_info.conn_options.mysql_port = master.port();
+        master_info.conn_options.mysql_user = "root";
+        master_info.reconnect_initial_ms = 10;
+        master_info.connect_retry = 1;
+
+        std::mutex mutex;
+        std::vector<int64_t> got;
+        slave::RowBinding<Item> binding([&](const slave::BoundRow<Item>& row)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            got.push_back(row.row.id);
+        });
+        binding.column("id", &Item::id);
+
+        slave::Slave slave(master_info, ext_state);
+        slave.setCallback("test", "fake", binding);
+        slave.init();
+        slave.createDatabaseStructure();
+
+        std::atomic<bool> stop(false);
+        std::thread thread([&]()
+        {
+            slave.get_remote_binlog([&stop]() { return stop.load(); });
+            mysql_thread_end();
+        });
+
+        for (size_t i = 0; i < 500 && ext_state.getIntransactionPos() != master.position().log_pos; ++i)
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        const unsigned long committed = master.position().log_pos;
+        BOOST_CHECK_EQUAL(ext_state.getIntransactionPos(), committed);
+
+        // Column of the binding is renamed: rows after ALTER are neither passed nor skipped
+        columns[0].name = "item_id";
+        master.addTable("test", "fake", columns);
+        master.append(fake::queryEvent("test", "ALTER TABLE fake CHANGE id item_id int(11)"));
+        transaction(2);
+
+        for (size_t i = 0; i < 500 && master.dumps() < 3; ++i)
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        BOOST_CHECK_GE(master.dumps(), 3);
+
+        stop = true;
+        slave.close_connection();
+        thread.join();
+
+        slave::Position pos;
+        ext_state.getMasterPosition(pos);
+        BOOST_CHECK_EQUAL(pos.log_pos, committed);
+        BOOST_REQUIRE_EQUAL(got.size(), 1);
+        BOOST_CHECK_EQUAL(got[0], 1);
+    }
 }// anonymous-namespace
 
 test_suite* init_unit_test_suite(int argc, char* argv[])
@@ -1729,6 +3537,31 @@ test_suite* init_unit_test_suite(int argc, char* argv[])
     ADD_FIXTURE_TEST(test_AlterCreateTable);
     ADD_FIXTURE_TEST(test_GtidParsing);
     ADD_FIXTURE_TEST(test_GtidAdding);
+    ADD_FIXTURE_TEST(test_SchemaCache);
+    ADD_FIXTURE_TEST(test_SharedSchemas);
+    ADD_FIXTURE_TEST(test_TablePattern);
+    ADD_FIXTURE_TEST(test_TzTable);
+    ADD_FIXTURE_TEST(test_DecimalModes);
+    ADD_FIXTURE_TEST(test_TemporalPacked);
+    ADD_FIXTURE_TEST(test_EnumOrdinal);
+    ADD_FIXTURE_TEST(test_JsonBinary);
+    ADD_FIXTURE_TEST(test_JsonPartialUpdate);
+    ADD_FIXTURE_TEST(test_TransactionPayload);
+    ADD_FIXTURE_TEST(test_Crc32);
+    ADD_FIXTURE_TEST(test_EventFilter);
+    ADD_FIXTURE_TEST(test_RowBinding);
+    ADD_FIXTURE_TEST(test_FakeMaster);
+    ADD_FIXTURE_TEST(test_NativeReader);
+    ADD_FIXTURE_TEST(test_NanomysqlCursor);
+    ADD_FIXTURE_TEST(test_BinlogStream);
+    ADD_FIXTURE_TEST(test_NonBlocking);
+    ADD_FIXTURE_TEST(test_SlaveGroup);
+    ADD_FIXTURE_TEST(test_Reconnect);
+    ADD_FIXTURE_TEST(test_HedgedReading);
+    ADD_FIXTURE_TEST(test_CallbackPattern);
+    ADD_FIXTURE_TEST(test_Subscriptions);
+    ADD_FIXTURE_TEST(test_AsyncChecksum);
+    ADD_FIXTURE_TEST(test_BindingAlter);
 
 #undef ADD_FIXTURE_TEST
 
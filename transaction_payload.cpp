@@ -0,0 +1,216 @@
+/* Copyright 2011 ZAO "Begun".
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include <my_byteorder.h>
+#undef min
+#undef max
+#undef test
+
+#include <mysql.h>
+
+#ifdef SLAVE_WITH_ZSTD
+#include <zstd.h>
+#endif
+
+#include "slave_log_event.h"
+#include "transaction_payload.h"
+
+#include "Logging.h"
+
+namespace
+{
+// Fields of payload header, see Transaction_payload_event @ control_events.h
+enum
+{
+    OTW_PAYLOAD_HEADER_END_MARK         = 0,
+    OTW_PAYLOAD_SIZE_FIELD              = 1,
+    OTW_PAYLOAD_COMPRESSION_TYPE_FIELD  = 2,
+    OTW_PAYLOAD_UNCOMPRESSED_SIZE_FIELD = 3
+};
+
+enum
+{
+    COMPRESSION_ZSTD = 0,
+    COMPRESSION_NONE = 255
+};
+
+// Output chunk, enough for the most of events
+const size_t chunk_size = 128 * 1024;
+}// anonymous-namespace
+
+namespace slave
+{
+
+TransactionPayload::~TransactionPayload()
+{
+#ifdef SLAVE_WITH_ZSTD
+    if (m_ctx)
+        ZSTD_freeDCtx(m_ctx);
+#endif
+}
+
+void TransactionPayload::read(const char* buf, unsigned int event_len, const callback_t& callback)
+{
+    unsigned char* p = (unsigned char*)buf + LOG_EVENT_HEADER_LEN;
+    unsigned char* const end = (unsigned char*)buf + event_len;
+
+    uint64_t payload_size = 0;
+    uint64_t compression = COMPRESSION_NONE;
+    uint64_t uncompressed_size = 0;
+
+    // Every field is: type, length of value, value; all are packed integers
+    for (;;) {
+        if (p >= end) {
+            throw std::runtime_error("TransactionPayload::read(): truncated payload header");
+        }
+        const uint64_t type = net_field_length_ll(&p);
+        if (type == OTW_PAYLOAD_HEADER_END_MARK)
+            break;
+
+        const uint64_t length = net_field_length_ll(&p);
+        if (p + length > end) {
+            throw std::runtime_error("TransactionPayload::read(): truncated payload header");
+        }
+        unsigned char* value = p;
+        p += length;
+
+        switch (type) {
+            case OTW_PAYLOAD_SIZE_FIELD:              payload_size = net_field_length_ll(&value); break;
+            case OTW_PAYLOAD_COMPRESSION_TYPE_FIELD:  compression = net_field_length_ll(&value); break;
+            case OTW_PAYLOAD_UNCOMPRESSED_SIZE_FIELD: uncompressed_size = net_field_length_ll(&value); break;
+            default: break;     // unknown fields are skipped
+        }
+    }
+
+    if (payload_size != static_cast<uint64_t>(end - p)) {
+        LOG_ERROR(log, "Transaction payload size " << payload_size << " != " << end - p);
+        throw std::runtime_error("TransactionPayload::read(): bad payload size");
+    }
+
+    LOG_TRACE(log, "Transaction payload: compression " << compression << ", size " << payload_size
+              << ", uncompressed " << uncompressed_size);
+
+    m_last_compressed = payload_size;
+    m_last_uncompressed = 0;
+
+    switch (compression) {
+        case COMPRESSION_NONE:
+            if (dispatch((const char*)p, payload_size, callback) != payload_size) {
+                throw std::runtime_error("TransactionPayload::read(): truncated event in payload");
+            }
+            m_last_uncompressed = payload_size;
+            break;
+        case COMPRESSION_ZSTD:
+            decompress((const char*)p, payload_size, callback);
+            break;
+        default:
+            LOG_ERROR(log, "Unknown compression type of transaction payload: " << compression);
+            throw std::runtime_error("TransactionPayload::read(): unknown compression");
+    }
+
+    if (uncompressed_size && uncompressed_size != m_last_uncompressed) {
+        LOG_ERROR(log, "Transaction payload uncompressed size " << m_last_uncompressed << " != " << uncompressed_size);
+        throw std::runtime_error("TransactionPayload::read(): bad uncompressed size");
+    }
+
+    m_compressed += m_last_compressed;
+    m_uncompressed += m_last_uncompressed;
+}
+
+size_t TransactionPayload::dispatch(const char* data, size_t size, const callback_t& callback)
+{
+    size_t pos = 0;
+    while (size - pos >= LOG_EVENT_HEADER_LEN) {
+        const char* event = data + pos;
+        const unsigned int len = uint4korr(event + EVENT_LEN_OFFSET);
+        if (len < LOG_EVENT_HEADER_LEN) {
+            throw std::runtime_error("TransactionPayload::dispatch(): bad event length");
+        }
+        if (size - pos < len)
+            break;
+
+        callback(event, len);
+        pos += len;
+    }
+    return pos;
+}
+
+#ifdef SLAVE_WITH_ZSTD
+
+void TransactionPayload::decompress(const char* data, size_t size, const callback_t& callback)
+{
+    if (!m_ctx) {
+        m_ctx = ZSTD_createDCtx();
+        if (!m_ctx) {
+            throw std::bad_alloc();
+        }
+    } else {
+        ZSTD_DCtx_reset(m_ctx, ZSTD_reset_session_only);
+    }
+
+    ZSTD_inBuffer in = {data, size, 0};
+    // Decompressed and not yet dispatched events are in m_buffer[begin, end)
+    size_t begin = 0, end = 0;
+    size_t ret = 1;
+
+    while (ret != 0) {
+        // Incomplete event is moved to the beginning, buffer grows if it does not fit
+        if (begin) {
+            ::memmove(m_buffer.data(), m_buffer.data() + begin, end - begin);
+            end -= begin;
+            begin = 0;
+        }
+        size_t need = chunk_size;
+        if (end >= LOG_EVENT_HEADER_LEN)
+            need = std::max<size_t>(need, uint4korr(m_buffer.data() + EVENT_LEN_OFFSET));
+        if (m_buffer.size() < end + need)
+            m_buffer.resize(end + need);
+
+        ZSTD_outBuffer out = {m_buffer.data(), m_buffer.size(), end};
+        const size_t in_pos = in.pos;
+        ret = ZSTD_decompressStream(m_ctx, &out, &in);
+        if (ZSTD_isError(ret)) {
+            LOG_ERROR(log, "Transaction payload decompression failed: " << ZSTD_getErrorName(ret));
+            throw std::runtime_error("TransactionPayload::decompress(): ZSTD_decompressStream() failed");
+        }
+        if (ret != 0 && in.pos == in_pos && out.pos == end) {
+            throw std::runtime_error("TransactionPayload::decompress(): truncated payload");
+        }
+
+        m_last_uncompressed += out.pos - end;
+        end = out.pos;
+        begin += dispatch(m_buffer.data() + begin, end - begin, callback);
+    }
+
+    if (begin != end || in.pos != in.size) {
+        throw std::runtime_error("TransactionPayload::decompress(): garbage after events");
+    }
+}
+
+#else
+
+void TransactionPayload::decompress(const char* data, size_t size, const callback_t& callback)
+{
+    LOG_ERROR(log, "Transaction payload is compressed with zstd, but libslave is built without it");
+    throw std::runtime_error("TransactionPayload::decompress(): zstd is not supported");
+}
+
+#endif
+
+}// slave
@@ -0,0 +1,74 @@
+/* Copyright 2011 ZAO "Begun".
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __SLAVE_TRANSACTION_PAYLOAD_H_
+#define __SLAVE_TRANSACTION_PAYLOAD_H_
+
+#include <inttypes.h>
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+struct ZSTD_DCtx_s;
+
+namespace slave
+{
+
+// Events of TRANSACTION_PAYLOAD_EVENT, which is written by MySQL 8 with
+// binlog_transaction_compression=ON. Payload is decompressed chunk by chunk into a buffer,
+// which is kept between transactions, so it grows up to the size of the largest event only.
+// zstd compression requires library built with SLAVE_WITH_ZSTD.
+class TransactionPayload
+{
+public:
+
+    // Inner event without checksum, data is valid only during the call
+    typedef std::function<void (const char* buf, unsigned int event_len)> callback_t;
+
+    TransactionPayload() {}
+    ~TransactionPayload();
+
+    TransactionPayload(const TransactionPayload&) = delete;
+    TransactionPayload& operator= (const TransactionPayload&) = delete;
+
+    // Calls callback for every event in the payload. buf and event_len are of the whole
+    // TRANSACTION_PAYLOAD_EVENT without checksum.
+    void read(const char* buf, unsigned int event_len, const callback_t& callback);
+
+    // Sizes of the last payload
+    uint64_t lastCompressed() const { return m_last_compressed; }
+    uint64_t lastUncompressed() const { return m_last_uncompressed; }
+
+    // Totals of all payloads read
+    uint64_t compressedBytes() const { return m_compressed; }
+    uint64_t uncompressedBytes() const { return m_uncompressed; }
+
+private:
+
+    // Calls callback for complete events in data, returns their total size
+    size_t dispatch(const char* data, size_t size, const callback_t& callback);
+    void decompress(const char* data, size_t size, const callback_t& callback);
+
+    ZSTD_DCtx_s*      m_ctx = nullptr;
+    std::vector<char> m_buffer;
+
+    uint64_t m_last_compressed = 0;
+    uint64_t m_last_uncompressed = 0;
+    uint64_t m_compressed = 0;
+    uint64_t m_uncompressed = 0;
+};
+
+}// slave
+
+#endif
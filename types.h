@@ -2,8 +2,12 @@
 #define __SLAVE_TYPES_H
 
 #include <inttypes.h>
+#include <map>
 #include <string>
 #include <time.h>
+#include <vector>
+
+#include "json_binary.h"
 
 // conflict with macro defined in mysql
 #ifdef test
@@ -43,6 +47,52 @@ namespace types
     typedef std::string         MY_LONGTEXT;
     typedef std::string         MY_BLOB;
 
+    // TIMESTAMP value in TimestampMode::Raw
+    struct Timestamp
+    {
+        int64_t  sec;   // seconds since epoch
+        uint32_t usec;
+    };
+
+    // DATETIME and TIME values in TemporalMode::Packed
+    struct DateTime
+    {
+        MY_DATETIME datetime;
+        uint32_t    usec;
+    };
+
+    struct Time
+    {
+        MY_TIME  time;
+        uint32_t usec;
+        // Sign of the whole value, time alone loses it when it is 0, i.e. -00:00:00.5
+        bool     neg = false;
+    };
+
+    // Labels of ENUM or SET column, owned by table structure: they are valid
+    // while the structure is not changed by ALTER, i.e. inside callback.
+    typedef std::vector<std::string> Labels;
+
+    // ENUM value in EnumMode::Ordinal: 1-based index of the label, 0 for the empty value
+    struct Enum
+    {
+        MY_ENUM       ordinal;
+        const Labels* labels;
+
+        // nullptr for the empty value and for ordinal out of labels, i.e. written before ALTER
+        const std::string* label() const
+        {
+            return ordinal > 0 && size_t(ordinal) <= labels->size() ? &(*labels)[ordinal - 1] : nullptr;
+        }
+    };
+
+    // SET value in EnumMode::Ordinal: bit N means labels[N] is in the set
+    struct Set
+    {
+        MY_SET        bits;
+        const Labels* labels;
+    };
+
     // NOTE you should call tzset directly or indirectly before using any of these functions
     // for proper initialization of daylight variable
 
@@ -88,6 +138,37 @@ namespace types
 
         return mktime(&t);
     }
+
+    // Days since epoch of the civil date, see http://howardhinnant.github.io/date_algorithms.html#days_from_civil
+    inline int64_t daysFromCivil(int year, unsigned month, unsigned day)
+    {
+        year -= month <= 2;
+        const int64_t era = (year >= 0 ? year : year - 399) / 400;
+        const unsigned yoe = static_cast<unsigned>(year - era * 400);
+        const unsigned doy = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+        const unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+        return era * 146097 + static_cast<int64_t>(doe) - 719468;
+    }
+
+    // Converts date from slave to timestamp assuming date is specified in UTC. Unlike date2time
+    // it does not call mktime, so it takes no timezone lock.
+    inline int64_t date2epoch(MY_DATE date)
+    {
+        if (0 == date)
+            return 0;
+
+        return daysFromCivil(date >> 9, (date >> 5) % (1 << 4), date % (1 << 5)) * 86400;
+    }
+
+    // Converts date and time from slave to timestamp assuming it is specified in UTC, without mktime.
+    inline int64_t datetime2epoch(MY_DATETIME datetime)
+    {
+        if (0 == datetime)
+            return 0;
+
+        const int64_t days = daysFromCivil(datetime / 10000000000, (datetime / 100000000) % 100, (datetime / 1000000) % 100);
+        return days * 86400 + (datetime / 10000) % 100 * 3600 + (datetime / 100) % 100 * 60 + datetime % 100;
+    }
 }// types
 
 enum class RowType {
@@ -95,6 +176,79 @@ enum class RowType {
     Vector
 };
 
+// Output of TIMESTAMP columns
+enum class TimestampMode {
+    String,     // 'YYYY-MM-DD hh:mm:ss[.ffffff]' in local timezone
+    Raw         // types::Timestamp
+};
+
+// Output of DECIMAL(M,D) columns
+enum class DecimalMode {
+    String,     // '-123.45'
+    Scaled,     // value * 10^D as int64_t if M <= 18, as __int128 otherwise (M <= 38)
+    Double      // types::MY_DECIMAL
+};
+
+// Output of DATE, DATETIME and TIME columns
+enum class TemporalMode {
+    String,     // 'YYYY-MM-DD', 'YYYY-MM-DD hh:mm:ss[.ffffff]', '[-]hh:mm:ss[.ffffff]'
+    Packed      // types::MY_DATE, types::DateTime, types::Time
+};
+
+// Output of ENUM and SET columns
+enum class EnumMode {
+    String,     // label, labels joined with commas for SET
+    Ordinal     // types::Enum, types::Set
+};
+
+// Output of JSON columns
+enum class JsonMode {
+    Text,       // JSON text as printed by MySQL
+    View        // json::Value over binary data of the event, valid only inside callback
+};
+
+// Output of JSON columns updated partially (PARTIAL_UPDATE_ROWS_EVENT) in after image
+enum class PartialJsonMode {
+    Diffs,      // json::Diffs over binary data of the event, valid only inside callback
+    Apply       // JSON text of before image with diffs applied
+};
+
+// Output modes of a column, defaults give values as strings
+struct ColumnOptions
+{
+    TimestampMode timestamp = TimestampMode::String;
+    DecimalMode   decimal   = DecimalMode::String;
+    TemporalMode  temporal  = TemporalMode::String;
+    EnumMode      enums     = EnumMode::String;
+    JsonMode      json      = JsonMode::Text;
+    PartialJsonMode partial_json = PartialJsonMode::Diffs;
+
+    bool operator== (const ColumnOptions& other) const
+    {
+        return timestamp == other.timestamp && decimal == other.decimal
+            && temporal == other.temporal && enums == other.enums && json == other.json
+            && partial_json == other.partial_json;
+    }
+};
+
+// Output modes of table columns: common ones and overrides by column name
+struct FieldOptions
+{
+    ColumnOptions defaults;
+    std::map<std::string, ColumnOptions> columns;
+
+    const ColumnOptions& get(const std::string& column) const
+    {
+        const auto it = columns.find(column);
+        return it == columns.end() ? defaults : it->second;
+    }
+
+    bool operator== (const FieldOptions& other) const
+    {
+        return defaults == other.defaults && columns == other.columns;
+    }
+};
+
 #ifdef SLAVE_USE_VARIANT_FOR_FIELD_VALUE
     using FieldValue = boost::variant<std::nullptr_t
                                     , int
@@ -103,9 +257,18 @@ enum class RowType {
                                     , int32_t
                                     , uint32_t
                                     , unsigned long long
+                                    , int64_t
+                                    , __int128
                                     , float
                                     , double
                                     , std::string
+                                    , types::Timestamp
+                                    , types::DateTime
+                                    , types::Time
+                                    , types::Enum
+                                    , types::Set
+                                    , json::Value
+                                    , json::Diffs
                                     >;
     inline std::nullptr_t nullFieldValue() { return nullptr; }
     inline bool isNullFieldValue(const FieldValue& v) { return v.type() == typeid(std::nullptr_t); }
@@ -0,0 +1,106 @@
+/* Copyright 2011 ZAO "Begun".
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <limits>
+#include <time.h>
+
+#include "tz_table.h"
+
+namespace
+{
+// TIMESTAMP range is '1970-01-01 00:00:01' UTC to '2038-01-19 03:14:07' UTC
+const int64_t timestamp_max = std::numeric_limits<int32_t>::max();
+
+// Timezones do not change offset more often than once a day
+const int64_t probe_step = 86400;
+
+int gmtoff(int64_t t)
+{
+    const time_t ts = t;
+    struct ::tm tm_;
+    ::localtime_r(&ts, &tm_);
+    return tm_.tm_gmtoff;
+}
+}// anonymous-namespace
+
+namespace slave
+{
+
+const TzTable& TzTable::local()
+{
+    static const TzTable table(0, timestamp_max);
+    return table;
+}
+
+TzTable::TzTable(int64_t from, int64_t to)
+{
+    ::tzset();
+
+    int current = gmtoff(from);
+    m_transitions.push_back({std::numeric_limits<int64_t>::min(), current});
+
+    for (int64_t t = from; t < to; )
+    {
+        const int64_t next = std::min(t + probe_step, to);
+        if (gmtoff(next) == current)
+        {
+            t = next;
+            continue;
+        }
+
+        // transition is in (t, next]
+        int64_t lo = t, hi = next;
+        while (hi - lo > 1)
+        {
+            const int64_t mid = lo + (hi - lo) / 2;
+            if (gmtoff(mid) == current)
+                lo = mid;
+            else
+                hi = mid;
+        }
+
+        current = gmtoff(hi);
+        m_transitions.push_back({hi, current});
+        t = hi;
+    }
+}
+
+int TzTable::offset(int64_t t, size_t& hint) const
+{
+    if (hint < m_transitions.size() && m_transitions[hint].at <= t
+        && (hint + 1 == m_transitions.size() || t < m_transitions[hint + 1].at))
+        return m_transitions[hint].offset;
+
+    const auto it = std::upper_bound(m_transitions.begin(), m_transitions.end(), t,
+                                     [](int64_t x, const Transition& tr) { return x < tr.at; });
+    hint = it - m_transitions.begin() - 1;
+    return m_transitions[hint].offset;
+}
+
+void civilFromDays(int64_t days, int& year, unsigned& month, unsigned& day)
+{
+    // see http://howardhinnant.github.io/date_algorithms.html#civil_from_days
+    days += 719468;
+    const int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+    const unsigned doe = static_cast<unsigned>(days - era * 146097);
+    const unsigned yoe = (doe - doe/1460 + doe/36524 - doe/146096) / 365;
+    const unsigned doy = doe - (365*yoe + yoe/4 - yoe/100);
+    const unsigned mp = (5*doy + 2)/153;
+    day = doy - (153*mp + 2)/5 + 1;
+    month = mp < 10 ? mp + 3 : mp - 9;
+    year = static_cast<int>(yoe + era * 400) + (month <= 2);
+}
+
+}// slave
@@ -0,0 +1,58 @@
+/* Copyright 2011 ZAO "Begun".
+ *
+ * This library is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU Lesser General Public License as published by the Free
+ * Software Foundation; either version 3 of the License, or (at your option)
+ * any later version.
+ * This library is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Lesser General Public License for more
+ * details.
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __SLAVE_TZ_TABLE_H_
+#define __SLAVE_TZ_TABLE_H_
+
+#include <inttypes.h>
+#include <cstddef>
+#include <vector>
+
+namespace slave
+{
+
+// UTC offsets of the local timezone over the TIMESTAMP range, precomputed with localtime_r,
+// so that converting a TIMESTAMP to local time takes no glibc timezone lock.
+class TzTable
+{
+public:
+
+    // Table of the local timezone as it is at the first call (changes of TZ are not followed).
+    static const TzTable& local();
+
+    // Offset from UTC in seconds at given time. Hint is the index of the interval found
+    // by the previous call, it makes lookup O(1) for close times.
+    int offset(int64_t t, size_t& hint) const;
+
+    size_t transitions() const { return m_transitions.size(); }
+
+private:
+
+    TzTable(int64_t from, int64_t to);
+
+    struct Transition
+    {
+        int64_t at;     // offset is used since this time
+        int     offset;
+    };
+
+    std::vector<Transition> m_transitions;
+};
+
+// Converts days since epoch to civil date.
+void civilFromDays(int64_t days, int& year, unsigned& month, unsigned& day);
+
+}// slave
+
+#endif